@@ -52,8 +52,8 @@ static const char *const _FATFS_ERROR_NAMES[]{
 /* FAT file and directory classes */
 
 size_t FATFile::read(void *output, size_t length) {
-	size_t actualLength;
-	auto   error = f_read(&_fd, output, length, &actualLength);
+	UINT actualLength;
+	auto error = f_read(&_fd, output, length, &actualLength);
 
 	if (error) {
 		LOG_FS("%s", _FATFS_ERROR_NAMES[error]);
@@ -64,8 +64,8 @@ size_t FATFile::read(void *output, size_t length) {
 }
 
 size_t FATFile::write(const void *input, size_t length) {
-	size_t actualLength;
-	auto   error = f_write(&_fd, input, length, &actualLength);
+	UINT actualLength;
+	auto error = f_write(&_fd, input, length, &actualLength);
 
 	if (error) {
 		LOG_FS("%s", _FATFS_ERROR_NAMES[error]);
@@ -75,7 +75,54 @@ size_t FATFile::write(const void *input, size_t length) {
 	return uint64_t(actualLength);
 }
 
+static constexpr size_t _INITIAL_LINK_MAP_LENGTH = 16;
+static constexpr size_t _MAX_LINK_MAP_LENGTH     = 256;
+
+void FATFile::_createLinkMap(void) {
+	// Try building the map with a small table first, then retry with a table
+	// of the exact size required if the file turns out to be more fragmented.
+	// Files that would need a larger table than allowed are seeked through by
+	// following the FAT chain as usual.
+	size_t length = _INITIAL_LINK_MAP_LENGTH;
+
+	for (;;) {
+		auto table = _linkMap.allocate<DWORD>(length);
+
+		if (!table)
+			break;
+
+		table[0]  = length;
+		_fd.cltbl = table;
+
+		auto error = f_lseek(&_fd, CREATE_LINKMAP);
+
+		if (!error)
+			return;
+
+		_fd.cltbl = nullptr;
+
+		if (error != FR_NOT_ENOUGH_CORE) {
+			LOG_FS("%s", _FATFS_ERROR_NAMES[error]);
+			break;
+		}
+		if ((table[0] <= length) || (table[0] > _MAX_LINK_MAP_LENGTH)) {
+			LOG_FS("file too fragmented, length=%d", table[0]);
+			break;
+		}
+
+		length = table[0];
+	}
+
+	_linkMap.destroy();
+	_linkMapFailed = true;
+}
+
 uint64_t FATFile::seek(uint64_t offset) {
+	// Files opened for writing may grow, which would invalidate the map (and
+	// FatFs does not allow extending files in fast seek mode anyway).
+	if (!_fd.cltbl && !_linkMapFailed && !(_fd.flag & FA_WRITE))
+		_createLinkMap();
+
 	auto error = f_lseek(&_fd, offset);
 
 	if (error) {
@@ -91,31 +138,86 @@ uint64_t FATFile::tell(void) const {
 }
 
 void FATFile::close(void) {
+	// Let the VFS know that any information it cached about this file (such
+	// as its size) is no longer valid.
+	if (_fd.flag & FA_WRITE)
+		(*_changeCount)++;
+
 	f_close(&_fd);
+
+	_fd.cltbl = nullptr;
+	_linkMap.destroy();
 }
 
 bool FATDirectory::getEntry(FileInfo &output) {
+	return getEntries(&output, 1) == 1;
+}
+
+size_t FATDirectory::getEntries(FileInfo *output, size_t count) {
 	FILINFO info;
-	auto    error = f_readdir(&_fd, &info);
+	size_t  actualCount = 0;
 
-	if (error) {
-		LOG_FS("%s", _FATFS_ERROR_NAMES[error]);
-		return false;
-	}
-	if (!info.fname[0])
-		return false;
+	for (; actualCount < count; actualCount++, output++) {
+		auto error = f_readdir(&_fd, &info);
 
-	__builtin_strncpy(output.name, info.fname, sizeof(output.name));
-	output.size       = info.fsize;
-	output.attributes = info.fattrib;
+		if (error) {
+			LOG_FS("%s", _FATFS_ERROR_NAMES[error]);
+			break;
+		}
+		if (!info.fname[0])
+			break;
 
-	return true;
+		__builtin_strncpy(output->name, info.fname, sizeof(output->name));
+		output->size       = info.fsize;
+		output->attributes = info.fattrib;
+	}
+
+	return actualCount;
 }
 
 void FATDirectory::close(void) {
 	f_closedir(&_fd);
 }
 
+/* Write combining buffer */
+
+// FatFs tends to issue lots of small writes to adjacent sectors (e.g. one
+// cluster at a time when appending to a file), each of which would otherwise
+// result in a separate command being sent to the drive. Contiguous writes are
+// accumulated into a buffer and only flushed once it is full, FatFs issues a
+// non-contiguous write or reads back a buffered sector, or the volume is synced
+// or unmounted.
+static constexpr size_t _WRITE_BUFFER_LENGTH = 64; // Sectors
+
+struct WriteBuffer {
+public:
+	util::Data data;
+	LBA_t      lba;
+	size_t     count;
+};
+
+static WriteBuffer _writeBuffers[util::countOf(ide::devices)];
+
+static DRESULT _flushWriteBuffer(uint8_t drive) {
+	auto &buffer = _writeBuffers[drive];
+
+	if (!buffer.count)
+		return RES_OK;
+
+	auto error = ide::devices[drive].writeData(
+		buffer.data.ptr, buffer.lba, buffer.count
+	);
+
+	if (error)
+		LOG_FS(
+			"%s, lba=0x%x, cnt=%d", ide::getErrorString(error),
+			uint32_t(buffer.lba), buffer.count
+		);
+
+	buffer.count = 0;
+	return error ? RES_ERROR : RES_OK;
+}
+
 /* FAT filesystem provider */
 
 bool FATProvider::init(int drive) {
@@ -124,10 +226,20 @@ bool FATProvider::init(int drive) {
 
 	_drive[0] = drive + '0';
 
+	// Failing to allocate the write buffer is not fatal, as writes will simply
+	// be passed through to the drive.
+	auto &buffer = _writeBuffers[drive];
+
+	buffer.count = 0;
+	buffer.data.allocate(
+		_WRITE_BUFFER_LENGTH * ide::devices[drive].getSectorSize()
+	);
+
 	auto error = f_mount(&_fs, _drive, 1);
 
 	if (error) {
 		LOG_FS("%s: %s", _FATFS_ERROR_NAMES[error], _drive);
+		buffer.data.destroy();
 		return false;
 	}
 
@@ -144,6 +256,10 @@ void FATProvider::close(void) {
 	if (!type)
 		return;
 
+	int drive = _drive[0] - '0';
+
+	_flushWriteBuffer(drive);
+
 	auto error = f_unmount(_drive);
 
 	if (error) {
@@ -151,6 +267,8 @@ void FATProvider::close(void) {
 		return;
 	}
 
+	_writeBuffers[drive].data.destroy();
+
 	type     = NONE;
 	capacity = 0;
 
@@ -175,6 +293,10 @@ uint64_t FATProvider::getFreeSpace(void) {
 	return uint64_t(count) * uint64_t(clusterSize);
 }
 
+uint32_t FATProvider::getChangeCount(void) const {
+	return _changeCount;
+}
+
 bool FATProvider::_selectDrive(void) {
 	if (!_fs.fs_type)
 		return false;
@@ -207,9 +329,9 @@ bool FATProvider::getFileFragments(
 	if (!_selectDrive())
 		return false;
 
-	FIL    fd;
-	size_t length = 0;
-	auto   error  = f_open(&fd, path, READ);
+	FIL  fd;
+	UINT length = 0;
+	auto error  = f_open(&fd, path, READ);
 
 	if (error)
 		goto _openError;
@@ -270,7 +392,7 @@ File *FATProvider::openFile(const char *path, uint32_t flags) {
 	if (!_selectDrive())
 		return nullptr;
 
-	auto _file = new FATFile();
+	auto _file = new FATFile(&_changeCount);
 	auto error = f_open(&(_file->_fd), path, uint8_t(flags));
 
 	if (error) {
@@ -313,12 +435,26 @@ extern "C" DSTATUS disk_status(uint8_t drive) {
 }
 
 extern "C" DRESULT disk_read(
-	uint8_t drive, uint8_t *data, LBA_t lba, size_t count
+	uint8_t drive, uint8_t *data, LBA_t lba, UINT count
 ) {
 	auto &dev = ide::devices[drive];
 
 	if (!(dev.flags & ide::DEVICE_READY))
 		return RES_NOTRDY;
+
+	// Make sure any buffered data is written to the drive before it is read
+	// back.
+	auto &buffer = _writeBuffers[drive];
+
+	if (
+		buffer.count &&
+		(lba < (buffer.lba + buffer.count)) &&
+		((lba + count) > buffer.lba)
+	) {
+		if (_flushWriteBuffer(drive))
+			return RES_ERROR;
+	}
+
 	if (dev.readData(data, lba, count))
 		return RES_ERROR;
 
@@ -326,7 +462,7 @@ extern "C" DRESULT disk_read(
 }
 
 extern "C" DRESULT disk_write(
-	uint8_t drive, const uint8_t *data, LBA_t lba, size_t count
+	uint8_t drive, const uint8_t *data, LBA_t lba, UINT count
 ) {
 	auto &dev = ide::devices[drive];
 
@@ -334,8 +470,49 @@ extern "C" DRESULT disk_write(
 		return RES_NOTRDY;
 	if (dev.flags & ide::DEVICE_READ_ONLY)
 		return RES_WRPRT;
-	if (dev.writeData(data, lba, count))
-		return RES_ERROR;
+
+	auto &buffer = _writeBuffers[drive];
+
+	if (buffer.count && (lba != (buffer.lba + buffer.count))) {
+		if (_flushWriteBuffer(drive))
+			return RES_ERROR;
+	}
+
+	// Writes that are at least as large as the buffer gain nothing from being
+	// combined, so they are passed through as-is.
+	if (!buffer.data.ptr || (count >= _WRITE_BUFFER_LENGTH)) {
+		if (_flushWriteBuffer(drive))
+			return RES_ERROR;
+		if (dev.writeData(data, lba, count))
+			return RES_ERROR;
+
+		return RES_OK;
+	}
+
+	size_t sectorSize = dev.getSectorSize();
+
+	while (count) {
+		if (!buffer.count)
+			buffer.lba = lba;
+
+		size_t length =
+			util::min(size_t(count), _WRITE_BUFFER_LENGTH - buffer.count);
+
+		__builtin_memcpy(
+			buffer.data.as<uint8_t>() + buffer.count * sectorSize, data,
+			length * sectorSize
+		);
+
+		buffer.count += length;
+		data         += length * sectorSize;
+		lba          += length;
+		count        -= length;
+
+		if (buffer.count >= _WRITE_BUFFER_LENGTH) {
+			if (_flushWriteBuffer(drive))
+				return RES_ERROR;
+		}
+	}
 
 	return RES_OK;
 }
@@ -349,6 +526,9 @@ extern "C" DRESULT disk_ioctl(uint8_t drive, uint8_t cmd, void *data) {
 	switch (cmd) {
 #ifdef ENABLE_FULL_IDE_DRIVER
 		case CTRL_SYNC:
+			if (_flushWriteBuffer(drive))
+				return RES_ERROR;
+
 			return dev.flushCache() ? RES_ERROR : RES_OK;
 #endif
 
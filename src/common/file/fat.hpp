@@ -29,9 +29,17 @@ class FATFile : public File {
 	friend class FATProvider;
 
 private:
-	FIL _fd;
+	FIL        _fd;
+	util::Data _linkMap;
+	bool       _linkMapFailed;
+	uint32_t   *_changeCount;
+
+	void _createLinkMap(void);
 
 public:
+	inline FATFile(uint32_t *changeCount)
+	: _linkMapFailed(false), _changeCount(changeCount) {}
+
 	size_t read(void *output, size_t length);
 	size_t write(const void *input, size_t length);
 	uint64_t seek(uint64_t offset);
@@ -47,6 +55,7 @@ private:
 
 public:
 	bool getEntry(FileInfo &output);
+	size_t getEntries(FileInfo *output, size_t count);
 	void close(void);
 };
 
@@ -54,13 +63,15 @@ public:
 
 class FATProvider : public Provider {
 private:
-	FATFS _fs;
-	char  _drive[4];
+	FATFS    _fs;
+	char     _drive[4];
+	uint32_t _changeCount;
 
 	bool _selectDrive(void);
 
 public:
-	inline FATProvider(void) {
+	inline FATProvider(void)
+	: _changeCount(0) {
 		_fs.fs_type = 0;
 		_drive[0]   = '#';
 		_drive[1]   = ':';
@@ -70,6 +81,7 @@ public:
 	bool init(int drive);
 	void close(void);
 	uint64_t getFreeSpace(void);
+	uint32_t getChangeCount(void) const;
 
 	bool getFileInfo(FileInfo &output, const char *path);
 	bool getFileFragments(FileFragmentTable &output, const char *path);
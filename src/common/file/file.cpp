@@ -49,6 +49,17 @@ Directory::~Directory(void) {
 	close();
 }
 
+size_t Directory::getEntries(FileInfo *output, size_t count) {
+	size_t actualCount = 0;
+
+	for (; actualCount < count; actualCount++) {
+		if (!getEntry(*(output++)))
+			break;
+	}
+
+	return actualCount;
+}
+
 /* Base file and asset provider classes */
 
 uint32_t currentSPUOffset = spu::DUMMY_BLOCK_END;
@@ -107,6 +107,9 @@ public:
 	virtual ~Directory(void);
 
 	virtual bool getEntry(FileInfo &output) { return false; }
+	virtual size_t getEntries(FileInfo *output, size_t count);
+	virtual size_t getSizeHint(void) const { return 0; }
+	virtual bool seek(size_t index) { return false; }
 	virtual void close(void) {}
 };
 
@@ -136,6 +139,7 @@ public:
 
 	virtual void close(void) {}
 	virtual uint64_t getFreeSpace(void) { return 0; }
+	virtual uint32_t getChangeCount(void) const { return 0; }
 
 	virtual bool getFileInfo(FileInfo &output, const char *path) {
 		return false;
@@ -135,92 +135,29 @@ size_t ISORecord::parseName(char *output, size_t maxLength) const {
 	return actualLength;
 }
 
-size_t ISORecord::comparePath(const char *path) const {
-	size_t prefixLength = 0;
-	size_t actualLength = 0;
-
-	while ((*path == '/') || (*path == '\\')) {
-		prefixLength++;
-		path++;
-	}
-
-	// This is pretty much the same code as parseName().
-	auto xaEntry = reinterpret_cast<const ISOXAEntry *>(getSystemUseData());
-
-	if (xaEntry->validateMagic())
-		xaEntry++;
-
-	auto ptr     = reinterpret_cast<const uint8_t *>(xaEntry);
-	auto dataEnd = reinterpret_cast<const uint8_t *>(this) + recordLength;
-
-	while (ptr < dataEnd) {
-		if (!(*ptr)) {
-			ptr++;
-			continue;
-		}
-
-		auto entry = reinterpret_cast<const ISOSUSPEntry *>(ptr);
-		ptr       += entry->length;
-
-		if (entry->magic != ISO_SUSP_ALTERNATE_NAME)
-			continue;
-
-		auto chunkData   = entry->getData();
-		auto chunkLength = entry->getDataLength() - 1;
-		auto chunkFlags  = *(chunkData++);
-
-		if (chunkFlags & (ISO_SUSP_NAME_CURRENT | ISO_SUSP_NAME_PARENT))
-			return 0;
-
-		for (size_t i = chunkLength; i; i--) {
-			if (
-				__builtin_toupper(*(chunkData++)) !=
-				__builtin_toupper(*(path++))
-			)
-				return 0;
-		}
-
-		actualLength += chunkLength;
-
-		if (!(chunkFlags & ISO_SUSP_NAME_CONTINUE))
-			break;
-	}
-
-	if (actualLength)
-		return prefixLength + actualLength;
-
-	auto isoName = getName();
-	actualLength = nameLength;
-
-	if ((*isoName == 0x00) || (*isoName == 0x01))
-		return 0;
-
-	for (size_t i = actualLength; i; i--) {
-		if (*isoName == ';')
-			break;
-		if ((isoName[0] == '.') && (isoName[1] == ';'))
-			break;
-
-		if (__builtin_toupper(*(isoName++)) != __builtin_toupper(*(path++)))
-			return 0;
-	}
-
-	return prefixLength + actualLength;
-}
-
 bool ISOVolumeDesc::validateMagic(void) const {
 	return (util::hash(magic, sizeof(magic)) == "CD001"_h) && (version == 1);
 }
 
 /* ISO9660 file and directory classes */
 
-bool ISO9660File::_loadSector(uint32_t lba) {
-	if (lba == _bufferedLBA)
-		return true;
-	if (_device->readData(_sectorBuffer, lba, 1))
+bool ISO9660File::_loadSectors(uint32_t lba, size_t numSectors) {
+	if (
+		!_buffer.ptr &&
+		!_buffer.allocate(_bufferLength * ide::ATAPI_SECTOR_SIZE)
+	)
 		return false;
 
-	_bufferedLBA = lba;
+	// Invalidate the buffer beforehand, so that its contents will not be used
+	// if the read fails halfway through.
+	_bufferedSectors = 0;
+
+	if (_device->readData(_buffer.ptr, lba, numSectors))
+		return false;
+
+	_bufferedLBA     = lba;
+	_bufferedSectors = numSectors;
+	_nextLBA         = lba + numSectors;
 	return true;
 }
 
@@ -242,9 +179,30 @@ size_t ISO9660File::read(void *output, size_t length) {
 		uint32_t lba          = offset / ide::ATAPI_SECTOR_SIZE + _startLBA;
 		size_t   sectorOffset = offset % ide::ATAPI_SECTOR_SIZE;
 
+		// If the sector is already in the buffer, copy as much data as possible
+		// from it.
+		if ((lba >= _bufferedLBA) && (lba < (_bufferedLBA + _bufferedSectors))) {
+			size_t bufferOffset =
+				(lba - _bufferedLBA) * ide::ATAPI_SECTOR_SIZE + sectorOffset;
+			auto   chunkLength  = util::min(
+				remaining,
+				_bufferedSectors * ide::ATAPI_SECTOR_SIZE - bufferOffset
+			);
+
+			__builtin_memcpy(
+				currentPtr, _buffer.as<uint8_t>() + bufferOffset, chunkLength
+			);
+
+			offset    += chunkLength;
+			ptr       += chunkLength;
+			remaining -= chunkLength;
+			continue;
+		}
+
 		// If the output pointer is on a sector boundary and satisfies the IDE
 		// driver's alignment requirements, read as many full sectors as
-		// possible without going through the sector buffer.
+		// possible without going through the buffer. This also applies to the
+		// middle part of unaligned reads.
 		if (!sectorOffset && _device->isPointerAligned(currentPtr)) {
 			auto numSectors = remaining  / ide::ATAPI_SECTOR_SIZE;
 			auto spanLength = numSectors * ide::ATAPI_SECTOR_SIZE;
@@ -253,6 +211,7 @@ size_t ISO9660File::read(void *output, size_t length) {
 				if (_device->readData(currentPtr, lba, numSectors))
 					return false;
 
+				_nextLBA   = lba + numSectors;
 				offset    += spanLength;
 				ptr       += spanLength;
 				remaining -= spanLength;
@@ -260,19 +219,23 @@ size_t ISO9660File::read(void *output, size_t length) {
 			}
 		}
 
-		// In all other cases, read one sector at a time into the buffer and
-		// copy it over.
-		auto chunkLength =
-			util::min(remaining, ide::ATAPI_SECTOR_SIZE - sectorOffset);
+		// In all other cases, fill the buffer and copy data from it on the next
+		// iteration. If the file is being read sequentially, prefetch as many
+		// sectors as the buffer can hold; otherwise, only read the sectors
+		// needed to satisfy this call.
+		size_t numSectors = _bufferLength;
 
-		if (!_loadSector(lba))
-			return false;
+		if (lba != _nextLBA)
+			numSectors = util::min(
+				(sectorOffset + remaining + ide::ATAPI_SECTOR_SIZE - 1)
+					/ ide::ATAPI_SECTOR_SIZE,
+				numSectors
+			);
 
-		__builtin_memcpy(currentPtr, &_sectorBuffer[sectorOffset], chunkLength);
+		numSectors = util::min(numSectors, size_t(_endLBA - lba));
 
-		offset    += chunkLength;
-		ptr       += chunkLength;
-		remaining -= chunkLength;
+		if (!_loadSectors(lba, numSectors))
+			return false;
 	}
 
 	_offset += length;
@@ -289,8 +252,20 @@ uint64_t ISO9660File::tell(void) const {
 	return _offset;
 }
 
+void ISO9660File::close(void) {
+	_buffer.destroy();
+
+	_bufferedSectors = 0;
+}
+
 bool ISO9660Directory::getEntry(FileInfo &output) {
-	while (_ptr < _dataEnd) {
+	return getEntries(&output, 1) == 1;
+}
+
+size_t ISO9660Directory::getEntries(FileInfo *output, size_t count) {
+	size_t actualCount = 0;
+
+	while ((actualCount < count) && (_ptr < _dataEnd)) {
 		auto record = reinterpret_cast<const ISORecord *>(_ptr);
 
 		// Skip any null padding bytes inserted between entries to prevent them
@@ -302,22 +277,185 @@ bool ISO9660Directory::getEntry(FileInfo &output) {
 
 		_ptr += record->recordLength;
 
-		if (_recordToFileInfo(output, *record))
-			return true;
+		if (_recordToFileInfo(output[actualCount], *record))
+			actualCount++;
 	}
 
-	return false;
+	return actualCount;
+}
+
+size_t ISO9660Directory::getSizeHint(void) const {
+	return _numEntries;
+}
+
+bool ISO9660Directory::seek(size_t index) {
+	_ptr = reinterpret_cast<uintptr_t>(_records.ptr);
+
+	// As all records are already in memory, there is no need to parse their
+	// names in order to skip them. Only the current and parent directory
+	// entries have to be excluded from the count.
+	while (_ptr < _dataEnd) {
+		auto record = reinterpret_cast<const ISORecord *>(_ptr);
+
+		if (!(record->recordLength)) {
+			_ptr += 2;
+			continue;
+		}
+
+		auto name = *(record->getName());
+
+		if ((name != 0x00) && (name != 0x01)) {
+			if (!index)
+				return true;
+
+			index--;
+		}
+
+		_ptr += record->recordLength;
+	}
+
+	return !index;
 }
 
 void ISO9660Directory::close(void) {
 	_records.destroy();
 }
 
+/* ISO9660 directory cache */
+
+// Names are compared case-insensitively, so they are converted to uppercase
+// before being hashed.
+static util::Hash _hashName(
+	const char *name, size_t length, util::Hash value = 0
+) {
+	for (; length && *name; length--)
+		value = util::Hash(__builtin_toupper(*(name++)))
+			+ (value << 6) + (value << 16) - value;
+
+	return value;
+}
+
+static bool _compareNames(const char *a, const char *b, size_t length) {
+	for (; length; length--) {
+		if (__builtin_toupper(*(a++)) != __builtin_toupper(*(b++)))
+			return false;
+	}
+
+	return true;
+}
+
+static const char *_skipSeparators(const char *path) {
+	while ((*path == '/') || (*path == '\\'))
+		path++;
+
+	return path;
+}
+
+static size_t _getComponentLength(const char *path) {
+	size_t length = 0;
+
+	while (path[length] && (path[length] != '/') && (path[length] != '\\'))
+		length++;
+
+	return length;
+}
+
+static util::Hash _hashComponent(
+	const char *name, size_t length, util::Hash value
+) {
+	value = _hashName(name, length, value);
+	value = util::Hash('/') + (value << 6) + (value << 16) - value;
+
+	return value;
+}
+
+static bool _recordMatches(
+	const ISORecord &record, const char *name, size_t nameLength
+) {
+	char recordName[MAX_NAME_LENGTH];
+
+	if (record.parseName(recordName, sizeof(recordName) - 1) != nameLength)
+		return false;
+
+	return _compareNames(recordName, name, nameLength);
+}
+
+bool ISOCachedDirectory::parse(void) {
+	// Each record is at least as large as an ISORecord structure, so this is
+	// an upper bound for the number of names in the directory.
+	if (!names.allocate<ISOCachedName>(length / sizeof(ISORecord) + 1))
+		return false;
+
+	auto ptr   = records.as<uint8_t>();
+	auto entry = names.as<ISOCachedName>();
+	numNames   = 0;
+
+	for (uint32_t offset = 0; offset < length;) {
+		auto record = reinterpret_cast<const ISORecord *>(&ptr[offset]);
+
+		if (!(record->recordLength)) {
+			offset += 2;
+			continue;
+		}
+
+		// Decode each record's name (including any Rock Ridge name) once here
+		// rather than on every lookup.
+		char name[MAX_NAME_LENGTH];
+		auto nameLength = record->parseName(name, sizeof(name) - 1);
+
+		if (nameLength) {
+			entry->hash   = _hashName(name, nameLength);
+			entry->offset = offset;
+			entry++;
+			numNames++;
+		}
+
+		offset += record->recordLength;
+	}
+
+	return true;
+}
+
+const ISORecord *ISOCachedDirectory::findRecord(
+	const char *name, size_t nameLength
+) const {
+	auto hash  = _hashName(name, nameLength);
+	auto entry = names.as<ISOCachedName>();
+
+	for (size_t i = numNames; i; i--, entry++) {
+		if (entry->hash != hash)
+			continue;
+
+		auto record = reinterpret_cast<const ISORecord *>(
+			records.as<uint8_t>() + entry->offset
+		);
+
+		// Make sure the match is not just a hash collision.
+		if (_recordMatches(*record, name, nameLength))
+			return record;
+	}
+
+	return nullptr;
+}
+
+void ISOCachedDirectory::destroy(void) {
+	records.destroy();
+	names.destroy();
+
+	lba      = 0;
+	length   = 0;
+	lastUsed = 0;
+	numNames = 0;
+}
+
 /* ISO9660 filesystem provider */
 
 static constexpr uint32_t _VOLUME_DESC_START_LBA = 0x10;
 static constexpr uint32_t _VOLUME_DESC_END_LBA   = 0x20;
 
+static constexpr size_t   _MAX_PATH_TABLE_LENGTH = 0x10000;
+static constexpr uint32_t _AMBIGUOUS_LBA         = 0xffffffff;
+
 bool ISO9660Provider::_readData(
 	util::Data &output, uint32_t lba, size_t numSectors
 ) {
@@ -329,62 +467,343 @@ bool ISO9660Provider::_readData(
 	return true;
 }
 
-bool ISO9660Provider::_getRecord(
-	ISORecordBuffer &output, const ISORecord &root, const char *path
+void ISO9660Provider::_flushCache(void) {
+	for (auto &dir : _dirCache)
+		dir.destroy();
+
+	util::clear(_pathIndex);
+
+	_cacheTime     = 0;
+	_nextPathIndex = 0;
+}
+
+void ISO9660Provider::_unloadPathTable(void) {
+	_dirIndex.destroy();
+
+	_dirIndexMask = 0;
+}
+
+bool ISO9660Provider::_loadPathTable(void) {
+	_unloadPathTable();
+
+	auto length = _pathTableLength;
+
+	if (!length || (length > _MAX_PATH_TABLE_LENGTH)) {
+		LOG_FS("unsupported path table length 0x%x", length);
+		return false;
+	}
+
+	util::Data table;
+	auto       numSectors =
+		(length + ide::ATAPI_SECTOR_SIZE - 1) / ide::ATAPI_SECTOR_SIZE;
+
+	if (!_readData(table, _pathTableLBA, numSectors))
+		return false;
+
+	// Count and validate all entries before building the index.
+	auto   ptr        = table.as<uint8_t>();
+	size_t numEntries = 0;
+
+	for (uint32_t offset = 0; offset < length; numEntries++) {
+		auto entry = reinterpret_cast<const ISOPathTableEntry *>(&ptr[offset]);
+
+		if (
+			((offset + sizeof(ISOPathTableEntry)) > length) ||
+			!entry->nameLength ||
+			((offset + entry->getEntryLength()) > length)
+		) {
+			LOG_FS("invalid path table entry, offset=0x%x", offset);
+			return false;
+		}
+
+		offset += entry->getEntryLength();
+	}
+
+	// The index is an open addressing hash table mapping the hash of each
+	// directory's full path to its LBA, kept at most half full.
+	size_t indexSize = 1;
+
+	while (indexSize < (numEntries * 2))
+		indexSize <<= 1;
+
+	util::Data hashes;
+
+	if (!hashes.allocate<util::Hash>(numEntries))
+		return false;
+	if (!_dirIndex.allocate<ISODirectoryIndexEntry>(indexSize))
+		return false;
+
+	__builtin_memset(_dirIndex.ptr, 0, _dirIndex.length);
+	_dirIndexMask = indexSize - 1;
+
+	// Entries are sorted so that each directory comes after its parent, thus
+	// each path's hash can be derived from the one of its parent. The first
+	// entry is always the root directory.
+	auto pathHashes = hashes.as<util::Hash>();
+	auto index      = _dirIndex.as<ISODirectoryIndexEntry>();
+	auto offset     =
+		reinterpret_cast<const ISOPathTableEntry *>(ptr)->getEntryLength();
+
+	pathHashes[0] = 0;
+
+	for (size_t i = 1; i < numEntries; i++) {
+		auto entry  = reinterpret_cast<const ISOPathTableEntry *>(&ptr[offset]);
+		auto parent = entry->parentIndex;
+		offset     += entry->getEntryLength();
+
+		if (!parent || (parent > i)) {
+			LOG_FS("invalid path table parent, index=%d", i + 1);
+			_unloadPathTable();
+			return false;
+		}
+
+		auto hash = _hashComponent(
+			reinterpret_cast<const char *>(entry->getName()),
+			entry->nameLength,
+			pathHashes[parent - 1]
+		);
+		auto slot = hash & _dirIndexMask;
+
+		pathHashes[i] = hash;
+
+		// If two paths happen to have the same hash, mark the entry as
+		// ambiguous so that lookups fall back to walking the tree.
+		for (; index[slot].lba; slot = (slot + 1) & _dirIndexMask) {
+			if (index[slot].hash == hash)
+				break;
+		}
+
+		index[slot].lba  = index[slot].lba ? _AMBIGUOUS_LBA : entry->lba;
+		index[slot].hash = hash;
+	}
+
+	LOG_FS("loaded path table, %d entries", numEntries);
+	return true;
+}
+
+uint32_t ISO9660Provider::_findDirectory(util::Hash hash) const {
+	auto index = _dirIndex.as<ISODirectoryIndexEntry>();
+
+	for (
+		auto slot = hash & _dirIndexMask; index[slot].lba;
+		slot = (slot + 1) & _dirIndexMask
+	) {
+		if (index[slot].hash != hash)
+			continue;
+
+		return (index[slot].lba == _AMBIGUOUS_LBA) ? 0 : index[slot].lba;
+	}
+
+	return 0;
+}
+
+const ISOCachedDirectory *ISO9660Provider::_getDirectory(
+	uint32_t lba, uint32_t length
+) {
+	// Unused slots have their last usage time set to zero, so they will always
+	// be picked over any slot currently in use.
+	auto oldest = &_dirCache[0];
+
+	for (auto &dir : _dirCache) {
+		if (dir.length && (dir.lba == lba)) {
+			dir.lastUsed = ++_cacheTime;
+			return &dir;
+		}
+
+		if (dir.lastUsed < oldest->lastUsed)
+			oldest = &dir;
+	}
+
+	size_t loadedSectors = 0;
+
+	oldest->destroy();
+
+	// If the directory's length is not known (i.e. its LBA was obtained from
+	// the path table), read its first sector and get the length from the "."
+	// record, which always comes first.
+	if (!length) {
+		if (!_readData(oldest->records, lba, 1)) {
+			oldest->destroy();
+			return nullptr;
+		}
+
+		auto self = oldest->records.as<ISORecord>();
+
+		if (!self->recordLength || (self->lba.le != lba) || !self->length.le) {
+			LOG_FS("invalid directory, lba=0x%x", lba);
+			oldest->destroy();
+			return nullptr;
+		}
+
+		length        = self->length.le;
+		loadedSectors = 1;
+	}
+
+	auto numSectors =
+		(length + ide::ATAPI_SECTOR_SIZE - 1) / ide::ATAPI_SECTOR_SIZE;
+
+	if (
+		(numSectors > loadedSectors) &&
+		!_readData(oldest->records, lba, numSectors)
+	) {
+		oldest->destroy();
+		return nullptr;
+	}
+
+	oldest->lba    = lba;
+	oldest->length = length;
+
+	if (!oldest->parse()) {
+		oldest->destroy();
+		return nullptr;
+	}
+
+	oldest->lastUsed = ++_cacheTime;
+	return oldest;
+}
+
+void ISO9660Provider::_addToPathIndex(
+	util::Hash hash, const ISOCachedDirectory &dir, const ISORecord &record
 ) {
+	auto &entry    = _pathIndex[_nextPathIndex];
+	_nextPathIndex = (_nextPathIndex + 1) % ISO9660_PATH_INDEX_SIZE;
+
+	entry.hash      = hash;
+	entry.dirLBA    = dir.lba;
+	entry.dirLength = dir.length;
+	entry.offset    = reinterpret_cast<uintptr_t>(&record)
+		- reinterpret_cast<uintptr_t>(dir.records.ptr);
+}
+
+bool ISO9660Provider::_getRecord(ISORecordBuffer &output, const char *path) {
 	if (!type)
 		return false;
 
+	// If the drive has reported a disc change since the volume was mounted,
+	// parse the new disc's volume descriptor again (which also throws away all
+	// cached directories and reloads the path table). The provider is closed
+	// if the new disc turns out not to be readable.
+	if (_device->discChangeCount != _discChangeCount) {
+		LOG_FS("disc changed, remounting");
+
+		if (!_mount()) {
+			close();
+			return false;
+		}
+	}
+
+	path = _skipSeparators(path);
+
 	if (!(*path)) {
-		__builtin_memcpy(&output, &root, root.recordLength);
+		__builtin_memcpy(&output, &_root, _root.recordLength);
 		return true;
 	}
 
-	util::Data records;
-	auto       numSectors =
-		(root.length.le + ide::ATAPI_SECTOR_SIZE - 1) / ide::ATAPI_SECTOR_SIZE;
+	// Split the path into its last component and the hash of the directory
+	// containing it. Paths are normalized while being hashed, so that e.g.
+	// "/a//B" and "A\\b" both resolve to the same path index entry.
+	util::Hash parentHash = 0;
+	auto       name       = path;
+	auto       nameLength = _getComponentLength(name);
 
-	if (!_readData(records, root.lba.le, numSectors))
-		return false;
+	for (;;) {
+		auto next = _skipSeparators(name + nameLength);
 
-	// Iterate over all records in the directory.
-	auto ptr     = reinterpret_cast<uintptr_t>(records.ptr);
-	auto dataEnd = ptr + root.length.le;
+		if (!(*next))
+			break;
 
-	while (ptr < dataEnd) {
-		auto record = reinterpret_cast<const ISORecord *>(ptr);
+		parentHash = _hashComponent(name, nameLength, parentHash);
+		name       = next;
+		nameLength = _getComponentLength(name);
+	}
 
-		// Skip any null padding bytes inserted between entries to prevent them
-		// from crossing sector boundaries.
-		if (!(record->recordLength)) {
-			ptr += 2;
+	// Check if the path has been looked up before and, if so, fetch the
+	// directory its record is in directly. The record's name is checked to
+	// rule out hash collisions between different paths.
+	auto hash = _hashComponent(name, nameLength, parentHash);
+
+	for (auto &entry : _pathIndex) {
+		if (!entry.dirLength || (entry.hash != hash))
 			continue;
-		}
 
-		auto nameLength = record->comparePath(path);
+		auto dir = _getDirectory(entry.dirLBA, entry.dirLength);
+
+		if (!dir)
+			return false;
+
+		auto record = reinterpret_cast<const ISORecord *>(
+			dir->records.as<uint8_t>() + entry.offset
+		);
 
-		if (!nameLength) {
-			ptr += record->recordLength;
+		if (!_recordMatches(*record, name, nameLength))
 			continue;
+
+		__builtin_memcpy(&output, record, record->recordLength);
+		return true;
+	}
+
+	// If the path table has been loaded, find the directory containing the
+	// record through it. As the path table only holds ISO9660 names, this may
+	// fail for paths using Rock Ridge names, in which case the directory tree
+	// is walked instead.
+	if (_dirIndex.ptr) {
+		uint32_t lba    = _root.lba.le;
+		uint32_t length = _root.length.le;
+
+		if (name != path) {
+			lba    = _findDirectory(parentHash);
+			length = 0;
 		}
 
-		// If the name matches, move onto the next component of the path and
-		// recursively search the subdirectory.
-		path      += nameLength;
-		auto found = _getRecord(output, *record, path);
+		auto dir = lba ? _getDirectory(lba, length) : nullptr;
+
+		if (dir) {
+			auto record = dir->findRecord(name, nameLength);
 
-		records.destroy();
-		return found;
+			if (record) {
+				__builtin_memcpy(&output, record, record->recordLength);
+				_addToPathIndex(hash, *dir, *record);
+				return true;
+			}
+		}
+	}
+
+	// Otherwise, walk down the directory tree one component at a time.
+	uint32_t lba    = _root.lba.le;
+	uint32_t length = _root.length.le;
+
+	for (;;) {
+		auto nameLength = _getComponentLength(path);
+		auto dir        = _getDirectory(lba, length);
+
+		if (!dir)
+			return false;
+
+		auto record = dir->findRecord(path, nameLength);
+
+		if (!record)
+			break;
+
+		path = _skipSeparators(path + nameLength);
+
+		if (!(*path)) {
+			__builtin_memcpy(&output, record, record->recordLength);
+			_addToPathIndex(hash, *dir, *record);
+			return true;
+		}
+
+		if (!(record->flags & ISO_RECORD_DIRECTORY))
+			break;
+
+		lba    = record->lba.le;
+		length = record->length.le;
 	}
 
-	records.destroy();
 	LOG_FS("not found: %s", path);
 	return false;
 }
 
-bool ISO9660Provider::init(int drive) {
-	_device = &ide::devices[drive];
-
+bool ISO9660Provider::_mount(void) {
 	// Locate and parse the primary volume descriptor.
 	ISOPrimaryVolumeDesc pvd;
 
@@ -415,10 +834,17 @@ bool ISO9660Provider::init(int drive) {
 		_copyPVDString(volumeLabel, pvd.volume, sizeof(pvd.volume));
 		__builtin_memcpy(&_root, &pvd.root, sizeof(_root));
 
+		_flushCache();
+		_discChangeCount = _device->discChangeCount;
+		_pathTableLBA    = pvd.pathTableLEOffsets[0];
+		_pathTableLength = pvd.pathTableLength.le;
+
+		// The path table is optional; if it is missing or malformed, paths will
+		// be resolved by walking the directory tree.
+		_loadPathTable();
+
 		type     = ISO9660;
 		capacity = uint64_t(pvd.volumeLength.le) * ide::ATAPI_SECTOR_SIZE;
-
-		LOG_FS("mounted ISO: %d", drive);
 		return true;
 	}
 
@@ -426,16 +852,35 @@ bool ISO9660Provider::init(int drive) {
 	return false;
 }
 
+bool ISO9660Provider::init(int drive) {
+	_device = &ide::devices[drive];
+
+	if (!_mount())
+		return false;
+
+	LOG_FS("mounted ISO: %d", drive);
+	return true;
+}
+
 void ISO9660Provider::close(void) {
+	_flushCache();
+	_unloadPathTable();
+
 	type     = NONE;
 	capacity = 0;
 	_device  = nullptr;
 }
 
+// The drive's disc change counter is only updated once the drive is accessed
+// again, so a swapped disc may go unnoticed by the VFS until then.
+uint32_t ISO9660Provider::getChangeCount(void) const {
+	return _device ? _device->discChangeCount : 0;
+}
+
 bool ISO9660Provider::getFileInfo(FileInfo &output, const char *path) {
 	ISORecordBuffer record;
 
-	if (!_getRecord(record, _root, path))
+	if (!_getRecord(record, path))
 		return false;
 
 	return _recordToFileInfo(output, record);
@@ -446,7 +891,7 @@ bool ISO9660Provider::getFileFragments(
 ) {
 	ISORecordBuffer record;
 
-	if (!_getRecord(record, _root, path))
+	if (!_getRecord(record, path))
 		return false;
 
 	// ISO9660 files are always contiguous and non-fragmented, so only a single
@@ -464,23 +909,31 @@ bool ISO9660Provider::getFileFragments(
 Directory *ISO9660Provider::openDirectory(const char *path) {
 	ISORecordBuffer record;
 
-	if (!_getRecord(record, _root, path))
+	if (!_getRecord(record, path))
 		return nullptr;
 	if (!(record.flags & ISO_RECORD_DIRECTORY))
 		return nullptr;
 
-	auto   dir       = new ISO9660Directory();
-	size_t dirLength =
-		(record.length.le + ide::ATAPI_SECTOR_SIZE - 1) / ide::ATAPI_SECTOR_SIZE;
+	// Reuse the directory's cached records rather than reading them again.
+	auto cached = _getDirectory(record.lba.le, record.length.le);
 
-	if (!_readData(dir->_records, record.lba.le, dirLength)) {
+	if (!cached) {
 		LOG_FS("read failed: %s", path);
+		return nullptr;
+	}
+
+	auto dir = new ISO9660Directory();
+
+	if (!dir->_records.allocate(record.length.le)) {
 		delete dir;
 		return nullptr;
 	}
 
-	dir->_ptr     = reinterpret_cast<uintptr_t>(dir->_records.ptr);
-	dir->_dataEnd = dir->_ptr + record.length.le;
+	__builtin_memcpy(dir->_records.ptr, cached->records.ptr, record.length.le);
+
+	dir->_ptr        = reinterpret_cast<uintptr_t>(dir->_records.ptr);
+	dir->_dataEnd    = dir->_ptr + record.length.le;
+	dir->_numEntries = cached->numNames;
 	return dir;
 }
 
@@ -489,7 +942,7 @@ File *ISO9660Provider::openFile(const char *path, uint32_t flags) {
 
 	if (flags & (WRITE | FORCE_CREATE))
 		return nullptr;
-	if (!_getRecord(record, _root, path))
+	if (!_getRecord(record, path))
 		return nullptr;
 	if (record.flags & ISO_RECORD_DIRECTORY)
 		return nullptr;
@@ -42,6 +42,7 @@ using ISOCharD  = uint8_t;
 /* ISO9660 data structures (see https://wiki.osdev.org/ISO_9660) */
 
 static constexpr size_t ISO9660_MAX_RECORD_DATA_LENGTH = 512;
+static constexpr size_t ISO9660_FILE_BUFFER_LENGTH     = 16;
 
 enum ISOSUSPEntryType : uint16_t {
 	ISO_SUSP_ATTRIBUTES     = util::concatenate('P', 'X'),
@@ -127,7 +128,22 @@ public:
 	}
 
 	size_t parseName(char *output, size_t maxLength) const;
-	size_t comparePath(const char *path) const;
+};
+
+class [[gnu::packed]] ISOPathTableEntry {
+public:
+	uint8_t  nameLength;         // 0x0
+	uint8_t  extendedAttrLength; // 0x1
+	uint32_t lba;                // 0x2-0x5
+	uint16_t parentIndex;        // 0x6-0x7
+
+	inline size_t getEntryLength(void) const {
+		// The name is padded to an even number of bytes.
+		return sizeof(ISOPathTableEntry) + ((nameLength + 1) & ~1);
+	}
+	inline const ISOCharD *getName(void) const {
+		return reinterpret_cast<const ISOCharD *>(this + 1);
+	}
 };
 
 class [[gnu::packed]] ISORecordBuffer : public ISORecord {
@@ -192,23 +208,34 @@ class ISO9660File : public File {
 
 private:
 	ide::Device *_device;
-	uint32_t    _startLBA;
+	uint32_t    _startLBA, _endLBA;
 
-	uint64_t _offset;
-	uint32_t _bufferedLBA;
-	uint8_t  _sectorBuffer[ide::ATAPI_SECTOR_SIZE];
+	uint64_t   _offset;
+	util::Data _buffer;
+	size_t     _bufferLength;
+	uint32_t   _bufferedLBA, _nextLBA;
+	size_t     _bufferedSectors;
 
-	bool _loadSector(uint32_t lba);
+	bool _loadSectors(uint32_t lba, size_t numSectors);
 
 public:
-	inline ISO9660File(ide::Device *device, const ISORecord &record)
-	: _device(device), _startLBA(record.lba.le), _offset(0), _bufferedLBA(0) {
-		size = record.length.le;
+	inline ISO9660File(
+		ide::Device     *device,
+		const ISORecord &record,
+		size_t          bufferLength = ISO9660_FILE_BUFFER_LENGTH
+	) : _device(device), _startLBA(record.lba.le), _offset(0),
+	_bufferLength(util::max(bufferLength, size_t(1))), _bufferedLBA(0),
+	_nextLBA(record.lba.le), _bufferedSectors(0) {
+		size    = record.length.le;
+		_endLBA = _startLBA
+			+ (record.length.le + ide::ATAPI_SECTOR_SIZE - 1)
+			/ ide::ATAPI_SECTOR_SIZE;
 	}
 
 	size_t read(void *output, size_t length);
 	uint64_t seek(uint64_t offset);
 	uint64_t tell(void) const;
+	void close(void);
 };
 
 class ISO9660Directory : public Directory {
@@ -217,12 +244,56 @@ class ISO9660Directory : public Directory {
 private:
 	util::Data _records;
 	uintptr_t  _ptr, _dataEnd;
+	size_t     _numEntries;
 
 public:
+	inline ISO9660Directory(void)
+	: _ptr(0), _dataEnd(0), _numEntries(0) {}
+
 	bool getEntry(FileInfo &output);
+	size_t getEntries(FileInfo *output, size_t count);
+	size_t getSizeHint(void) const;
+	bool seek(size_t index);
 	void close(void);
 };
 
+/* ISO9660 directory cache */
+
+static constexpr size_t ISO9660_DIR_CACHE_SIZE  = 8;
+static constexpr size_t ISO9660_PATH_INDEX_SIZE = 32;
+
+struct ISOCachedName {
+public:
+	util::Hash hash;
+	uint32_t   offset;
+};
+
+class ISOCachedDirectory {
+public:
+	uint32_t   lba, length, lastUsed;
+	util::Data records, names;
+	size_t     numNames;
+
+	inline ISOCachedDirectory(void)
+	: lba(0), length(0), lastUsed(0), numNames(0) {}
+
+	bool parse(void);
+	const ISORecord *findRecord(const char *name, size_t nameLength) const;
+	void destroy(void);
+};
+
+struct ISOPathIndexEntry {
+public:
+	util::Hash hash;
+	uint32_t   dirLBA, dirLength, offset;
+};
+
+struct ISODirectoryIndexEntry {
+public:
+	util::Hash hash;
+	uint32_t   lba;
+};
+
 /* ISO9660 filesystem provider */
 
 class ISO9660Provider : public Provider {
@@ -230,17 +301,37 @@ private:
 	ide::Device *_device;
 	ISORecord   _root;
 
+	ISOCachedDirectory _dirCache[ISO9660_DIR_CACHE_SIZE];
+	ISOPathIndexEntry  _pathIndex[ISO9660_PATH_INDEX_SIZE];
+	uint32_t           _cacheTime, _discChangeCount;
+	size_t             _nextPathIndex;
+
+	util::Data _dirIndex;
+	size_t     _dirIndexMask;
+	uint32_t   _pathTableLBA, _pathTableLength;
+
 	bool _readData(util::Data &output, uint32_t lba, size_t numSectors);
-	bool _getRecord(
-		ISORecordBuffer &output, const ISORecord &root, const char *path
+	void _flushCache(void);
+	void _unloadPathTable(void);
+	bool _loadPathTable(void);
+	uint32_t _findDirectory(util::Hash hash) const;
+	const ISOCachedDirectory *_getDirectory(uint32_t lba, uint32_t length = 0);
+	void _addToPathIndex(
+		util::Hash hash, const ISOCachedDirectory &dir, const ISORecord &record
 	);
+	bool _getRecord(ISORecordBuffer &output, const char *path);
+	bool _mount(void);
 
 public:
 	inline ISO9660Provider(void)
-	: _device(nullptr) {}
+	: _device(nullptr), _cacheTime(0), _discChangeCount(0), _nextPathIndex(0),
+	_dirIndexMask(0), _pathTableLBA(0), _pathTableLength(0) {
+		util::clear(_pathIndex);
+	}
 
 	bool init(int drive);
 	void close(void);
+	uint32_t getChangeCount(void) const;
 
 	bool getFileInfo(FileInfo &output, const char *path);
 	bool getFileFragments(FileFragmentTable &output, const char *path);
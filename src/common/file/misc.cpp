@@ -82,15 +82,21 @@ void HostFile::close(void) {
 }
 
 bool HostDirectory::getEntry(FileInfo &output) {
-	if (_fd < 0)
-		return false;
+	return getEntries(&output, 1) == 1;
+}
+
+size_t HostDirectory::getEntries(FileInfo *output, size_t count) {
+	size_t actualCount = 0;
 
 	// Return the last entry fetched while also fetching the next one (if any).
-	_dirEntryToFileInfo(output, _entry);
-	if (pcdrvFindNext(_fd, &_entry) < 0)
-		_fd = -1;
+	for (; (actualCount < count) && (_fd >= 0); actualCount++, output++) {
+		_dirEntryToFileInfo(*output, _entry);
 
-	return true;
+		if (pcdrvFindNext(_fd, &_entry) < 0)
+			_fd = -1;
+	}
+
+	return actualCount;
 }
 
 /* PCDRV filesystem provider */
@@ -192,6 +198,46 @@ VFSMountPoint *VFSProvider::_getMounted(const char *path) {
 	return nullptr;
 }
 
+const VFSCacheEntry *VFSProvider::_getCached(
+	const char *path, util::Hash hash
+) {
+	for (auto &entry : _cache) {
+		if (!entry.mp || (entry.hash != hash))
+			continue;
+		if (__builtin_strcmp(entry.path, path))
+			continue;
+
+		// Drop the entry if the provider has since had any files written to
+		// or its medium swapped.
+		if (entry.changeCount != entry.mp->provider->getChangeCount()) {
+			entry.mp = nullptr;
+			return nullptr;
+		}
+
+		return &entry;
+	}
+
+	return nullptr;
+}
+
+void VFSProvider::_invalidateCache(const Provider *provider) {
+	// Writing to a file may also affect the cached information about other
+	// paths (e.g. its parent directories), so all entries belonging to the
+	// same provider are dropped. Note that the provider may be mounted under
+	// more than one prefix.
+	for (auto &entry : _cache) {
+		if (entry.mp && (entry.mp->provider == provider))
+			entry.mp = nullptr;
+	}
+}
+
+void VFSProvider::flushCache(void) {
+	for (auto &entry : _cache)
+		entry.mp = nullptr;
+
+	_nextCacheEntry = 0;
+}
+
 bool VFSProvider::mount(const char *prefix, Provider *provider, bool force) {
 	auto hash = util::hash(prefix, VFS_PREFIX_SEPARATOR);
 
@@ -221,6 +267,7 @@ bool VFSProvider::mount(const char *prefix, Provider *provider, bool force) {
 		(__builtin_strchr(prefix, VFS_PREFIX_SEPARATOR) - prefix) + 1;
 	freeMP->provider   = provider;
 
+	flushCache();
 	LOG_FS("mapped %s", prefix);
 	return true;
 }
@@ -236,6 +283,7 @@ bool VFSProvider::unmount(const char *prefix) {
 		mp.pathOffset = 0;
 		mp.provider   = nullptr;
 
+		flushCache();
 		LOG_FS("unmapped %s", prefix);
 		return true;
 	}
@@ -245,12 +293,42 @@ bool VFSProvider::unmount(const char *prefix) {
 }
 
 bool VFSProvider::getFileInfo(FileInfo &output, const char *path) {
+	auto hash   = util::hash(path);
+	auto cached = _getCached(path, hash);
+
+	if (cached) {
+		if (!cached->exists)
+			return false;
+
+		__builtin_memcpy(&output, &cached->info, sizeof(output));
+		return true;
+	}
+
 	auto mp = _getMounted(path);
 
 	if (!mp)
 		return false;
 
-	return mp->provider->getFileInfo(output, &path[mp->pathOffset]);
+	// Paths too long to be stored in the cache are passed through as-is.
+	if (__builtin_strlen(path) >= MAX_PATH_LENGTH)
+		return mp->provider->getFileInfo(output, &path[mp->pathOffset]);
+
+	auto &entry     = _cache[_nextCacheEntry];
+	_nextCacheEntry = (_nextCacheEntry + 1) % VFS_CACHE_SIZE;
+
+	entry.hash        = hash;
+	entry.mp          = mp;
+	entry.changeCount = mp->provider->getChangeCount();
+	entry.exists      =
+		mp->provider->getFileInfo(entry.info, &path[mp->pathOffset]);
+
+	__builtin_strcpy(entry.path, path);
+
+	if (!entry.exists)
+		return false;
+
+	__builtin_memcpy(&output, &entry.info, sizeof(output));
+	return true;
 }
 
 bool VFSProvider::getFileFragments(
@@ -279,15 +357,28 @@ bool VFSProvider::createDirectory(const char *path) {
 	if (!mp)
 		return false;
 
+	_invalidateCache(mp->provider);
 	return mp->provider->createDirectory(&path[mp->pathOffset]);
 }
 
 File *VFSProvider::openFile(const char *path, uint32_t flags) {
+	// Skip calling into the provider if the file is already known not to
+	// exist.
+	if (!(flags & (FORCE_CREATE | ALLOW_CREATE))) {
+		auto cached = _getCached(path, util::hash(path));
+
+		if (cached && !cached->exists)
+			return nullptr;
+	}
+
 	auto mp = _getMounted(path);
 
 	if (!mp)
 		return nullptr;
 
+	if (flags & (WRITE | FORCE_CREATE | ALLOW_CREATE))
+		_invalidateCache(mp->provider);
+
 	return mp->provider->openFile(&path[mp->pathOffset], flags);
 }
 
@@ -317,6 +408,7 @@ size_t VFSProvider::saveData(
 	if (!mp)
 		return 0;
 
+	_invalidateCache(mp->provider);
 	return mp->provider->saveData(input, length, &path[mp->pathOffset]);
 }
 
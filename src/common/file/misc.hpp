@@ -49,6 +49,7 @@ private:
 
 public:
 	bool getEntry(FileInfo &output);
+	size_t getEntries(FileInfo *output, size_t count);
 };
 
 class HostProvider : public Provider {
@@ -66,6 +67,7 @@ public:
 
 static constexpr char   VFS_PREFIX_SEPARATOR = ':';
 static constexpr size_t MAX_VFS_MOUNT_POINTS = 8;
+static constexpr size_t VFS_CACHE_SIZE       = 16;
 
 struct VFSMountPoint {
 public:
@@ -74,21 +76,41 @@ public:
 	Provider   *provider;
 };
 
+// The VFS keeps the results of the most recent getFileInfo() calls (including
+// failed ones), as the same few paths tend to be probed over and over. Each
+// entry is only valid as long as the provider's change count stays the same.
+struct VFSCacheEntry {
+public:
+	util::Hash    hash;
+	VFSMountPoint *mp;
+	uint32_t      changeCount;
+	bool          exists;
+	FileInfo      info;
+	char          path[MAX_PATH_LENGTH];
+};
+
 class VFSProvider : public Provider {
 private:
 	VFSMountPoint _mountPoints[MAX_VFS_MOUNT_POINTS];
+	VFSCacheEntry _cache[VFS_CACHE_SIZE];
+	size_t        _nextCacheEntry;
 
 	VFSMountPoint *_getMounted(const char *path);
+	const VFSCacheEntry *_getCached(const char *path, util::Hash hash);
+	void _invalidateCache(const Provider *provider);
 
 public:
-	inline VFSProvider(void) {
+	inline VFSProvider(void)
+	: _nextCacheEntry(0) {
 		type = VFS;
 
 		__builtin_memset(_mountPoints, 0, sizeof(_mountPoints));
+		__builtin_memset(_cache,       0, sizeof(_cache));
 	}
 
 	bool mount(const char *prefix, Provider *provider, bool force = false);
 	bool unmount(const char *prefix);
+	void flushCache(void);
 
 	bool getFileInfo(FileInfo &output, const char *path);
 	bool getFileFragments(FileFragmentTable &output, const char *path);
@@ -67,18 +67,6 @@ static bool _zipStatToFileInfo(
 	if (!stat.m_is_supported)
 		return false;
 
-#if 0
-	auto ptr = __builtin_strrchr(stat.m_filename, '/');
-
-	if (ptr)
-		ptr++;
-	else
-		ptr = (char *) stat.m_filename;
-#else
-	auto ptr = stat.m_filename;
-#endif
-
-	__builtin_strncpy(output.name, ptr, sizeof(output.name));
 	output.size       = stat.m_uncomp_size;
 	output.attributes = READ_ONLY | ARCHIVE;
 
@@ -88,21 +76,374 @@ static bool _zipStatToFileInfo(
 	return true;
 }
 
-/* ZIP directory class */
+// Lookups are case-insensitive, matching the behavior of miniz's own
+// mz_zip_reader_locate_file() when not passed MZ_ZIP_FLAG_CASE_SENSITIVE.
+static util::Hash _hashChars(
+	const char *str, size_t length, util::Hash value = 0
+) {
+	for (; length; length--)
+		value = util::Hash(__builtin_toupper(*(str++)))
+			+ (value << 6) + (value << 16) - value;
+
+	return value;
+}
+
+static bool _comparePaths(
+	const char *a, const char *aEnd, const char *b, const char *bEnd
+) {
+	while ((a < aEnd) && (b < bEnd)) {
+		// Treat repeated separators as a single one.
+		if ((*a == '/') && (*b == '/')) {
+			while ((a < aEnd) && (*a == '/'))
+				a++;
+			while ((b < bEnd) && (*b == '/'))
+				b++;
+
+			continue;
+		}
+
+		if (__builtin_toupper(*(a++)) != __builtin_toupper(*(b++)))
+			return false;
+	}
+
+	return (a == aEnd) && (b == bEnd);
+}
+
+static const char *_skipSeparators(const char *path) {
+	while ((*path == '/') || (*path == '\\'))
+		path++;
+
+	return path;
+}
+
+// Paths passed to the provider are normalized (by removing leading, trailing
+// and repeated separators) before being hashed and compared against the
+// archive's file names, which always use forward slashes.
+static size_t _normalizePath(char *output, const char *path) {
+	size_t length = 0;
+
+	for (path = _skipSeparators(path); *path;) {
+		if ((*path == '/') || (*path == '\\')) {
+			path = _skipSeparators(path);
+
+			if (*path && (length < (MAX_PATH_LENGTH - 1)))
+				output[length++] = '/';
+
+			continue;
+		}
+
+		if (length < (MAX_PATH_LENGTH - 1))
+			output[length++] = *path;
+
+		path++;
+	}
+
+	output[length] = 0;
+	return length;
+}
+
+/* ZIP file and directory classes */
+
+static constexpr size_t   _SKIP_BUFFER_LENGTH = 256;
+static constexpr uint32_t _ROOT_ENTRY         = 0xffffffff;
+static constexpr uint32_t _IMPLIED_DIRECTORY  = 0xffffffff;
+
+bool ZIPFile::_restart(void) {
+	if (_state)
+		mz_zip_reader_extract_iter_free(_state);
+
+	_state  = mz_zip_reader_extract_iter_new(_zip, _index, 0);
+	_offset = 0;
+
+	if (!_state) {
+		auto error = mz_zip_get_last_error(_zip);
+
+		LOG_FS("%s: %d", _MINIZ_ZIP_ERROR_NAMES[error], _index);
+		return false;
+	}
+
+	size = _state->file_stat.m_uncomp_size;
+	return true;
+}
+
+size_t ZIPFile::read(void *output, size_t length) {
+	if (!_state)
+		return 0;
+
+	auto actualLength = mz_zip_reader_extract_iter_read(_state, output, length);
+
+	_offset += actualLength;
+	return actualLength;
+}
+
+uint64_t ZIPFile::seek(uint64_t offset) {
+	offset = util::min(offset, size);
+
+	if ((offset < _offset) && !_restart())
+		return 0;
+
+	// Skip over any data between the current offset and the new one by
+	// decompressing it into a small temporary buffer.
+	uint8_t buffer[_SKIP_BUFFER_LENGTH];
+
+	while (_offset < offset) {
+		auto chunkLength = size_t(util::min<uint64_t>(
+			offset - _offset, sizeof(buffer)
+		));
+
+		if (read(buffer, chunkLength) < chunkLength)
+			break;
+	}
+
+	return _offset;
+}
+
+uint64_t ZIPFile::tell(void) const {
+	return _offset;
+}
+
+void ZIPFile::close(void) {
+	if (!_state)
+		return;
+
+	mz_zip_reader_extract_iter_free(_state);
+	_state = nullptr;
+}
+
 
 bool ZIPDirectory::getEntry(FileInfo &output) {
-	mz_zip_archive_file_stat stat;
+	return getEntries(&output, 1) == 1;
+}
 
-	while (_index < _zip->m_total_files) {
-		if (!mz_zip_reader_file_stat(_zip, _index++, &stat))
+size_t ZIPDirectory::getEntries(FileInfo *output, size_t count) {
+	auto   entries     = _provider->_entries.as<ZIPIndexEntry>();
+	size_t actualCount = 0;
+
+	while ((actualCount < count) && (_index < _provider->_numEntries)) {
+		auto &entry = entries[_index++];
+
+		if (entry.parent != _parent)
 			continue;
-		if (!_zipStatToFileInfo(output, stat))
+		if (_provider->_entryToFileInfo(output[actualCount], entry))
+			actualCount++;
+	}
+
+	return actualCount;
+}
+
+size_t ZIPDirectory::getSizeHint(void) const {
+	if (_parent == _ROOT_ENTRY)
+		return _provider->_numRootEntries;
+
+	return _provider->_entries.as<ZIPIndexEntry>()[_parent].numChildren;
+}
+
+bool ZIPDirectory::seek(size_t index) {
+	auto entries = _provider->_entries.as<ZIPIndexEntry>();
+
+	for (_index = 0; _index < _provider->_numEntries; _index++) {
+		if (entries[_index].parent != _parent)
+			continue;
+		if (!index)
+			return true;
+
+		index--;
+	}
+
+	return !index;
+}
+
+/* ZIP central directory index */
+
+bool ZIPProvider::_buildIndex(void) {
+	auto numFiles = _zip.m_total_files;
+	char name[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
+
+	// Each path component may result in a new entry, so the total number of
+	// components is an upper bound for the number of entries.
+	size_t maxEntries = 0;
+
+	for (mz_uint i = 0; i < numFiles; i++) {
+		mz_zip_reader_get_filename(&_zip, i, name, sizeof(name));
+
+		for (auto ptr = name; *ptr; ptr++) {
+			if ((ptr[0] != '/') && ((ptr[1] == '/') || !ptr[1]))
+				maxEntries++;
+		}
+	}
+
+	// The hash table holds the index of each entry plus one (with zero marking
+	// empty slots) and is kept at most half full.
+	size_t tableSize = 1;
+
+	while (tableSize < (maxEntries * 2))
+		tableSize <<= 1;
+
+	if (!_entries.allocate<ZIPIndexEntry>(util::max(maxEntries, size_t(1))))
+		return false;
+	if (!_hashTable.allocate<uint32_t>(tableSize))
+		return false;
+
+	__builtin_memset(_hashTable.ptr, 0, _hashTable.length);
+
+	_numEntries     = 0;
+	_numRootEntries = 0;
+	_hashTableMask  = tableSize - 1;
+
+	auto entries = _entries.as<ZIPIndexEntry>();
+	auto table   = _hashTable.as<uint32_t>();
+
+	for (mz_uint i = 0; i < numFiles; i++) {
+		mz_zip_reader_get_filename(&_zip, i, name, sizeof(name));
+
+		auto       start  = name;
+		auto       parent = _ROOT_ENTRY;
+		util::Hash hash   = 0;
+
+		while (*start == '/')
+			start++;
+
+		for (auto ptr = start; *ptr;) {
+			auto component = ptr;
+
+			while (*ptr && (*ptr != '/'))
+				ptr++;
+
+			// Skip any repeated separators, so that the path is hashed in the
+			// same normalized form as the ones passed to _findPath().
+			auto next = ptr;
+
+			while (*next == '/')
+				next++;
+
+			size_t nameLength = ptr - component;
+			bool   isLast     = !*next;
+
+			if (parent != _ROOT_ENTRY)
+				hash = _hashChars("/", 1, hash);
+
+			hash = _hashChars(component, nameLength, hash);
+
+			auto index = _findEntry(hash, start, ptr - start);
+
+			if (index < 0) {
+				auto &entry = entries[_numEntries];
+
+				entry.hash        = hash;
+				entry.parent      = parent;
+				entry.fileIndex   = isLast ? i : _IMPLIED_DIRECTORY;
+				entry.sourceIndex = i;
+				entry.numChildren = 0;
+				entry.nameOffset  = component - name;
+				entry.nameLength  = nameLength;
+
+				// Keep track of the number of children each directory has, so
+				// that it can be returned as a size hint without scanning the
+				// whole index.
+				if (parent == _ROOT_ENTRY)
+					_numRootEntries++;
+				else
+					entries[parent].numChildren++;
+
+				auto slot = hash & _hashTableMask;
+
+				while (table[slot])
+					slot = (slot + 1) & _hashTableMask;
+
+				table[slot] = ++_numEntries;
+				index       = _numEntries - 1;
+			} else if (
+				isLast && (entries[index].fileIndex == _IMPLIED_DIRECTORY)
+			) {
+				// If a directory was previously implied by another file's path,
+				// replace it with its actual entry.
+				entries[index].fileIndex   = i;
+				entries[index].sourceIndex = i;
+				entries[index].nameOffset  = component - name;
+			}
+
+			parent = index;
+			ptr    = next;
+		}
+	}
+
+	LOG_FS("indexed %d files, %d entries", numFiles, _numEntries);
+	return true;
+}
+
+bool ZIPProvider::_comparePath(
+	const ZIPIndexEntry &entry, const char *path, size_t length
+) {
+	char name[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
+
+	mz_zip_reader_get_filename(&_zip, entry.sourceIndex, name, sizeof(name));
+
+	auto start = name;
+
+	while (*start == '/')
+		start++;
+
+	auto end = &name[entry.nameOffset + entry.nameLength];
+
+	return _comparePaths(start, end, path, &path[length]);
+}
+
+int ZIPProvider::_findEntry(util::Hash hash, const char *path, size_t length) {
+	auto entries = _entries.as<ZIPIndexEntry>();
+	auto table   = _hashTable.as<uint32_t>();
+
+	// Make sure each match is not just a hash collision.
+	for (
+		auto slot = hash & _hashTableMask; table[slot];
+		slot = (slot + 1) & _hashTableMask
+	) {
+		auto &entry = entries[table[slot] - 1];
+
+		if (entry.hash != hash)
 			continue;
+		if (_comparePath(entry, path, length))
+			return table[slot] - 1;
+	}
+
+	return -1;
+}
+
+int ZIPProvider::_findPath(const char *path) {
+	char normalized[MAX_PATH_LENGTH];
+
+	auto length = _normalizePath(normalized, path);
+
+	if (!length)
+		return -1;
+
+	return _findEntry(_hashChars(normalized, length), normalized, length);
+}
+
+bool ZIPProvider::_entryToFileInfo(
+	FileInfo &output, const ZIPIndexEntry &entry
+) {
+	mz_zip_archive_file_stat stat;
+
+	if (entry.fileIndex == _IMPLIED_DIRECTORY) {
+		mz_zip_reader_get_filename(
+			&_zip, entry.sourceIndex, stat.m_filename, sizeof(stat.m_filename)
+		);
 
-		return true;
+		output.size       = 0;
+		output.attributes = READ_ONLY | ARCHIVE | DIRECTORY;
+	} else {
+		if (!mz_zip_reader_file_stat(&_zip, entry.fileIndex, &stat))
+			return false;
+		if (!_zipStatToFileInfo(output, stat))
+			return false;
 	}
 
-	return false;
+	// Only return the last component of the file's path as its name.
+	auto length = util::min(size_t(entry.nameLength), sizeof(output.name) - 1);
+
+	__builtin_memcpy(output.name, &stat.m_filename[entry.nameOffset], length);
+	output.name[length] = 0;
+	return true;
 }
 
 /* ZIP filesystem provider */
@@ -138,6 +479,11 @@ bool ZIPProvider::init(File *file) {
 		return false;
 	}
 
+	if (!_buildIndex()) {
+		mz_zip_reader_end(&_zip);
+		return false;
+	}
+
 	type     = ZIP_FILE;
 	capacity = _zip.m_archive_size;
 
@@ -159,6 +505,11 @@ bool ZIPProvider::init(const void *zipData, size_t length) {
 		return false;
 	}
 
+	if (!_buildIndex()) {
+		mz_zip_reader_end(&_zip);
+		return false;
+	}
+
 	type     = ZIP_MEMORY;
 	capacity = _zip.m_archive_size;
 
@@ -171,6 +522,12 @@ void ZIPProvider::close(void) {
 		return;
 
 	mz_zip_reader_end(&_zip);
+	_entries.destroy();
+	_hashTable.destroy();
+
+	_numEntries     = 0;
+	_numRootEntries = 0;
+	_hashTableMask  = 0;
 
 #if 0
 	if (_file) {
@@ -184,66 +541,84 @@ void ZIPProvider::close(void) {
 }
 
 bool ZIPProvider::getFileInfo(FileInfo &output, const char *path) {
-	// Any leading path separators must be stripped manually.
-	while ((*path == '/') || (*path == '\\'))
-		path++;
-
-	mz_zip_archive_file_stat stat;
-
-	int index = mz_zip_reader_locate_file(&_zip, path, nullptr, 0);
+	int index = _findPath(path);
 
 	if (index < 0)
 		return false;
-	if (!mz_zip_reader_file_stat(&_zip, index, &stat))
-		return false;
 
-	return _zipStatToFileInfo(output, stat);
+	return _entryToFileInfo(output, _entries.as<ZIPIndexEntry>()[index]);
 }
 
 Directory *ZIPProvider::openDirectory(const char *path) {
-	while ((*path == '/') || (*path == '\\'))
-		path++;
+	if (!(*_skipSeparators(path)))
+		return new ZIPDirectory(*this, _ROOT_ENTRY);
+
+	int index = _findPath(path);
 
-	// ZIP subdirectories are not currently handled; all files are instead
-	// returned as if they were part of the root directory.
-	if (*path)
+	if (index < 0)
 		return nullptr;
 
-	return new ZIPDirectory(_zip);
+	auto &entry = _entries.as<ZIPIndexEntry>()[index];
+
+	if (
+		(entry.fileIndex != _IMPLIED_DIRECTORY) &&
+		!mz_zip_reader_is_file_a_directory(&_zip, entry.fileIndex)
+	)
+		return nullptr;
+
+	return new ZIPDirectory(*this, index);
 }
 
-size_t ZIPProvider::loadData(util::Data &output, const char *path) {
-	while ((*path == '/') || (*path == '\\'))
-		path++;
+File *ZIPProvider::openFile(const char *path, uint32_t flags) {
+	if (flags & (WRITE | FORCE_CREATE))
+		return nullptr;
 
-	output.destroy();
-	output.ptr = mz_zip_reader_extract_file_to_heap(
-		&_zip, path, &(output.length), 0
-	);
+	int index = _findPath(path);
 
-	if (!output.ptr) {
-		auto error = mz_zip_get_last_error(&_zip);
+	if (index < 0) {
+		LOG_FS("not found: %s", path);
+		return nullptr;
+	}
 
-		LOG_FS("%s: %s", _MINIZ_ZIP_ERROR_NAMES[error], path);
-		return 0;
+	auto fileIndex = _entries.as<ZIPIndexEntry>()[index].fileIndex;
+
+	if (fileIndex == _IMPLIED_DIRECTORY)
+		return nullptr;
+
+	auto file = new ZIPFile(_zip, fileIndex);
+
+	if (!file->_restart()) {
+		delete file;
+		return nullptr;
 	}
 
-	return output.length;
+	return file;
 }
 
-size_t ZIPProvider::loadData(void *output, size_t length, const char *path) {
-	while ((*path == '/') || (*path == '\\'))
-		path++;
+size_t ZIPProvider::loadData(util::Data &output, const char *path) {
+	int index = _findPath(path);
 
-	if (!mz_zip_reader_extract_file_to_mem(&_zip, path, output, length, 0)) {
+	if (index < 0)
+		return 0;
+
+	auto fileIndex = _entries.as<ZIPIndexEntry>()[index].fileIndex;
+
+	if (fileIndex == _IMPLIED_DIRECTORY)
+		return 0;
+
+	output.destroy();
+	output.ptr = mz_zip_reader_extract_to_heap(
+		&_zip, fileIndex, &(output.length), 0
+	);
+
+	if (!output.ptr) {
 		auto error = mz_zip_get_last_error(&_zip);
 
 		LOG_FS("%s: %s", _MINIZ_ZIP_ERROR_NAMES[error], path);
 		return 0;
 	}
 
-	// FIXME: this may not reflect the file's actual length
-	return length;
+	return output.length;
 }
 
 }
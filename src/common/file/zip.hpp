@@ -23,38 +23,102 @@
 
 namespace file {
 
-/* ZIP directory class */
+/* ZIP file and directory classes */
+
+// Files are decompressed incrementally as they are read. As DEFLATE streams
+// cannot be decoded backwards, seeking backwards requires decompression to be
+// restarted from the beginning of the file.
+class ZIPFile : public File {
+	friend class ZIPProvider;
+
+private:
+	mz_zip_archive                   *_zip;
+	mz_zip_reader_extract_iter_state *_state;
+	size_t                           _index;
+
+	uint64_t _offset;
+
+	bool _restart(void);
+
+public:
+	inline ZIPFile(mz_zip_archive &zip, size_t index)
+	: _zip(&zip), _state(nullptr), _index(index), _offset(0) {}
+
+	size_t read(void *output, size_t length);
+	uint64_t seek(uint64_t offset);
+	uint64_t tell(void) const;
+	void close(void);
+};
+
+class ZIPProvider;
 
 class ZIPDirectory : public Directory {
+	friend class ZIPProvider;
+
 private:
-	mz_zip_archive *_zip;
-	size_t         _index;
+	ZIPProvider *_provider;
+	uint32_t    _parent;
+	size_t      _index;
 
 public:
-	inline ZIPDirectory(mz_zip_archive &zip)
-	: _zip(&zip), _index(0) {}
+	inline ZIPDirectory(ZIPProvider &provider, uint32_t parent)
+	: _provider(&provider), _parent(parent), _index(0) {}
 
 	bool getEntry(FileInfo &output);
+	size_t getEntries(FileInfo *output, size_t count);
+	size_t getSizeHint(void) const;
+	bool seek(size_t index);
+};
+
+/* ZIP central directory index */
+
+// As ZIP archives do not have a directory hierarchy (and may not even have
+// entries for directories), a tree is synthesized from the central directory's
+// file paths when the archive is mounted. Each entry represents a path
+// component and is indexed by the hash of the full path up to that component.
+struct ZIPIndexEntry {
+public:
+	util::Hash hash;
+	uint32_t   parent, fileIndex, sourceIndex, numChildren;
+	uint16_t   nameOffset, nameLength;
 };
 
 /* ZIP filesystem provider */
 
-// This implementation only supports loading an entire file at once.
 class ZIPProvider : public Provider {
+	friend class ZIPDirectory;
+
 private:
 	mz_zip_archive _zip;
 	File           *_file;
 
+	util::Data _entries, _hashTable;
+	size_t     _numEntries, _numRootEntries, _hashTableMask;
+
+	bool _buildIndex(void);
+	bool _comparePath(
+		const ZIPIndexEntry &entry, const char *path, size_t length
+	);
+	int _findEntry(util::Hash hash, const char *path, size_t length);
+	int _findPath(const char *path);
+	bool _entryToFileInfo(FileInfo &output, const ZIPIndexEntry &entry);
+
 public:
+	inline ZIPProvider(void)
+	: _file(nullptr), _numEntries(0), _numRootEntries(0), _hashTableMask(0) {}
+
 	bool init(File *file);
 	bool init(const void *zipData, size_t length);
 	void close(void);
 
 	bool getFileInfo(FileInfo &output, const char *path);
 	Directory *openDirectory(const char *path);
+	File *openFile(const char *path, uint32_t flags);
 
+	// Partial reads are handled by the generic implementation, which only
+	// decompresses as much data as requested.
+	using Provider::loadData;
 	size_t loadData(util::Data &output, const char *path);
-	size_t loadData(void *output, size_t length, const char *path);
 };
 
 }
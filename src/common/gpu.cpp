@@ -57,7 +57,7 @@ size_t upload(const RectWH &rect, const void *data, bool wait) {
 	while (!(GPU_GP1 & GP1_STAT_WRITE_READY))
 		__asm__ volatile("");
 
-	DMA_MADR(DMA_GPU) = reinterpret_cast<uint32_t>(data);
+	DMA_MADR(DMA_GPU) = reinterpret_cast<uintptr_t>(data);
 	DMA_BCR (DMA_GPU) = _DMA_CHUNK_SIZE | (length << 16);
 	DMA_CHCR(DMA_GPU) = DMA_CHCR_WRITE | DMA_CHCR_MODE_SLICE | DMA_CHCR_ENABLE;
 
@@ -95,7 +95,7 @@ size_t download(const RectWH &rect, void *data, bool wait) {
 	while (!(GPU_GP1 & GP1_STAT_READ_READY))
 		__asm__ volatile("");
 
-	DMA_MADR(DMA_GPU) = reinterpret_cast<uint32_t>(data);
+	DMA_MADR(DMA_GPU) = reinterpret_cast<uintptr_t>(data);
 	DMA_BCR (DMA_GPU) = _DMA_CHUNK_SIZE | (length << 16);
 	DMA_CHCR(DMA_GPU) = DMA_CHCR_READ | DMA_CHCR_MODE_SLICE | DMA_CHCR_ENABLE;
 
@@ -181,7 +181,7 @@ void Context::flip(void) {
 	GPU_GP1 = gp1_fbOffset(newBuffer.clip.x1, newBuffer.clip.y1);
 	GPU_GP1 = gp1_dmaRequestMode(GP1_DREQ_GP0_WRITE);
 
-	DMA_MADR(DMA_GPU) = reinterpret_cast<uint32_t>(oldBuffer.displayList);
+	DMA_MADR(DMA_GPU) = reinterpret_cast<uintptr_t>(oldBuffer.displayList);
 	DMA_CHCR(DMA_GPU) = DMA_CHCR_WRITE | DMA_CHCR_MODE_LIST | DMA_CHCR_ENABLE;
 }
 
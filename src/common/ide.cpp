@@ -16,6 +16,8 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include "common/ide.hpp"
 #include "common/idedefs.hpp"
 #include "common/io.hpp"
@@ -173,16 +175,59 @@ int IdentifyBlock::getHighestPIOMode(void) const {
 	return 1;
 }
 
+int IdentifyBlock::getHighestMultiSectorCount(void) const {
+	// The maximum number of sectors per DRQ block is stored in the lower 8
+	// bits. As some drives only accept powers of 2 when setting the block
+	// size, the value is rounded down accordingly.
+	int count = maxMultiSectorCount & 0xff;
+
+	if (count < 2)
+		return 0;
+
+	return 1 << (31 - __builtin_clz(count));
+}
+
+int IdentifyBlock::getHighestDMAMode(void) const {
+	if (!(capabilities & IDENTIFY_CAP_FLAG_DMA))
+		return -1;
+
+	if (dmaModeFlags & (1 << 2))
+		return 2;
+	if (dmaModeFlags & (1 << 1))
+		return 1;
+	if (dmaModeFlags & (1 << 0))
+		return 0;
+
+	return -1;
+}
+
 /* Device class */
 
-static constexpr int _DMA_TIMEOUT = 10000;
+// Multiword DMA transfers are allowed to take much longer than PIO transfers
+// performed through the DMA channel, as a slow CD-ROM drive may have to stream
+// an entire chunk from the disc.
+static constexpr int    _DMA_TIMEOUT    = 10000;
+static constexpr int    _MWDMA_TIMEOUT  = 30000000;
+static constexpr size_t _MAX_DMA_LENGTH = 0x20000;
 
 Device devices[2]{ (DEVICE_PRIMARY), (DEVICE_SECONDARY) };
 
 Device::Device(uint32_t flags)
-: flags(flags), capacity(0), lastStatusReg(0), lastErrorReg(0), lastCountReg(0)
-{
+:
+#ifdef ENABLE_FULL_IDE_DRIVER
+_cacheLBA(0), _nextLBA(0), _cacheLength(0), _cachedSectors(0),
+#endif
+flags(flags),
+#ifdef ENABLE_FULL_IDE_DRIVER
+discChangeCount(0),
+#endif
+capacity(0), multiSectorCount(0), lastStatusReg(0), lastErrorReg(0),
+lastCountReg(0) {
 	util::clear(lastSenseData);
+#ifdef ENABLE_FULL_IDE_DRIVER
+	util::clear(cacheStats);
+	util::clear(stats);
+#endif
 }
 
 void Device::_readPIO(void *data, size_t length) const {
@@ -215,7 +260,7 @@ bool Device::_readDMA(void *data, size_t length) const {
 
 	util::assertAligned<uint32_t>(data);
 
-	DMA_MADR(DMA_PIO) = reinterpret_cast<uint32_t>(data);
+	DMA_MADR(DMA_PIO) = reinterpret_cast<uintptr_t>(data);
 	DMA_BCR (DMA_PIO) = length;
 	DMA_CHCR(DMA_PIO) = 0
 		| DMA_CHCR_READ
@@ -232,7 +277,7 @@ bool Device::_writeDMA(const void *data, size_t length) const {
 
 	util::assertAligned<uint32_t>(data);
 
-	DMA_MADR(DMA_PIO) = reinterpret_cast<uint32_t>(data);
+	DMA_MADR(DMA_PIO) = reinterpret_cast<uintptr_t>(data);
 	DMA_BCR (DMA_PIO) = length;
 	DMA_CHCR(DMA_PIO) = 0
 		| DMA_CHCR_WRITE
@@ -252,6 +297,89 @@ static constexpr int _DETECT_TIMEOUT  = 2500000;
 static constexpr int _SRST_SET_DELAY   = 5000;
 static constexpr int _SRST_CLEAR_DELAY = 50000;
 
+static constexpr int _POLL_DELAY = 10;
+
+#ifdef ENABLE_FULL_IDE_DRIVER
+// Commands that complete quickly (such as most PIO data blocks) are still
+// busy-polled for a short time, as yielding would add up to a frame of latency
+// to each of them. The time spent yielding is measured using timer 1, which
+// counts horizontal blanking periods (roughly 64 us each).
+static constexpr int _IRQ_POLL_TIME = 500;
+static constexpr int _HBLANK_TIME   = 64;
+
+static volatile bool _irqPending = false;
+
+// The IRQ handler only flags the drive as ready. Preempting the main thread
+// here would stall it mid-frame, so the main loop instead checks the flag once
+// it is done with the current frame and switches back to the waiting thread as
+// soon as it is set, without waiting for the next frame.
+void handleInterrupt(void) {
+	_irqPending = true;
+}
+
+bool isInterruptPending(void) {
+	return _irqPending;
+}
+
+static void _updateHistogram(uint32_t *histogram, int elapsed) {
+	int bucket = (elapsed > 0) ? (32 - __builtin_clz(elapsed)) : 0;
+
+	histogram[util::min(bucket, NUM_LATENCY_BUCKETS - 1)]++;
+}
+#endif
+
+void Device::_command(uint8_t command) {
+#ifdef ENABLE_FULL_IDE_DRIVER
+	// Discard any IRQ raised by a previous command that was busy-polled, so
+	// that it does not end the next wait early.
+	_irqPending = false;
+	stats.commands[command]++;
+#endif
+
+	_write(CS0_COMMAND, command);
+}
+
+// Waits for the drive's status to (potentially) change. If the device is set up
+// to use interrupts and this function is called from a worker thread, it will
+// yield to the main thread (unless the IDE IRQ has already fired) until it
+// switches back. Returns the approximate time spent in microseconds.
+int Device::_waitForStatusChange(int elapsed) {
+#ifdef ENABLE_FULL_IDE_DRIVER
+	if ((flags & DEVICE_IRQ) && (elapsed >= _IRQ_POLL_TIME)) {
+		auto thread = currentThread;
+
+		switchThread(nullptr);
+
+		// Polling must be used as a fallback if there is no other thread to
+		// yield to.
+		if (nextThread != thread) {
+			// Make sure the drive is allowed to assert INTRQ, as resetting the
+			// other drive on the bus will disable it again.
+			_write(CS1_DEVICE_CTRL, 0);
+
+			uint16_t start = TIMER_VALUE(1);
+
+			if (_irqPending)
+				switchThread(thread);
+			else
+				switchThreadImmediate(nullptr);
+
+			_irqPending = false;
+
+			uint16_t lines = TIMER_VALUE(1) - start;
+
+			return util::max(int(lines) * _HBLANK_TIME, _POLL_DELAY);
+		}
+	}
+#endif
+
+	delayMicroseconds(_POLL_DELAY);
+#ifndef ENABLE_FULL_IDE_DRIVER
+	io::clearWatchdog();
+#endif
+	return _POLL_DELAY;
+}
+
 // Note that ATA drives will always assert DRDY when ready, but ATAPI drives
 // will not. This is an intentional feature meant to prevent ATA-only drivers
 // from misdetecting ATAPI drives.
@@ -259,36 +387,47 @@ DeviceError Device::_waitForIdle(bool drdy, int timeout, bool ignoreError) {
 	if (!timeout)
 		timeout = _COMMAND_TIMEOUT;
 
-	for (; timeout > 0; timeout -= 10) {
+	auto error   = STATUS_TIMEOUT;
+	int  elapsed = 0;
+
+	for (; elapsed < timeout; elapsed += _waitForStatusChange(elapsed)) {
 		auto status = _read(CS0_STATUS);
 
 		// Only check for errors *after* BSY is cleared.
 		if (!(status & CS0_STATUS_BSY)) {
 			if ((status & CS0_STATUS_ERR) && !ignoreError) {
 				_handleError();
-				return DRIVE_ERROR;
+				error = DRIVE_ERROR;
+				break;
 			}
 
-			if ((status & CS0_STATUS_DRDY) || !drdy)
-				return NO_ERROR;
+			if ((status & CS0_STATUS_DRDY) || !drdy) {
+				error = NO_ERROR;
+				break;
+			}
 		}
+	}
 
-		delayMicroseconds(10);
-#ifndef ENABLE_FULL_IDE_DRIVER
-		io::clearWatchdog();
+#ifdef ENABLE_FULL_IDE_DRIVER
+	_updateHistogram(stats.idleLatency, elapsed);
 #endif
+
+	if (error == STATUS_TIMEOUT) {
+		LOG_IDE("timeout, ignore=%d", ignoreError);
+		_handleTimeout();
 	}
 
-	LOG_IDE("timeout, ignore=%d", ignoreError);
-	_handleTimeout();
-	return STATUS_TIMEOUT;
+	return error;
 }
 
 DeviceError Device::_waitForDRQ(int timeout, bool ignoreError) {
 	if (!timeout)
 		timeout = _DRQ_TIMEOUT;
 
-	for (; timeout > 0; timeout -= 10) {
+	auto error   = STATUS_TIMEOUT;
+	int  elapsed = 0;
+
+	for (; elapsed < timeout; elapsed += _waitForStatusChange(elapsed)) {
 		auto status = _read(CS0_STATUS);
 
 		// Check for errors *before* DRQ is set but *after* BSY is cleared.
@@ -296,22 +435,27 @@ DeviceError Device::_waitForDRQ(int timeout, bool ignoreError) {
 		if (!(status & CS0_STATUS_BSY)) {
 			if ((status & CS0_STATUS_ERR) && !ignoreError) {
 				_handleError();
-				return DRIVE_ERROR;
+				error = DRIVE_ERROR;
+				break;
 			}
 		}
 
-		if (status & CS0_STATUS_DRQ)
-			return NO_ERROR;
+		if (status & CS0_STATUS_DRQ) {
+			error = NO_ERROR;
+			break;
+		}
+	}
 
-		delayMicroseconds(10);
-#ifndef ENABLE_FULL_IDE_DRIVER
-		io::clearWatchdog();
+#ifdef ENABLE_FULL_IDE_DRIVER
+	_updateHistogram(stats.drqLatency, elapsed);
 #endif
+
+	if (error == STATUS_TIMEOUT) {
+		LOG_IDE("timeout, ignore=%d", ignoreError);
+		_handleTimeout();
 	}
 
-	LOG_IDE("timeout, ignore=%d", ignoreError);
-	_handleTimeout();
-	return STATUS_TIMEOUT;
+	return error;
 }
 
 void Device::_handleError(void) {
@@ -319,6 +463,10 @@ void Device::_handleError(void) {
 	lastErrorReg  = _read(CS0_ERROR);
 	lastCountReg  = _read(CS0_COUNT);
 
+#ifdef ENABLE_FULL_IDE_DRIVER
+	stats.errors++;
+#endif
+
 	LOG_IDE(
 		"%d, st=0x%02x, err=0x%02x, cnt=0x%02x", getDriveIndex(), lastStatusReg,
 		lastErrorReg, lastCountReg
@@ -328,7 +476,7 @@ void Device::_handleError(void) {
 	// error's sense data being lost.
 #if 0
 	if (flags & DEVICE_ATAPI)
-		_write(CS0_COMMAND, ATA_DEVICE_RESET);
+		_command(ATA_DEVICE_RESET);
 #endif
 }
 
@@ -337,21 +485,28 @@ void Device::_handleTimeout(void) {
 	lastErrorReg  = _read(CS0_ERROR);
 	lastCountReg  = _read(CS0_COUNT);
 
+#ifdef ENABLE_FULL_IDE_DRIVER
+	stats.timeouts++;
+#endif
+
 	LOG_IDE(
 		"%d, st=0x%02x, err=0x%02x, cnt=0x%02x", getDriveIndex(), lastStatusReg,
 		lastErrorReg, lastCountReg
 	);
 
 	if (flags & DEVICE_ATAPI)
-		_write(CS0_COMMAND, ATA_DEVICE_RESET);
+		_command(ATA_DEVICE_RESET);
 }
 
-DeviceError Device::_resetDrive(void) {
-	// Issue a software reset, which affects both devices on the bus.
-	_write(CS1_DEVICE_CTRL, CS1_DEVICE_CTRL_IEN | CS1_DEVICE_CTRL_SRST);
-	delayMicroseconds(_SRST_SET_DELAY);
-	_write(CS1_DEVICE_CTRL, CS1_DEVICE_CTRL_IEN);
-	delayMicroseconds(_SRST_CLEAR_DELAY);
+DeviceError Device::_resetDrive(bool resetBus) {
+	// Issue a software reset, which affects both devices on the bus. When
+	// enumerating both devices, only the first one needs to do this.
+	if (resetBus) {
+		_write(CS1_DEVICE_CTRL, CS1_DEVICE_CTRL_IEN | CS1_DEVICE_CTRL_SRST);
+		delayMicroseconds(_SRST_SET_DELAY);
+		_write(CS1_DEVICE_CTRL, CS1_DEVICE_CTRL_IEN);
+		delayMicroseconds(_SRST_CLEAR_DELAY);
+	}
 
 	_select(0);
 
@@ -394,13 +549,16 @@ DeviceError Device::_resetDrive(void) {
 
 /* ATA-specific function */
 
+// The ERR flag is not cleared until a new command is issued, so any error left
+// over from the previous command (e.g. an aborted READ MULTIPLE or DMA command
+// being retried) must be ignored here.
 DeviceError Device::_ataSetLBA(uint64_t lba, size_t count, int timeout) {
 	if (flags & DEVICE_HAS_LBA48) {
 		//assert(lba < (1ULL << 48));
 		//assert(count <= (1 << 16));
 		_select(CS0_DEVICE_SEL_LBA);
 
-		auto error = _waitForIdle(true);
+		auto error = _waitForIdle(true, timeout, true);
 
 		if (error)
 			return error;
@@ -414,7 +572,7 @@ DeviceError Device::_ataSetLBA(uint64_t lba, size_t count, int timeout) {
 		//assert(count <= (1 << 8));
 		_select(CS0_DEVICE_SEL_LBA | ((lba >> 24) & 15));
 
-		auto error = _waitForIdle(true);
+		auto error = _waitForIdle(true, timeout, true);
 
 		if (error)
 			return error;
@@ -427,20 +585,121 @@ DeviceError Device::_ataSetLBA(uint64_t lba, size_t count, int timeout) {
 	return NO_ERROR;
 }
 
+#ifdef ENABLE_FULL_IDE_DRIVER
+DeviceError Device::_ataTransferDMA(
+	uintptr_t ptr, uint64_t lba, size_t count, bool write
+) {
+	uint8_t cmd;
+
+	if (flags & DEVICE_HAS_LBA48)
+		cmd = write ? ATA_WRITE_DMA_EXT : ATA_READ_DMA_EXT;
+	else
+		cmd = write ? ATA_WRITE_DMA : ATA_READ_DMA;
+
+	auto error = _ataSetLBA(lba, count);
+
+	if (error)
+		return error;
+
+	_command(cmd);
+
+	// Drives assert DRQ alongside DMARQ once ready to transfer data, so waiting
+	// for it first allows errors to be reported without waiting for the DMA
+	// timeout to expire.
+	error = _waitForDRQ();
+
+	if (error)
+		return error;
+
+	size_t length = count * ATA_SECTOR_SIZE;
+	bool   done   = write
+		? _writeDMA(reinterpret_cast<const void *>(ptr), length)
+		: _readDMA(reinterpret_cast<void *>(ptr), length);
+
+	// Keep waiting if the transfer takes longer than a PIO one would.
+	if (!done)
+		done = waitForDMATransfer(DMA_PIO, _MWDMA_TIMEOUT);
+
+	if (!done) {
+		DMA_CHCR(DMA_PIO) = 0;
+
+		LOG_IDE("DMA timeout, lba=0x%llx", lba);
+		_handleTimeout();
+		return STATUS_TIMEOUT;
+	}
+
+	if (write)
+		stats.bytesWritten += length;
+	else
+		stats.bytesRead    += length;
+
+	return _waitForIdle();
+}
+#endif
+
 DeviceError Device::_ataTransfer(
 	uintptr_t ptr, uint64_t lba, size_t count, bool write
 ) {
+#ifdef ENABLE_FULL_IDE_DRIVER
+	// Use DMA if enabled and if the buffer is suitably aligned. If the drive
+	// rejects the command or the transfer times out, disable DMA permanently
+	// and carry on using PIO.
+	if ((flags & DEVICE_DMA) && !(ptr % alignof(uint32_t))) {
+		while (count) {
+			size_t chunkLength =
+				util::min(count, _MAX_DMA_LENGTH / ATA_SECTOR_SIZE);
+
+			auto error = _ataTransferDMA(ptr, lba, chunkLength, write);
+
+			if (
+				(error == STATUS_TIMEOUT) || (
+					(error == DRIVE_ERROR) &&
+					(lastErrorReg & (CS0_ERROR_ABRT | CS0_ERROR_ICRC))
+				)
+			) {
+				LOG_IDE("DMA failed, falling back to PIO");
+				flags &= ~DEVICE_DMA;
+				stats.retries++;
+				break;
+			}
+			if (error)
+				return error;
+
+			ptr   += chunkLength * ATA_SECTOR_SIZE;
+			lba   += chunkLength;
+			count -= chunkLength;
+		}
+
+		if (!count)
+			return NO_ERROR;
+	}
+#endif
+
 	uint8_t cmd;
 	size_t  maxLength;
 
+	// If multiple mode was enabled, use READ/WRITE MULTIPLE to transfer more
+	// than one sector per DRQ assertion.
+	bool multiple = (multiSectorCount > 1);
+
 	if (flags & DEVICE_HAS_LBA48) {
-		cmd       = write ? ATA_WRITE_SECTORS_EXT : ATA_READ_SECTORS_EXT;
+		if (multiple)
+			cmd = write ? ATA_WRITE_MULTIPLE_EXT : ATA_READ_MULTIPLE_EXT;
+		else
+			cmd = write ? ATA_WRITE_SECTORS_EXT : ATA_READ_SECTORS_EXT;
+
 		maxLength = 1 << 16;
 	} else {
-		cmd       = write ? ATA_WRITE_SECTORS : ATA_READ_SECTORS;
+		if (multiple)
+			cmd = write ? ATA_WRITE_MULTIPLE : ATA_READ_MULTIPLE;
+		else
+			cmd = write ? ATA_WRITE_SECTORS : ATA_READ_SECTORS;
+
 		maxLength = 1 << 8;
 	}
 
+	size_t blockLength = multiple ? multiSectorCount : 1;
+
 	while (count) {
 		size_t chunkLength = util::min(count, maxLength);
 
@@ -449,22 +708,59 @@ DeviceError Device::_ataTransfer(
 		if (error)
 			return error;
 
-		_write(CS0_COMMAND, cmd);
+		_command(cmd);
+
+		// Data must be transferred one block at a time (a single sector, or up
+		// to multiSectorCount sectors in multiple mode) as the drive may
+		// deassert DRQ between blocks.
+		auto chunkPtr = ptr;
 
-		// Data must be transferred one sector at a time as the drive may
-		// deassert DRQ between sectors.
-		for (size_t i = chunkLength; i; i--, ptr += ATA_SECTOR_SIZE) {
-			auto error = _waitForDRQ();
+		for (size_t i = chunkLength; i;) {
+			error = _waitForDRQ();
 
 			if (error)
-				return error;
+				break;
+
+			size_t numSectors = util::min(i, blockLength);
+			size_t length     = numSectors * ATA_SECTOR_SIZE;
+
+			if (write)
+				_writePIO(reinterpret_cast<const void *>(chunkPtr), length);
+			else
+				_readPIO(reinterpret_cast<void *>(chunkPtr), length);
 
+#ifdef ENABLE_FULL_IDE_DRIVER
 			if (write)
-				_writePIO(reinterpret_cast<const void *>(ptr), ATA_SECTOR_SIZE);
+				stats.bytesWritten += length;
 			else
-				_readPIO(reinterpret_cast<void *>(ptr), ATA_SECTOR_SIZE);
+				stats.bytesRead    += length;
+#endif
+
+			chunkPtr += length;
+			i        -= numSectors;
 		}
 
+		if (error) {
+			// Some drives report support for multiple mode but then abort
+			// READ/WRITE MULTIPLE commands. In that case disable multiple mode
+			// and retry the chunk one sector at a time.
+			if (
+				multiple && (error == DRIVE_ERROR) &&
+				(lastErrorReg & CS0_ERROR_ABRT)
+			) {
+				LOG_IDE("multiple mode aborted, falling back");
+				multiSectorCount = 0;
+#ifdef ENABLE_FULL_IDE_DRIVER
+				stats.retries++;
+#endif
+
+				return _ataTransfer(ptr, lba, count, write);
+			}
+
+			return error;
+		}
+
+		ptr   += chunkLength * ATA_SECTOR_SIZE;
 		lba   += chunkLength;
 		count -= chunkLength;
 	}
@@ -496,11 +792,14 @@ DeviceError Device::_atapiRequestSense(void) {
 #else
 		_setCylinder(ATAPI_SECTOR_SIZE);
 #endif
-		_write(CS0_COMMAND, ATA_PACKET);
+		_command(ATA_PACKET);
 
 		error = _waitForDRQ(_REQ_SENSE_TIMEOUT, true);
 	}
 	if (!error) {
+#ifdef ENABLE_FULL_IDE_DRIVER
+		stats.packets[packet.command]++;
+#endif
 		_writePIO(&packet, getPacketSize());
 
 		error = _waitForDRQ(_REQ_SENSE_TIMEOUT, true);
@@ -519,13 +818,29 @@ DeviceError Device::_atapiRequestSense(void) {
 		lastSenseData.senseKey = lastErrorReg >> 4;
 
 		LOG_IDE("%s", getErrorString(error));
-		_write(CS0_COMMAND, ATA_DEVICE_RESET);
+		_command(ATA_DEVICE_RESET);
+	}
+
+#ifdef ENABLE_FULL_IDE_DRIVER
+	stats.senseKeys[lastSenseData.senseKey & 15]++;
+#endif
+
+	error = _senseDataToError(lastSenseData);
+
+#ifdef ENABLE_FULL_IDE_DRIVER
+	// Any data left in the readahead cache may belong to a different disc.
+	if (error == DISC_CHANGED) {
+		invalidateCache();
+		discChangeCount++;
 	}
+#endif
 
-	return _senseDataToError(lastSenseData);
+	return error;
 }
 
-DeviceError Device::_atapiPacket(const Packet &packet, size_t dataLength) {
+DeviceError Device::_atapiPacket(
+	const Packet &packet, size_t dataLength, bool dma, bool wait
+) {
 	if (!(flags & DEVICE_READY))
 		return NO_DRIVE;
 	if (!(flags & DEVICE_ATAPI))
@@ -534,29 +849,37 @@ DeviceError Device::_atapiPacket(const Packet &packet, size_t dataLength) {
 	LOG_IDE("cmd=0x%02x, length=0x%x", packet.command, dataLength);
 
 	// Keep resending the command as long as the drive reports it is in progress
-	// of becoming ready (i.e. spinning up).
+	// of becoming ready (i.e. spinning up). As with ATA commands, any error
+	// left over from the previous command (e.g. a rejected IDLE) is ignored.
 	for (
 		int timeout = _ATAPI_READY_TIMEOUT; timeout > 0;
 		timeout -= _ATAPI_POLL_DELAY
 	) {
 		_select(0);
 
-		auto error = _waitForIdle();
+		auto error = _waitForIdle(false, 0, true);
 
 		if (!error) {
-			_write(CS0_FEATURES, 0);
+			_write(CS0_FEATURES, dma ? CS0_FEATURES_DMA : 0);
 #if 0
 			_setCylinder(dataLength);
 #else
 			_setCylinder(ATAPI_SECTOR_SIZE);
 #endif
-			_write(CS0_COMMAND, ATA_PACKET);
+			_command(ATA_PACKET);
 
 			error = _waitForDRQ();
 		}
 		if (!error) {
+#ifdef ENABLE_FULL_IDE_DRIVER
+			stats.packets[packet.command]++;
+#endif
 			_writePIO(&packet, getPacketSize());
 
+			// When using DMA, the data phase is handled by the caller.
+			if (dma)
+				return NO_ERROR;
+
 			error = dataLength
 				? _waitForDRQ()
 				: _waitForIdle();
@@ -568,15 +891,27 @@ DeviceError Device::_atapiPacket(const Packet &packet, size_t dataLength) {
 		// the command.
 		LOG_IDE("%s, cmd=0x%02x", getErrorString(error), packet.command);
 
+		bool aborted =
+			(error == DRIVE_ERROR) && (lastErrorReg & CS0_ERROR_ABRT);
+
 		error = _atapiRequestSense();
 
+		// A drive rejecting the command itself (e.g. as it does not support
+		// DMA) aborts it without reporting any sense data, so resending it
+		// would never succeed.
+		if (!error && aborted)
+			return UNSUPPORTED_OP;
 		if (error && (error != NOT_YET_READY)) {
 			LOG_IDE("%s (from sense)", getErrorString(error));
 			return error;
 		}
+		if (!wait)
+			return NOT_YET_READY;
 
 		delayMicroseconds(_ATAPI_POLL_DELAY);
-#ifndef ENABLE_FULL_IDE_DRIVER
+#ifdef ENABLE_FULL_IDE_DRIVER
+		stats.retries++;
+#else
 		io::clearWatchdog();
 #endif
 	}
@@ -585,7 +920,82 @@ DeviceError Device::_atapiPacket(const Packet &packet, size_t dataLength) {
 	return STATUS_TIMEOUT;
 }
 
+#ifdef ENABLE_FULL_IDE_DRIVER
+DeviceError Device::_atapiReadDMA(uintptr_t ptr, uint32_t lba, size_t count) {
+	Packet packet;
+
+	packet.setRead(lba, count);
+
+	size_t length = count * ATAPI_SECTOR_SIZE;
+	auto   error  = _atapiPacket(packet, length, true);
+
+	if (error)
+		return error;
+
+	error = _waitForDRQ();
+
+	if (!error) {
+		bool done = _readDMA(reinterpret_cast<void *>(ptr), length)
+			|| waitForDMATransfer(DMA_PIO, _MWDMA_TIMEOUT);
+
+		if (!done) {
+			DMA_CHCR(DMA_PIO) = 0;
+
+			LOG_IDE("DMA timeout, lba=0x%x", lba);
+			_handleTimeout();
+			return STATUS_TIMEOUT;
+		}
+
+		stats.bytesRead += length;
+
+		error = _waitForIdle();
+	}
+
+	if (error != DRIVE_ERROR)
+		return error;
+
+	// Fetch the sense data to figure out whether the error was caused by the
+	// disc or by the drive refusing to perform the transfer using DMA.
+	error = _atapiRequestSense();
+
+	return error ? error : DRIVE_ERROR;
+}
+#endif
+
 DeviceError Device::_atapiRead(uintptr_t ptr, uint32_t lba, size_t count) {
+#ifdef ENABLE_FULL_IDE_DRIVER
+	if ((flags & DEVICE_DMA) && !(ptr % alignof(uint32_t))) {
+		while (count) {
+			size_t chunkLength =
+				util::min(count, _MAX_DMA_LENGTH / ATAPI_SECTOR_SIZE);
+
+			auto error = _atapiReadDMA(ptr, lba, chunkLength);
+
+			// Let the PIO path's retry logic deal with drives that are still
+			// spinning up, as well as any other drive error (which may not be
+			// related to DMA at all). DMA is only disabled permanently if the
+			// transfer timed out or the drive aborted the command.
+			if ((error == NOT_YET_READY) || (error == DRIVE_ERROR))
+				break;
+			if ((error == STATUS_TIMEOUT) || (error == UNSUPPORTED_OP)) {
+				LOG_IDE("DMA failed, falling back to PIO");
+				flags &= ~DEVICE_DMA;
+				stats.retries++;
+				break;
+			}
+			if (error)
+				return error;
+
+			ptr   += chunkLength * ATAPI_SECTOR_SIZE;
+			lba   += chunkLength;
+			count -= chunkLength;
+		}
+
+		if (!count)
+			return NO_ERROR;
+	}
+#endif
+
 	Packet packet;
 
 	packet.setRead(lba, count);
@@ -598,28 +1008,123 @@ DeviceError Device::_atapiRead(uintptr_t ptr, uint32_t lba, size_t count) {
 	// Data must be transferred one sector at a time as the drive may deassert
 	// DRQ between sectors.
 	for (; count; count--) {
-		auto error = _waitForDRQ();
+		error = _waitForDRQ();
 
 		if (error)
-			return error;
+			break;
 
 		size_t chunkLength = _getCylinder();
 
 		_readPIO(reinterpret_cast<void *>(ptr), chunkLength);
 		ptr += chunkLength;
+
+#ifdef ENABLE_FULL_IDE_DRIVER
+		stats.bytesRead += chunkLength;
+#endif
 	}
 
-	return _waitForIdle();
+	if (!error)
+		error = _waitForIdle();
+	if (error != DRIVE_ERROR)
+		return error;
+
+	// Fetch the sense data for errors reported during the data phase (e.g. an
+	// unreadable sector) rather than leaving it pending for the next command.
+	error = _atapiRequestSense();
+
+	return error ? error : DRIVE_ERROR;
+}
+
+#ifdef ENABLE_FULL_IDE_DRIVER
+DeviceError Device::_atapiCachedRead(
+	uintptr_t ptr, uint32_t lba, size_t count
+) {
+	while (count) {
+		// Copy over as many sectors as possible from the readahead cache.
+		if (
+			_cachedSectors && (lba >= _cacheLBA) &&
+			(lba < (_cacheLBA + _cachedSectors))
+		) {
+			size_t offset     = lba - _cacheLBA;
+			size_t numSectors = util::min(count, _cachedSectors - offset);
+			size_t length     = numSectors * ATAPI_SECTOR_SIZE;
+
+			__builtin_memcpy(
+				reinterpret_cast<void *>(ptr),
+				&_cache.as<uint8_t>()[offset * ATAPI_SECTOR_SIZE], length
+			);
+
+			cacheStats.hits += numSectors;
+			ptr             += length;
+			lba             += numSectors;
+			count           -= numSectors;
+			_nextLBA         = lba;
+			continue;
+		}
+
+		// Only fill the cache if the request continues the previous one and is
+		// smaller than the cache, as large or random reads would not benefit
+		// from it. If the drive refuses to read the whole cache's worth of
+		// sectors (e.g. as they would go past the end of the disc), fall back
+		// to reading the requested sectors directly.
+		if ((lba == _nextLBA) && (count < _cacheLength)) {
+			auto error = _atapiRead(
+				reinterpret_cast<uintptr_t>(_cache.ptr), lba, _cacheLength
+			);
+
+			if (!error) {
+				_cacheLBA      = lba;
+				_cachedSectors = _cacheLength;
+
+				cacheStats.prefetches++;
+				continue;
+			}
+
+			invalidateCache();
+
+			if (error == DISC_CHANGED)
+				return error;
+		}
+
+		cacheStats.misses += count;
+		_nextLBA           = lba + count;
+
+		return _atapiRead(ptr, lba, count);
+	}
+
+	return NO_ERROR;
 }
+#endif
 
 /* Public API */
 
 static constexpr uint16_t _ATAPI_SIGNATURE = 0xeb14;
 
 DeviceError Device::enumerate(void) {
-	flags &= DEVICE_PRIMARY | DEVICE_SECONDARY;
+	auto error = detect();
+
+	if (error)
+		return error;
+
+	// Make sure any pending ATAPI sense data is cleared.
+	do {
+		error = poll();
+	} while ((error == ide::NOT_YET_READY) || (error == ide::DISC_CHANGED));
+
+	return error;
+}
+
+// Unlike enumerate(), this function does not wait for ATAPI drives to spin up.
+// This allows the caller to poll() multiple drives for readiness concurrently.
+DeviceError Device::detect(bool resetBus) {
+	flags           &= DEVICE_PRIMARY | DEVICE_SECONDARY | DEVICE_IRQ;
+	multiSectorCount = 0;
+
+#ifdef ENABLE_FULL_IDE_DRIVER
+	invalidateCache();
+#endif
 
-	auto error = _resetDrive();
+	auto error = _resetDrive(resetBus);
 
 	if (error)
 		return error;
@@ -636,9 +1141,9 @@ DeviceError Device::enumerate(void) {
 	if (signature == _ATAPI_SIGNATURE) {
 		flags |= DEVICE_ATAPI;
 
-		_write(CS0_COMMAND, ATA_IDENTIFY_PACKET);
+		_command(ATA_IDENTIFY_PACKET);
 	} else {
-		_write(CS0_COMMAND, ATA_IDENTIFY);
+		_command(ATA_IDENTIFY);
 	}
 
 	if (_waitForDRQ(_DETECT_TIMEOUT))
@@ -694,25 +1199,53 @@ DeviceError Device::enumerate(void) {
 
 	_write(CS0_FEATURES, FEATURE_TRANSFER_MODE);
 	_write(CS0_COUNT,    TRANSFER_MODE_PIO | mode);
-	_write(CS0_COMMAND,  ATA_SET_FEATURES);
+	_command(ATA_SET_FEATURES);
 
 	error = _waitForIdle();
 
 	if (error)
 		return error;
 
-	LOG_IDE("drive %d ready, mode=PIO%d", getDriveIndex(), mode);
-	flags |= DEVICE_READY;
+#ifdef ENABLE_FULL_IDE_DRIVER
+	// Enable the fastest multiword DMA mode supported, if any. PIO will still
+	// be used for unaligned buffers and whenever a DMA transfer fails.
+	int dmaMode = block.getHighestDMAMode();
 
-	// Make sure any pending ATAPI sense data is cleared.
-	do {
-		error = poll();
-	} while ((error == ide::NOT_YET_READY) || (error == ide::DISC_CHANGED));
+	if (dmaMode >= 0) {
+		_write(CS0_FEATURES, FEATURE_TRANSFER_MODE);
+		_write(CS0_COUNT,    TRANSFER_MODE_DMA | dmaMode);
+		_command(ATA_SET_FEATURES);
 
-	return error;
+		if (!_waitForIdle()) {
+			flags |= DEVICE_DMA;
+
+			LOG_IDE("drive %d: MWDMA%d enabled", getDriveIndex(), dmaMode);
+		}
+	}
+#endif
+
+	// Enable multiple mode on ATA drives using the largest block size they
+	// support. Failing to do so is not fatal, as transfers will simply fall
+	// back to one sector per DRQ block.
+	int count = block.getHighestMultiSectorCount();
+
+	if (!(flags & DEVICE_ATAPI) && count) {
+		_write(CS0_COUNT,   count);
+		_command(ATA_SET_MULTIPLE_MODE);
+
+		if (!_waitForIdle())
+			multiSectorCount = count;
+	}
+
+	LOG_IDE(
+		"drive %d ready, mode=PIO%d, multi=%d", getDriveIndex(), mode,
+		multiSectorCount
+	);
+	flags |= DEVICE_READY;
+	return NO_ERROR;
 }
 
-DeviceError Device::poll(void) {
+DeviceError Device::poll(bool wait) {
 	if (!(flags & DEVICE_READY))
 		return NO_DRIVE;
 
@@ -720,27 +1253,40 @@ DeviceError Device::poll(void) {
 		Packet packet;
 
 		packet.setTestUnitReady();
-		return _atapiPacket(packet);
+		return _atapiPacket(packet, 0, false, wait);
 	} else {
 		_select(CS0_DEVICE_SEL_LBA);
 		return _waitForIdle(true);
 	}
 }
 
+// Transfers are always synchronous. The driver has no command state machine
+// that could run queued requests in the background, so callers can only
+// overlap drive latency with other work by setting DEVICE_IRQ, which lets the
+// main thread run while a worker is waiting for the drive.
 DeviceError Device::readData(void *data, uint64_t lba, size_t count) {
 	util::assertAligned<uint32_t>(data);
 
 	if (!(flags & DEVICE_READY))
 		return NO_DRIVE;
 
-	if (flags & DEVICE_ATAPI)
+	if (flags & DEVICE_ATAPI) {
+#ifdef ENABLE_FULL_IDE_DRIVER
+		if (_cacheLength)
+			return _atapiCachedRead(
+				reinterpret_cast<uintptr_t>(data), static_cast<uint32_t>(lba),
+				count
+			);
+#endif
+
 		return _atapiRead(
 			reinterpret_cast<uintptr_t>(data), static_cast<uint32_t>(lba), count
 		);
-	else
+	} else {
 		return _ataTransfer(
 			reinterpret_cast<uintptr_t>(data), lba, count, false
 		);
+	}
 }
 
 DeviceError Device::writeData(const void *data, uint64_t lba, size_t count) {
@@ -767,7 +1313,7 @@ DeviceError Device::goIdle(bool standby) {
 	if (error)
 		return error;
 
-	_write(CS0_COMMAND, standby ? ATA_STANDBY_IMMEDIATE : ATA_IDLE_IMMEDIATE);
+	_command(standby ? ATA_STANDBY_IMMEDIATE : ATA_IDLE_IMMEDIATE);
 	return _waitForIdle();
 }
 
@@ -777,6 +1323,10 @@ DeviceError Device::startStopUnit(ATAPIStartStopMode mode) {
 	if (!(flags & DEVICE_ATAPI))
 		return UNSUPPORTED_OP;
 
+#ifdef ENABLE_FULL_IDE_DRIVER
+	invalidateCache();
+#endif
+
 	Packet packet;
 
 	packet.setStartStopUnit(mode);
@@ -800,11 +1350,172 @@ DeviceError Device::flushCache(void) {
 	if (error)
 		return error;
 
-	_write(
-		CS0_COMMAND,
+	_command(
 		(flags & DEVICE_HAS_LBA48) ? ATA_FLUSH_CACHE_EXT : ATA_FLUSH_CACHE
 	);
 	return _waitForIdle();
 }
 
+#ifdef ENABLE_FULL_IDE_DRIVER
+bool Device::setReadaheadLength(size_t numSectors) {
+	invalidateCache();
+	util::clear(cacheStats);
+
+	if (!numSectors) {
+		_cache.destroy();
+		_cacheLength = 0;
+		return true;
+	}
+
+	if (!_cache.allocate(numSectors * ATAPI_SECTOR_SIZE)) {
+		_cacheLength = 0;
+		return false;
+	}
+
+	_cacheLength = numSectors;
+	return true;
+}
+
+void Device::invalidateCache(void) {
+	_cacheLBA      = 0;
+	_nextLBA       = 0;
+	_cachedSectors = 0;
+}
+
+// SET CD SPEED takes a speed in KB/s, with 0xffff selecting the highest speed
+// supported by the drive. Standby timer values in the 1-240 range are
+// multiples of 5 seconds, while 0 disables the timer.
+static constexpr uint16_t _PERFORMANCE_CD_SPEED = 0xffff;
+static constexpr uint8_t  _QUIET_STANDBY_TIMER  = 120; // 10 minutes
+
+DeviceError Device::setProfile(DriveProfile profile) {
+	if (!(flags & DEVICE_READY))
+		return NO_DRIVE;
+
+	bool fast = (profile == PROFILE_PERFORMANCE);
+
+	// Both SET CD SPEED and the IDLE command's standby timer are optional, so
+	// drives rejecting them are not considered to have failed. The read speed
+	// is never capped, as the quiet profile is also used while browsing files
+	// and running workers that do not switch profiles.
+	if ((flags & DEVICE_ATAPI) && fast) {
+		Packet packet;
+
+		packet.setSetCDSpeed(_PERFORMANCE_CD_SPEED);
+
+		auto error = _atapiPacket(packet);
+
+		if (error && (error != UNSUPPORTED_OP) && (error != DRIVE_ERROR))
+			return error;
+	}
+
+	_select(0);
+
+	auto error = _waitForIdle(false, 0, true);
+
+	if (error)
+		return error;
+
+	_write(CS0_COUNT, fast ? 0 : _QUIET_STANDBY_TIMER);
+	_command(ATA_IDLE);
+
+	error = _waitForIdle();
+
+	if ((error == DRIVE_ERROR) && (lastErrorReg & CS0_ERROR_ABRT))
+		error = NO_ERROR;
+
+	LOG_IDE("drive %d: profile=%d", getDriveIndex(), profile);
+	return error;
+}
+
+void Device::resetStats(void) {
+	util::clear(cacheStats);
+	util::clear(stats);
+}
+
+static size_t _formatHistogram(
+	char *output, size_t length, const char *name, const uint32_t *histogram
+) {
+	size_t offset = 0;
+
+	for (int i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+		if (!histogram[i] || (offset >= length))
+			continue;
+
+		offset += snprintf(
+			&output[offset], length - offset, "%s <%u us: %u\n", name, 1u << i,
+			histogram[i]
+		);
+	}
+
+	return offset;
+}
+
+// Generates a human-readable summary of all counters, one per line. Counters
+// that are zero are omitted in order to keep the output short.
+size_t Device::formatStats(char *output, size_t length) const {
+	size_t offset = snprintf(
+		output, length,
+		"drive %d\nread: %llu bytes\nwritten: %llu bytes\n"
+		"retries: %u\nerrors: %u\ntimeouts: %u\n"
+		"cache: %u hits, %u misses, %u prefetches\n",
+		getDriveIndex(), (unsigned long long) stats.bytesRead,
+		(unsigned long long) stats.bytesWritten, stats.retries, stats.errors,
+		stats.timeouts, cacheStats.hits, cacheStats.misses,
+		cacheStats.prefetches
+	);
+
+	for (int i = 0; i < 256; i++) {
+		if (stats.commands[i] && (offset < length))
+			offset += snprintf(
+				&output[offset], length - offset, "cmd 0x%02x: %u\n", i,
+				stats.commands[i]
+			);
+	}
+	for (int i = 0; i < 256; i++) {
+		if (stats.packets[i] && (offset < length))
+			offset += snprintf(
+				&output[offset], length - offset, "packet 0x%02x: %u\n", i,
+				stats.packets[i]
+			);
+	}
+	for (int i = 0; i < 16; i++) {
+		if (stats.senseKeys[i] && (offset < length))
+			offset += snprintf(
+				&output[offset], length - offset, "sense %s: %u\n",
+				_SENSE_KEY_NAMES[i], stats.senseKeys[i]
+			);
+	}
+
+	if (offset < length)
+		offset += _formatHistogram(
+			&output[offset], length - offset, "idle", stats.idleLatency
+		);
+	if (offset < length)
+		offset += _formatHistogram(
+			&output[offset], length - offset, "drq", stats.drqLatency
+		);
+
+	return util::min(offset, length ? (length - 1) : 0);
+}
+
+void Device::logStats(void) const {
+	char buffer[4096];
+
+	formatStats(buffer, sizeof(buffer));
+
+	for (char *line = buffer; *line;) {
+		char *end = strchr(line, '\n');
+
+		if (end)
+			*(end++) = 0;
+		else
+			end = line + strlen(line);
+
+		LOG_IDE("%s", line);
+		line = end;
+	}
+}
+#endif
+
 }
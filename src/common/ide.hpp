@@ -61,7 +61,8 @@ public:
 	uint16_t _reserved2[3];
 	uint16_t revision[4];           // 23-26
 	uint16_t model[20];             // 27-46
-	uint16_t _reserved3[2];
+	uint16_t maxMultiSectorCount;   // 47
+	uint16_t _reserved3;
 	uint16_t capabilities;          // 49
 	uint16_t _reserved4[3];
 	uint16_t timingValidityFlags;   // 53
@@ -111,6 +112,8 @@ public:
 
 	bool validateChecksum(void) const;
 	int getHighestPIOMode(void) const;
+	int getHighestMultiSectorCount(void) const;
+	int getHighestDMAMode(void) const;
 };
 
 /* ATAPI data structures */
@@ -199,6 +202,26 @@ public:
 
 /* Device class */
 
+struct ReadaheadStats {
+public:
+	uint32_t hits, misses, prefetches;
+};
+
+#ifdef ENABLE_FULL_IDE_DRIVER
+// Each latency bucket holds the number of waits that took less than 2^N
+// microseconds (with the last one also counting any longer wait).
+static constexpr int NUM_LATENCY_BUCKETS = 26;
+
+struct DeviceStats {
+public:
+	uint32_t commands[256], packets[256];
+	uint64_t bytesRead, bytesWritten;
+	uint32_t retries, errors, timeouts;
+	uint32_t senseKeys[16];
+	uint32_t idleLatency[NUM_LATENCY_BUCKETS], drqLatency[NUM_LATENCY_BUCKETS];
+};
+#endif
+
 enum DeviceError {
 	NO_ERROR          = 0,
 	UNSUPPORTED_OP    = 1,
@@ -221,9 +244,18 @@ enum DeviceFlag {
 	DEVICE_HAS_TRIM     = 1 << 5, // Device supports TRIM/sector erasing
 	DEVICE_HAS_FLUSH    = 1 << 6, // Device supports cache flushing
 	DEVICE_HAS_LBA48    = 1 << 7, // Device supports 48-bit LBA addressing
-	DEVICE_HAS_PACKET16 = 1 << 8  // Device requires 16-byte ATAPI packets
+	DEVICE_HAS_PACKET16 = 1 << 8, // Device requires 16-byte ATAPI packets
+	DEVICE_DMA          = 1 << 9, // Multiword DMA transfers are enabled
+	DEVICE_IRQ          = 1 << 10 // Yield and wait for IRQ rather than polling
 };
 
+#ifdef ENABLE_FULL_IDE_DRIVER
+enum DriveProfile {
+	PROFILE_QUIET       = 0, // Default rotation speed, spin down after a while
+	PROFILE_PERFORMANCE = 1  // Highest rotation speed, never spin down
+};
+#endif
+
 class Device {
 private:
 	inline uint8_t _read(CS0Register reg) const {
@@ -239,6 +271,7 @@ private:
 		SYS573_IDE_CS1_BASE[reg] = value;
 	}
 
+	void _command(uint8_t command);
 	inline void _select(uint8_t selFlags) const {
 		if (flags & DEVICE_SECONDARY)
 			_write(CS0_DEVICE_SEL, selFlags | CS0_DEVICE_SEL_SECONDARY);
@@ -258,30 +291,50 @@ private:
 	bool _readDMA(void *data, size_t length) const;
 	bool _writeDMA(const void *data, size_t length) const;
 
+	int _waitForStatusChange(int elapsed);
 	DeviceError _waitForIdle(
 		bool drdy = false, int timeout = 0, bool ignoreError = false
 	);
 	DeviceError _waitForDRQ(int timeout = 0, bool ignoreError = false);
 	void _handleError(void);
 	void _handleTimeout(void);
-	DeviceError _resetDrive(void);
+	DeviceError _resetDrive(bool resetBus = true);
 
 	DeviceError _ataSetLBA(uint64_t lba, size_t count, int timeout = 0);
+	DeviceError _ataTransferDMA(
+		uintptr_t ptr, uint64_t lba, size_t count, bool write
+	);
 	DeviceError _ataTransfer(
 		uintptr_t ptr, uint64_t lba, size_t count, bool write
 	);
 
 	DeviceError _atapiRequestSense(void);
-	DeviceError _atapiPacket(const Packet &packet, size_t dataLength = 0);
+	DeviceError _atapiPacket(
+		const Packet &packet, size_t dataLength = 0, bool dma = false,
+		bool wait = true
+	);
+	DeviceError _atapiReadDMA(uintptr_t ptr, uint32_t lba, size_t count);
 	DeviceError _atapiRead(uintptr_t ptr, uint32_t lba, size_t count);
 
+#ifdef ENABLE_FULL_IDE_DRIVER
+	util::Data _cache;
+	uint32_t   _cacheLBA, _nextLBA;
+	size_t     _cacheLength, _cachedSectors;
+
+	DeviceError _atapiCachedRead(uintptr_t ptr, uint32_t lba, size_t count);
+#endif
+
 public:
 	uint32_t flags;
 
 #ifdef ENABLE_FULL_IDE_DRIVER
-	char     model[41], revision[9], serialNumber[21];
+	char           model[41], revision[9], serialNumber[21];
+	ReadaheadStats cacheStats;
+	DeviceStats    stats;
+	uint32_t       discChangeCount;
 #endif
 	uint64_t capacity;
+	size_t   multiSectorCount;
 
 	uint8_t   lastStatusReg, lastErrorReg, lastCountReg;
 	SenseData lastSenseData;
@@ -307,19 +360,36 @@ public:
 
 	Device(uint32_t flags);
 	DeviceError enumerate(void);
-	DeviceError poll(void);
+	DeviceError detect(bool resetBus = true);
+	DeviceError poll(bool wait = true);
 
 	DeviceError readData(void *data, uint64_t lba, size_t count);
 	DeviceError writeData(const void *data, uint64_t lba, size_t count);
 	DeviceError goIdle(bool standby = false);
 	DeviceError startStopUnit(ATAPIStartStopMode mode);
 	DeviceError flushCache(void);
+
+#ifdef ENABLE_FULL_IDE_DRIVER
+	bool setReadaheadLength(size_t numSectors);
+	void invalidateCache(void);
+
+	DeviceError setProfile(DriveProfile profile);
+
+	void resetStats(void);
+	size_t formatStats(char *output, size_t length) const;
+	void logStats(void) const;
+#endif
 };
 
 extern const char *const DEVICE_ERROR_NAMES[];
 
 extern Device devices[2];
 
+#ifdef ENABLE_FULL_IDE_DRIVER
+void handleInterrupt(void);
+bool isInterruptPending(void);
+#endif
+
 static inline const char *getErrorString(DeviceError error) {
 	return DEVICE_ERROR_NAMES[error];
 }
@@ -51,6 +51,14 @@ enum CS0StatusFlag : uint8_t {
 	CS0_STATUS_BSY  = 1 << 7  // Busy
 };
 
+enum CS0ErrorFlag : uint8_t {
+	CS0_ERROR_AMNF = 1 << 0, // Address mark not found (ATA)
+	CS0_ERROR_ABRT = 1 << 2, // Command aborted
+	CS0_ERROR_IDNF = 1 << 4, // ID not found (ATA)
+	CS0_ERROR_UNC  = 1 << 6, // Uncorrectable data error (ATA)
+	CS0_ERROR_ICRC = 1 << 7  // Interface CRC error (ATA)
+};
+
 enum CS0DeviceSelectFlag : uint8_t {
 	CS0_DEVICE_SEL_PRIMARY   = 10 << 4,
 	CS0_DEVICE_SEL_SECONDARY = 11 << 4,
@@ -83,10 +91,12 @@ enum ATACommand : uint8_t {
 	ATA_READ_SECTORS_EXT     = 0x24, // ATA
 	ATA_READ_DMA_EXT         = 0x25, // ATA
 	ATA_READ_DMA_QUEUED_EXT  = 0x26, // ATA
+	ATA_READ_MULTIPLE_EXT    = 0x29, // ATA
 	ATA_WRITE_SECTORS        = 0x30, // ATA
 	ATA_WRITE_SECTORS_EXT    = 0x34, // ATA
 	ATA_WRITE_DMA_EXT        = 0x35, // ATA
 	ATA_WRITE_DMA_QUEUED_EXT = 0x36, // ATA
+	ATA_WRITE_MULTIPLE_EXT   = 0x39, // ATA
 	ATA_SEEK                 = 0x70, // ATA
 	ATA_EXECUTE_DIAGNOSTIC   = 0x90, // ATA/ATAPI
 	ATA_PACKET               = 0xa0, // ATAPI
@@ -94,6 +104,9 @@ enum ATACommand : uint8_t {
 	ATA_SERVICE              = 0xa2, // ATA/ATAPI
 	ATA_DEVICE_CONFIG        = 0xb1, // ATA
 	ATA_ERASE_SECTORS        = 0xc0, // ATA
+	ATA_READ_MULTIPLE        = 0xc4, // ATA
+	ATA_WRITE_MULTIPLE       = 0xc5, // ATA
+	ATA_SET_MULTIPLE_MODE    = 0xc6, // ATA
 	ATA_READ_DMA_QUEUED      = 0xc7, // ATA
 	ATA_READ_DMA             = 0xc8, // ATA
 	ATA_WRITE_DMA            = 0xca, // ATA
@@ -42,7 +42,7 @@ void init(void) {
 	// transfer. It does not affect non-DMA access since the BIU will replace
 	// the bottommost N bits, where N is the number of address lines used, with
 	// the respective CPU address bits.
-	BIU_DEV0_ADDR = reinterpret_cast<uint32_t>(SYS573_IDE_CS0_BASE) & 0x1fffffff;
+	BIU_DEV0_ADDR = uintptr_t(SYS573_IDE_CS0_BASE) & 0x1fffffff;
 	BIU_DEV0_CTRL = 0
 		| (7 << 0) // Write delay
 		| (4 << 4) // Read delay
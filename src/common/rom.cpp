@@ -29,7 +29,7 @@ namespace rom {
 
 // TODO: implement bounds checks in these
 
-uint16_t *Region::getRawPtr(uint32_t offset, bool alignToChip) const {
+RawPtr Region::getRawPtr(uint32_t offset, bool alignToChip) const {
 #if 0
 	if (bank >= 0)
 		io::setFlashBank(bank);
@@ -37,7 +37,7 @@ uint16_t *Region::getRawPtr(uint32_t offset, bool alignToChip) const {
 	if (alignToChip)
 		offset = 0;
 
-	auto dest = reinterpret_cast<uint16_t *>(ptr + offset);
+	auto dest = reinterpret_cast<RawPtr>(ptr + offset);
 
 	util::assertAligned<uint16_t>(dest);
 
@@ -143,7 +143,7 @@ bool FlashRegion::isPresent(void) const {
 	return false;
 }
 
-uint16_t *FlashRegion::getRawPtr(uint32_t offset, bool alignToChip) const {
+RawPtr FlashRegion::getRawPtr(uint32_t offset, bool alignToChip) const {
 	// The internal flash and PCMCIA cards can only be accessed 4 MB at a time.
 	int bankOffset = offset / FLASH_BANK_LENGTH;
 	int ptrOffset  = offset % FLASH_BANK_LENGTH;
@@ -151,7 +151,7 @@ uint16_t *FlashRegion::getRawPtr(uint32_t offset, bool alignToChip) const {
 	if (alignToChip)
 		ptrOffset = 0;
 
-	auto dest = reinterpret_cast<uint16_t *>(ptr + ptrOffset);
+	auto dest = &SYS573_FLASH_BASE[ptrOffset / 2];
 
 	util::assertAligned<uint16_t>(dest);
 	io::setFlashBank(bank + bankOffset);
@@ -160,40 +160,54 @@ uint16_t *FlashRegion::getRawPtr(uint32_t offset, bool alignToChip) const {
 }
 
 void FlashRegion::read(void *data, uint32_t offset, size_t length) const {
-	// FIXME: this implementation will not handle unaligned reads and reads that
-	// cross bank boundaries properly
-	auto bankOffset = offset / FLASH_BANK_LENGTH;
-	auto ptrOffset  = offset % FLASH_BANK_LENGTH;
+	// FIXME: this implementation will not handle unaligned reads properly
+	auto              dest = reinterpret_cast<uint16_t *>(data);
+	FlashBankIterator iterator(*this, offset, length);
 
-	io::setFlashBank(bank + bankOffset);
-	Region::read(data, ptrOffset, length);
+	util::assertAligned<uint16_t>(dest);
+
+	// The flash window is on a 16-bit bus, so 16-bit loads take as many bus
+	// cycles as 32-bit ones (which the BIU splits in two anyway).
+	while (iterator.next()) {
+		auto   source    = &SYS573_FLASH_BASE[iterator.ptrOffset / 2];
+		size_t remaining = iterator.length;
+
+		for (; remaining >= 16; remaining -= 16, dest += 8, source += 8) {
+			dest[0] = source[0];
+			dest[1] = source[1];
+			dest[2] = source[2];
+			dest[3] = source[3];
+			dest[4] = source[4];
+			dest[5] = source[5];
+			dest[6] = source[6];
+			dest[7] = source[7];
+		}
+
+		for (; remaining; remaining -= 2)
+			*(dest++) = *(source++);
+	}
 }
 
 uint32_t FlashRegion::zipCRC32(
 	uint32_t offset, size_t length, uint32_t crc
 ) const {
-	// FIXME: this implementation will not handle unaligned reads and reads that
-	// cross bank boundaries properly
-	auto bankOffset = offset / FLASH_BANK_LENGTH;
-	auto ptrOffset  = offset % FLASH_BANK_LENGTH;
+	// FIXME: this implementation will not handle unaligned reads properly
+	auto              table = reinterpret_cast<const uint32_t *>(CACHE_BASE);
+	FlashBankIterator iterator(*this, offset, length);
 
-	auto source = reinterpret_cast<const uint32_t *>(ptr + ptrOffset);
-	auto table  = reinterpret_cast<const uint32_t *>(CACHE_BASE);
-	crc         = ~crc;
+	crc = ~crc;
 
-	util::assertAligned<uint32_t>(source);
-	io::setFlashBank(bank + bankOffset);
+	while (iterator.next()) {
+		auto   source    = &SYS573_FLASH_BASE[iterator.ptrOffset / 2];
+		size_t remaining = iterator.length;
 
-	for (; length; length -= 4) {
-		uint32_t data = *(source++);
+		for (; remaining; remaining -= 2) {
+			uint32_t data = *(source++);
 
-		crc    = (crc >> 8) ^ table[(crc ^ data) & 0xff];
-		data >>= 8;
-		crc    = (crc >> 8) ^ table[(crc ^ data) & 0xff];
-		data >>= 8;
-		crc    = (crc >> 8) ^ table[(crc ^ data) & 0xff];
-		data >>= 8;
-		crc    = (crc >> 8) ^ table[(crc ^ data) & 0xff];
+			crc    = (crc >> 8) ^ table[(crc ^ data) & 0xff];
+			data >>= 8;
+			crc    = (crc >> 8) ^ table[(crc ^ data) & 0xff];
+		}
 	}
 
 	return ~crc;
@@ -252,7 +266,7 @@ const util::ExecutableHeader *FlashRegion::getBootExecutableHeader(void) const {
 uint32_t FlashRegion::getJEDECID(void) const {
 	io::setFlashBank(bank);
 
-	auto _ptr = reinterpret_cast<volatile uint16_t *>(ptr);
+	auto _ptr = SYS573_FLASH_BASE;
 
 	_ptr[0x000] = JEDEC_RESET;
 	_ptr[0x000] = INTEL_RESET;
@@ -284,7 +298,7 @@ size_t FlashRegion::getActualLength(void) const {
 	// wrapped around.
 	io::setFlashBank(bank);
 
-	auto _ptr = reinterpret_cast<volatile uint16_t *>(ptr);
+	auto _ptr = SYS573_FLASH_BASE;
 
 	_ptr[0x000] = JEDEC_RESET;
 	_ptr[0x000] = INTEL_RESET;
@@ -380,6 +394,21 @@ Driver *FlashRegion::newDriver(void) const {
 	return new Driver(*this);
 }
 
+bool FlashBankIterator::next(void) {
+	if (!_remaining)
+		return false;
+
+	auto bankOffset = _offset / FLASH_BANK_LENGTH;
+	ptrOffset       = _offset % FLASH_BANK_LENGTH;
+	length          = util::min(_remaining, FLASH_BANK_LENGTH - ptrOffset);
+
+	io::setFlashBank(_region.bank + bankOffset);
+
+	_offset    += length;
+	_remaining -= length;
+	return true;
+}
+
 const BIOSRegion  bios;
 const RTCRegion   rtc;
 const FlashRegion flash(0x1000000, SYS573_BANK_FLASH);
@@ -20,11 +20,17 @@
 #include <stdint.h>
 #include "common/util.hpp"
 #include "ps1/registers.h"
+#include "ps1/registers573.h"
 
 namespace rom {
 
 /* ROM region dumpers */
 
+// Pointer to a 16-bit location within the flash and PCMCIA card window. This
+// is a plain volatile pointer on the 573, but host builds replace the window
+// with an array of proxy objects (see host/ps1/registers573.h).
+using RawPtr = decltype(&SYS573_FLASH_BASE[0]);
+
 static constexpr size_t   FLASH_BANK_LENGTH       = 0x400000;
 static constexpr uint32_t FLASH_HEADER_OFFSET     = 0x00;
 static constexpr uint32_t FLASH_CRC_OFFSET        = 0x20;
@@ -45,7 +51,7 @@ public:
 		return true;
 	}
 
-	virtual uint16_t *getRawPtr(uint32_t offset, bool alignToChip = false) const;
+	virtual RawPtr getRawPtr(uint32_t offset, bool alignToChip = false) const;
 	virtual void read(void *data, uint32_t offset, size_t length) const;
 	virtual uint32_t zipCRC32(
 		uint32_t offset, size_t length, uint32_t crc = 0
@@ -92,7 +98,7 @@ public:
 
 	bool isPresent(void) const;
 
-	uint16_t *getRawPtr(uint32_t offset, bool alignToChip = false) const;
+	RawPtr getRawPtr(uint32_t offset, bool alignToChip = false) const;
 	void read(void *data, uint32_t offset, size_t length) const;
 	uint32_t zipCRC32(uint32_t offset, size_t length, uint32_t crc = 0) const;
 
@@ -102,6 +108,25 @@ public:
 	Driver *newDriver(void) const;
 };
 
+// Splits a span of a flash region into chunks that do not cross bank
+// boundaries, switching to the appropriate bank once per chunk.
+class FlashBankIterator {
+private:
+	const FlashRegion &_region;
+	uint32_t          _offset;
+	size_t            _remaining;
+
+public:
+	size_t ptrOffset, length;
+
+	inline FlashBankIterator(
+		const FlashRegion &region, uint32_t offset, size_t length
+	) : _region(region), _offset(offset), _remaining(length), ptrOffset(0),
+	length(0) {}
+
+	bool next(void);
+};
+
 extern const BIOSRegion  bios;
 extern const RTCRegion   rtc;
 extern const FlashRegion flash, pcmcia[2];
@@ -23,8 +23,9 @@ namespace rom {
 
 /* Data common to all chip drivers */
 
-static constexpr int _FLASH_WRITE_TIMEOUT = 10000000;
-static constexpr int _FLASH_ERASE_TIMEOUT = 20000000;
+static constexpr int _FLASH_WRITE_TIMEOUT  = 10000000;
+static constexpr int _FLASH_ERASE_TIMEOUT  = 20000000;
+static constexpr int _FLASH_BUFFER_TIMEOUT = 1000000;
 
 const char *const DRIVER_ERROR_NAMES[]{
 	"NO_ERROR",
@@ -107,7 +108,7 @@ const ChipSize &RTCDriver::getChipSize(void) const {
 DriverError AM29F016Driver::_flush(
 	uint32_t offset, uint16_t value, int timeout
 ) {
-	volatile uint16_t *ptr = _region.getRawPtr(offset & ~1);
+	RawPtr ptr = _region.getRawPtr(offset & ~1);
 
 	int     shift = (offset & 1) * 8;
 	uint8_t byte  = (value >> shift) & 0xff;
@@ -131,6 +132,9 @@ DriverError AM29F016Driver::_flush(
 	if (!(diff & JEDEC_STATUS_POLL_BIT))
 		return NO_ERROR;
 
+	// Make sure the chip is taken out of unlock bypass mode, as the reset
+	// command alone is not guaranteed to do so.
+	exitBulkWrite(offset & ~1);
 	*ptr = JEDEC_RESET;
 
 	if (status & JEDEC_STATUS_ERROR) {
@@ -142,9 +146,74 @@ DriverError AM29F016Driver::_flush(
 	}
 }
 
+void AM29F016Driver::_exitAllBulkWrites(void) {
+	for (
+		uint32_t offset = 0; _bypassChips && (offset < _region.regionLength);
+		offset += _chipLength
+	)
+		exitBulkWrite(offset);
+}
+
+bool AM29F016Driver::_bypassWrite(uint32_t offset, uint16_t value) {
+	auto bit = _getChipBit(offset);
+
+	if (!(_bypassChips & bit))
+		return false;
+
+	RawPtr ptr = _region.getRawPtr(offset);
+
+	// Until the chip is known to support unlock bypass, values that are
+	// already present are not written at all, as reading them back would
+	// otherwise be mistaken for a successful bypass mode write.
+	if ((_unverifiedChips & bit) && (*ptr == value)) {
+		_skippedChips |= bit;
+		return true;
+	}
+
+	// In unlock bypass mode the handshake is omitted and the write command can
+	// be issued at any address within the chip.
+	*ptr = JEDEC_WRITE_BYTE;
+	*ptr = value;
+	return true;
+}
+
+// Not all chips handled by this driver implement unlock bypass. If a chip
+// ignored the command, the first bypass mode write will be ignored as well; in
+// that case bulk write mode is disabled and the write is reissued normally.
+bool AM29F016Driver::_verifyBypass(uint32_t offset, uint16_t value) {
+	RawPtr ptr = _region.getRawPtr(offset);
+
+	uint16_t status1 = *ptr;
+	uint16_t status2 = *ptr;
+	uint16_t toggle  = JEDEC_STATUS_TOGGLE | (JEDEC_STATUS_TOGGLE << 8);
+
+	// A toggling status bit means the chip is busy programming, while reading
+	// back the new value means the write has already completed (values that
+	// were already present are never written, see _bypassWrite()).
+	if ((status2 == value) || ((status1 ^ status2) & toggle)) {
+		_unverifiedChips &= ~_getChipBit(offset);
+		return true;
+	}
+
+	LOG_ROM("bypass ignored, ptr=0x%06x, st=0x%04x", offset, status2);
+
+	// Other chips are left in bypass mode (if any), as they will go through
+	// the same check once flushed.
+	exitBulkWrite(offset);
+	_bypassUnsupported = true;
+	return false;
+}
+
+AM29F016Driver::~AM29F016Driver(void) {
+	_exitAllBulkWrites();
+}
+
 void AM29F016Driver::write(uint32_t offset, uint16_t value) {
-	volatile uint16_t *ptr = _region.getRawPtr(offset, true);
-	offset                 = (offset % FLASH_BANK_LENGTH) / 2;
+	if (_bypassWrite(offset, value))
+		return;
+
+	RawPtr ptr = _getChipPtr(offset);
+	offset     = (offset % _chipLength) / 2;
 
 	ptr[0x000]  = JEDEC_RESET;
 	ptr[0x555]  = JEDEC_HANDSHAKE1;
@@ -154,8 +223,8 @@ void AM29F016Driver::write(uint32_t offset, uint16_t value) {
 }
 
 void AM29F016Driver::eraseSector(uint32_t offset) {
-	volatile uint16_t *ptr = _region.getRawPtr(offset, true);
-	offset                 = (offset % FLASH_BANK_LENGTH) / 2;
+	RawPtr ptr = _getChipPtr(offset);
+	offset     = (offset % _chipLength) / 2;
 
 	ptr[0x000]  = JEDEC_RESET;
 	ptr[0x555]  = JEDEC_HANDSHAKE1;
@@ -167,7 +236,7 @@ void AM29F016Driver::eraseSector(uint32_t offset) {
 }
 
 void AM29F016Driver::eraseChip(uint32_t offset) {
-	volatile uint16_t *ptr = _region.getRawPtr(offset, true);
+	RawPtr ptr = _getChipPtr(offset);
 
 	ptr[0x000] = JEDEC_RESET;
 	ptr[0x555] = JEDEC_HANDSHAKE1;
@@ -181,6 +250,17 @@ void AM29F016Driver::eraseChip(uint32_t offset) {
 DriverError AM29F016Driver::flushWrite(
 	uint32_t offset, uint16_t value
 ) {
+	auto bit = _getChipBit(offset);
+
+	if (_skippedChips & bit) {
+		_skippedChips &= ~bit;
+		return NO_ERROR;
+	}
+	if (_unverifiedChips & bit) {
+		if (!_verifyBypass(offset, value))
+			write(offset, value);
+	}
+
 	auto error = _flush(offset, value, _FLASH_WRITE_TIMEOUT);
 
 	if (error)
@@ -202,14 +282,54 @@ const ChipSize &AM29F016Driver::getChipSize(void) const {
 	return _STANDARD_CHIP_SIZE;
 }
 
+void AM29F016Driver::enterBulkWrite(uint32_t offset) {
+	auto bit = _getChipBit(offset);
+
+	if (_bypassUnsupported || (_bypassChips & bit))
+		return;
+
+	RawPtr ptr = _getChipPtr(offset);
+
+	ptr[0x000] = JEDEC_RESET;
+	ptr[0x555] = JEDEC_HANDSHAKE1;
+	ptr[0x2aa] = JEDEC_HANDSHAKE2;
+	ptr[0x555] = JEDEC_UNLOCK_BYPASS;
+
+	_bypassChips     |= bit;
+	_unverifiedChips |= bit;
+}
+
+void AM29F016Driver::exitBulkWrite(uint32_t offset) {
+	auto bit = _getChipBit(offset);
+
+	if (!(_bypassChips & bit))
+		return;
+
+	// The unlock bypass reset command can be issued at any address within the
+	// chip.
+	RawPtr ptr = _getChipPtr(offset);
+
+	ptr[0x000] = JEDEC_BYPASS_RESET1;
+	ptr[0x000] = JEDEC_BYPASS_RESET2;
+	ptr[0x000] = JEDEC_RESET;
+
+	_bypassChips     &= ~bit;
+	_unverifiedChips &= ~bit;
+}
+
 /* AMD AM29F040 (Fujitsu MBM29F040A) driver */
 
 // Konami's drivers handle this chip pretty much identically to the MBM29F016A,
-// but using 0x5555/0x2aaa as command addresses instead of 0x555/0x2aa.
+// but using 0x5555/0x2aaa as command addresses instead of 0x555/0x2aa. As each
+// bank holds multiple chips, commands must be issued relative to the base of
+// the chip being accessed rather than to the base of the bank.
 
 void AM29F040Driver::write(uint32_t offset, uint16_t value) {
-	volatile uint16_t *ptr = _region.getRawPtr(offset, true);
-	offset                 = (offset % FLASH_BANK_LENGTH) / 2;
+	if (_bypassWrite(offset, value))
+		return;
+
+	RawPtr ptr = _getChipPtr(offset);
+	offset     = (offset % _chipLength) / 2;
 
 	ptr[0x0000] = JEDEC_RESET;
 	ptr[0x5555] = JEDEC_HANDSHAKE1;
@@ -219,8 +339,8 @@ void AM29F040Driver::write(uint32_t offset, uint16_t value) {
 }
 
 void AM29F040Driver::eraseSector(uint32_t offset) {
-	volatile uint16_t *ptr = _region.getRawPtr(offset, true);
-	offset                 = (offset % FLASH_BANK_LENGTH) / 2;
+	RawPtr ptr = _getChipPtr(offset);
+	offset     = (offset % _chipLength) / 2;
 
 	ptr[0x0000] = JEDEC_RESET;
 	ptr[0x5555] = JEDEC_HANDSHAKE1;
@@ -232,7 +352,7 @@ void AM29F040Driver::eraseSector(uint32_t offset) {
 }
 
 void AM29F040Driver::eraseChip(uint32_t offset) {
-	volatile uint16_t *ptr = _region.getRawPtr(offset, true);
+	RawPtr ptr = _getChipPtr(offset);
 
 	ptr[0x0005] = JEDEC_RESET;
 	ptr[0x5555] = JEDEC_HANDSHAKE1;
@@ -247,10 +367,27 @@ const ChipSize &AM29F040Driver::getChipSize(void) const {
 	return _ALT_CHIP_SIZE;
 }
 
+void AM29F040Driver::enterBulkWrite(uint32_t offset) {
+	auto bit = _getChipBit(offset);
+
+	if (_bypassUnsupported || (_bypassChips & bit))
+		return;
+
+	RawPtr ptr = _getChipPtr(offset);
+
+	ptr[0x0000] = JEDEC_RESET;
+	ptr[0x5555] = JEDEC_HANDSHAKE1;
+	ptr[0x2aaa] = JEDEC_HANDSHAKE2;
+	ptr[0x5555] = JEDEC_UNLOCK_BYPASS;
+
+	_bypassChips     |= bit;
+	_unverifiedChips |= bit;
+}
+
 /* Intel 28F016S5 (Sharp LH28F016S) driver */
 
 DriverError Intel28F016S5Driver::_flush(uint32_t offset, int timeout) {
-	volatile uint16_t *ptr  = _region.getRawPtr(offset & ~1);
+	RawPtr ptr = _region.getRawPtr(offset & ~1);
 
 	int     shift  = (offset & 1) * 8;
 	uint8_t status = 0;
@@ -289,7 +426,7 @@ DriverError Intel28F016S5Driver::_flush(uint32_t offset, int timeout) {
 }
 
 void Intel28F016S5Driver::write(uint32_t offset, uint16_t value) {
-	volatile uint16_t *ptr = _region.getRawPtr(offset);
+	RawPtr ptr = _region.getRawPtr(offset);
 
 	*ptr = INTEL_RESET;
 	*ptr = INTEL_CLEAR_STATUS;
@@ -298,7 +435,7 @@ void Intel28F016S5Driver::write(uint32_t offset, uint16_t value) {
 }
 
 void Intel28F016S5Driver::eraseSector(uint32_t offset) {
-	volatile uint16_t *ptr = _region.getRawPtr(offset);
+	RawPtr ptr = _region.getRawPtr(offset);
 
 	*ptr = INTEL_RESET;
 	*ptr = INTEL_ERASE_SECTOR1;
@@ -350,4 +487,53 @@ const ChipSize &Intel28F640J5Driver::getChipSize(void) const {
 	return _28F640J5_CHIP_SIZE;
 }
 
+// The 28F640J5 has a 32-byte write buffer, which can be filled and programmed
+// in a single operation taking roughly as long as a single halfword write.
+static constexpr size_t _28F640J5_BLOCK_LENGTH = 32;
+
+size_t Intel28F640J5Driver::getBlockLength(void) const {
+	return _28F640J5_BLOCK_LENGTH;
+}
+
+DriverError Intel28F640J5Driver::writeBlock(
+	uint32_t offset, const uint16_t *data, size_t length
+) {
+	RawPtr ptr = _region.getRawPtr(offset);
+
+	*ptr = INTEL_RESET;
+	*ptr = INTEL_CLEAR_STATUS;
+
+	// Request the write buffer, then wait until the extended status register
+	// (returned after the command is issued) reports that it is available.
+	int timeout = _FLASH_BUFFER_TIMEOUT;
+
+	for (;;) {
+		*ptr = INTEL_WRITE_BUFFER;
+
+		if (*ptr & INTEL_STATUS_WSMS)
+			break;
+
+		if (--timeout <= 0) {
+			*ptr = INTEL_RESET;
+
+			LOG_ROM("Intel buffer timeout, ptr=0x%06x", offset);
+			return CHIP_TIMEOUT;
+		}
+	}
+
+	size_t count = length / 2;
+
+	*ptr = count - 1;
+
+	for (size_t i = 0; i < count; i++)
+		ptr[i] = *(data++);
+
+	*ptr = INTEL_CONFIRM;
+	return NO_ERROR;
+}
+
+DriverError Intel28F640J5Driver::flushWriteBlock(uint32_t offset) {
+	return _flush(offset, _FLASH_WRITE_TIMEOUT);
+}
+
 }
@@ -32,7 +32,10 @@ enum JEDECCommand : uint16_t {
 	JEDEC_WRITE_BYTE      = 0xa0a0,
 	JEDEC_ERASE_HANDSHAKE = 0x8080,
 	JEDEC_ERASE_CHIP      = 0x1010,
-	JEDEC_ERASE_SECTOR    = 0x3030
+	JEDEC_ERASE_SECTOR    = 0x3030,
+	JEDEC_UNLOCK_BYPASS   = 0x2020,
+	JEDEC_BYPASS_RESET1   = 0x9090,
+	JEDEC_BYPASS_RESET2   = 0x0000
 };
 
 enum JEDECStatusFlag : uint16_t {
@@ -52,7 +55,9 @@ enum IntelCommand : uint16_t {
 	INTEL_GET_STATUS    = 0x7070,
 	INTEL_CLEAR_STATUS  = 0x5050,
 	INTEL_SUSPEND       = 0xb0b0,
-	INTEL_RESUME        = 0xd0d0
+	INTEL_RESUME        = 0xd0d0,
+	INTEL_WRITE_BUFFER  = 0xe8e8,
+	INTEL_CONFIRM       = 0xd0d0
 };
 
 enum IntelStatusFlag : uint16_t {
@@ -100,6 +105,27 @@ public:
 		return UNSUPPORTED_OP;
 	}
 	virtual const ChipSize &getChipSize(void) const;
+
+	// Chips with a write buffer can program up to getBlockLength() bytes at
+	// once using writeBlock() and flushWriteBlock(). Blocks must not cross a
+	// getBlockLength()-aligned boundary. Drivers for chips without a write
+	// buffer return zero and only support halfword writes.
+	virtual size_t getBlockLength(void) const { return 0; }
+	virtual DriverError writeBlock(
+		uint32_t offset, const uint16_t *data, size_t length
+	) {
+		return UNSUPPORTED_OP;
+	}
+	virtual DriverError flushWriteBlock(uint32_t offset) {
+		return UNSUPPORTED_OP;
+	}
+
+	// Bulk write mode reduces the number of bus cycles required by write() on
+	// chips that support it. It must be entered and exited separately for
+	// each chip (by passing any offset within the chip); deleting the driver
+	// exits it for all chips.
+	virtual void enterBulkWrite(uint32_t offset) {}
+	virtual void exitBulkWrite(uint32_t offset) {}
 };
 
 class RTCDriver : public Driver {
@@ -117,11 +143,31 @@ public:
 
 class AM29F016Driver : public Driver {
 protected:
+	// The chip length is cached rather than obtained through getChipSize(), as
+	// the destructor (which exits bulk write mode) cannot call virtual methods
+	// of subclasses.
+	size_t   _chipLength;
+	uint64_t _bypassChips, _unverifiedChips, _skippedChips;
+	bool     _bypassUnsupported;
+
+	inline uint64_t _getChipBit(uint32_t offset) const {
+		return uint64_t(1) << (offset / _chipLength);
+	}
+	inline RawPtr _getChipPtr(uint32_t offset) const {
+		return _region.getRawPtr(offset - (offset % _chipLength));
+	}
+
 	DriverError _flush(uint32_t offset, uint16_t value, int timeout);
+	void _exitAllBulkWrites(void);
+	bool _bypassWrite(uint32_t offset, uint16_t value);
+	bool _verifyBypass(uint32_t offset, uint16_t value);
 
 public:
 	inline AM29F016Driver(const FlashRegion &region)
-	: Driver(region) {}
+	: Driver(region), _chipLength(AM29F016Driver::getChipSize().chipLength),
+	_bypassChips(0), _unverifiedChips(0), _skippedChips(0),
+	_bypassUnsupported(false) {}
+	~AM29F016Driver(void);
 
 	virtual void write(uint32_t offset, uint16_t value);
 	virtual void eraseSector(uint32_t offset);
@@ -129,17 +175,24 @@ public:
 	DriverError flushWrite(uint32_t offset, uint16_t value);
 	DriverError flushErase(uint32_t offset);
 	const ChipSize &getChipSize(void) const;
+
+	virtual void enterBulkWrite(uint32_t offset);
+	void exitBulkWrite(uint32_t offset);
 };
 
 class AM29F040Driver : public AM29F016Driver {
 public:
 	inline AM29F040Driver(const FlashRegion &region)
-	: AM29F016Driver(region) {}
+	: AM29F016Driver(region) {
+		_chipLength = AM29F040Driver::getChipSize().chipLength;
+	}
 
 	void write(uint32_t offset, uint16_t value);
 	void eraseSector(uint32_t offset);
 	void eraseChip(uint32_t offset);
 	const ChipSize &getChipSize(void) const;
+
+	void enterBulkWrite(uint32_t offset);
 };
 
 class Intel28F016S5Driver : public Driver {
@@ -165,6 +218,12 @@ public:
 	DriverError flushWrite(uint32_t offset, uint16_t value);
 	DriverError flushErase(uint32_t offset);
 	const ChipSize &getChipSize(void) const;
+
+	size_t getBlockLength(void) const;
+	DriverError writeBlock(
+		uint32_t offset, const uint16_t *data, size_t length
+	);
+	DriverError flushWriteBlock(uint32_t offset);
 };
 
 extern const char *const DRIVER_ERROR_NAMES[];
@@ -0,0 +1,346 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common/file/file.hpp"
+#include "common/rom.hpp"
+#include "common/romdrivers.hpp"
+#include "common/romwriter.hpp"
+#include "common/util.hpp"
+
+namespace rom {
+
+/* Region erasing and restoring */
+
+static constexpr size_t _WRITE_CHUNK_LENGTH   = 0x80000;
+static constexpr size_t _COMPARE_CHUNK_LENGTH = 0x8000;
+
+RegionWriter::RegionWriter(
+	const Region &region, Driver &driver, size_t regionLength
+) : _region(region), _driver(driver), _regionLength(regionLength),
+callback(nullptr), callbackArg(nullptr), sectorsSkipped(0),
+sectorsProgrammed(0), sectorsErased(0), bytesWritten(0) {
+	_chipLength   = driver.getChipSize().chipLength;
+	_sectorLength = driver.getChipSize().eraseSectorLength;
+	_numChips     = _chipLength
+		? ((regionLength + _chipLength - 1) / _chipLength)
+		: 0;
+}
+
+void RegionWriter::_update(WriterStep step, size_t part) const {
+	if (callback)
+		callback(step, part, _chipLength, callbackArg);
+}
+
+SectorState RegionWriter::_compareSector(
+	file::File &file, uint32_t offset, size_t length, uint8_t *buffer
+) const {
+	auto fileData = reinterpret_cast<const uint32_t *>(buffer);
+	auto romData  = reinterpret_cast<const uint32_t *>(
+		&buffer[_COMPARE_CHUNK_LENGTH]
+	);
+	auto state    = SECTOR_MATCH;
+
+	file.seek(offset);
+
+	while (length) {
+		auto chunkLength = util::min(length, _COMPARE_CHUNK_LENGTH);
+		auto readLength  = file.read(buffer, chunkLength);
+
+		// Any data past the end of the file is expected to be erased.
+		__builtin_memset(&buffer[readLength], 0xff, chunkLength - readLength);
+		_region.read(&buffer[_COMPARE_CHUNK_LENGTH], offset, chunkLength);
+
+		for (size_t i = 0; i < chunkLength / 4; i++) {
+			auto expected = fileData[i];
+			auto actual   = romData[i];
+
+			if (expected == actual)
+				continue;
+			if (expected & ~actual)
+				return SECTOR_ERASE;
+
+			state = SECTOR_PROGRAM;
+		}
+
+		offset += chunkLength;
+		length -= chunkLength;
+	}
+
+	return state;
+}
+
+DriverError RegionWriter::erase(void) {
+	if (!_chipLength)
+		return UNSUPPORTED_OP;
+
+	// Parallelize erasing by sending the same sector erase command to all chips
+	// at the same time.
+	for (size_t i = 0; i < _chipLength; i += _sectorLength) {
+		_update(WRITER_ERASE, i);
+
+		for (size_t j = 0; j < _regionLength; j += _chipLength)
+			_driver.eraseSector(i + j);
+
+		for (size_t j = 0; j < _regionLength; j += _chipLength) {
+			auto error = _driver.flushErase(i + j);
+
+			if (error)
+				return error;
+
+			sectorsErased++;
+		}
+	}
+
+	return NO_ERROR;
+}
+
+DriverError RegionWriter::restore(file::File &file) {
+	if (!_chipLength)
+		return UNSUPPORTED_OP;
+
+	// Chunks must not span multiple sectors, so that the ones belonging to
+	// sectors that already match can be skipped. Half of the buffer is used to
+	// hold the current contents of each chunk. As the number of chips is not
+	// necessarily a power of two, the length is rounded down to one so that
+	// each sector is always split into a whole number of chunks.
+	size_t maxChunkLength = util::min(
+		_regionLength, _WRITE_CHUNK_LENGTH / _numChips / 2
+	);
+	maxChunkLength        = util::min(maxChunkLength, _sectorLength);
+	maxChunkLength        = 1 << (31 - __builtin_clz(maxChunkLength));
+
+	size_t blockLength = _driver.getBlockLength();
+	size_t step        = blockLength ? blockLength : 2;
+
+	LOG_ROM(
+		"%d chips, buf=%d, block=%d", _numChips, maxChunkLength, blockLength
+	);
+
+	util::Data buffers, chunkLengths, sectorStates;
+	DriverError error = NO_ERROR;
+
+	size_t currentOffset = maxChunkLength * _numChips;
+
+	buffers.allocate(
+		util::max(currentOffset * 2, _COMPARE_CHUNK_LENGTH * 2)
+	);
+	chunkLengths.allocate<size_t>(_numChips);
+	sectorStates.allocate<uint8_t>(
+		_numChips * ((_chipLength + _sectorLength - 1) / _sectorLength)
+	);
+
+	auto statePtr = sectorStates.as<uint8_t>();
+
+	for (size_t i = 0; i < _chipLength; i += _sectorLength) {
+		_update(WRITER_COMPARE, i);
+
+		for (
+			size_t offset = i; offset < (_numChips * _chipLength);
+			offset += _chipLength
+		) {
+			auto state = SECTOR_MATCH;
+
+			if (offset < _regionLength)
+				state = _compareSector(
+					file, offset,
+					util::min(_sectorLength, _regionLength - offset),
+					buffers.as<uint8_t>()
+				);
+
+			switch (state) {
+				case SECTOR_MATCH:
+					sectorsSkipped++;
+					break;
+
+				case SECTOR_PROGRAM:
+					sectorsProgrammed++;
+					break;
+
+				case SECTOR_ERASE:
+					sectorsErased++;
+					break;
+			}
+
+			*(statePtr++) = state;
+		}
+	}
+
+	LOG_ROM(
+		"skip=%d, program=%d, erase=%d", sectorsSkipped, sectorsProgrammed,
+		sectorsErased
+	);
+
+	// Parallelize erasing by sending the same sector erase command to all chips
+	// whose sectors need to be erased at the same time.
+	statePtr = sectorStates.as<uint8_t>();
+
+	for (
+		size_t i = 0; i < _chipLength;
+		i += _sectorLength, statePtr += _numChips
+	) {
+		_update(WRITER_ERASE, i);
+
+		for (size_t j = 0; j < _numChips; j++) {
+			if (statePtr[j] == SECTOR_ERASE)
+				_driver.eraseSector(i + j * _chipLength);
+		}
+
+		for (size_t j = 0; j < _numChips; j++) {
+			if (statePtr[j] != SECTOR_ERASE)
+				continue;
+
+			error = _driver.flushErase(i + j * _chipLength);
+
+			if (error)
+				return error;
+		}
+	}
+
+	// Skip the full command sequence for each write on chips that support it.
+	// Deleting the driver takes care of exiting bulk write mode on errors.
+	for (size_t i = 0; i < _regionLength; i += _chipLength)
+		_driver.enterBulkWrite(i);
+
+	// Parallelize writing by buffering a chunk for each chip into RAM, then
+	// writing all chunks to the respective chips at the same time.
+	for (size_t i = 0; i < _chipLength; i += maxChunkLength) {
+		// Stop once there is no more data to write.
+		if (i >= file.size)
+			break;
+
+		_update(WRITER_WRITE, i);
+
+		auto   bufferPtr   = buffers.as<uint8_t>();
+		auto   lengthPtr   = chunkLengths.as<size_t>();
+		size_t offset      = i;
+		size_t totalLength = 0;
+
+		statePtr = &sectorStates.as<uint8_t>()[(i / _sectorLength) * _numChips];
+
+		for (
+			size_t j = _numChips; j > 0; j--, bufferPtr += maxChunkLength,
+			offset += _chipLength
+		) {
+			if (*(statePtr++) == SECTOR_MATCH) {
+				*(lengthPtr++) = 0;
+				continue;
+			}
+
+			file.seek(offset);
+			auto length = file.read(bufferPtr, maxChunkLength);
+
+			// Data is written 16 bits at a time, so the chunk must be padded to
+			// an even number of bytes.
+			if (length % 2)
+				bufferPtr[length++] = 0xff;
+
+			*(lengthPtr++) = length;
+			totalLength   += length;
+
+			if (length)
+				_region.read(
+					&bufferPtr[currentOffset], offset, (length + 3) & ~3
+				);
+		}
+
+		if (!totalLength)
+			continue;
+
+		bufferPtr = buffers.as<uint8_t>();
+		offset    = i;
+
+		// If the chips have a write buffer, program an entire block at a time
+		// rather than a single halfword. As chunks are aligned to their length
+		// (a power of two), blocks never cross a buffer boundary. Blocks whose
+		// contents already match are skipped.
+		for (
+			size_t j = 0; j < maxChunkLength; j += step, bufferPtr += step,
+			offset += step
+		) {
+			auto chunkOffset = offset;
+			auto chunkPtr    = bufferPtr;
+			lengthPtr        = chunkLengths.as<size_t>();
+
+			for (
+				size_t k = _numChips; k > 0;
+				k--, chunkPtr += maxChunkLength, chunkOffset += _chipLength
+			) {
+				auto length = *(lengthPtr++);
+
+				if (j >= length)
+					continue;
+
+				auto blockSize = util::min(step, length - j);
+				auto data      = reinterpret_cast<const uint16_t *>(chunkPtr);
+
+				if (!__builtin_memcmp(
+					chunkPtr, &chunkPtr[currentOffset], blockSize
+				))
+					continue;
+
+				if (blockLength) {
+					error = _driver.writeBlock(chunkOffset, data, blockSize);
+
+					if (error)
+						return error;
+				} else {
+					_driver.write(chunkOffset, *data);
+				}
+			}
+
+			chunkOffset = offset;
+			chunkPtr    = bufferPtr;
+			lengthPtr   = chunkLengths.as<size_t>();
+
+			for (
+				size_t k = _numChips; k > 0;
+				k--, chunkPtr += maxChunkLength, chunkOffset += _chipLength
+			) {
+				auto length = *(lengthPtr++);
+
+				if (j >= length)
+					continue;
+
+				auto blockSize = util::min(step, length - j);
+				auto data      = reinterpret_cast<const uint16_t *>(chunkPtr);
+
+				if (!__builtin_memcmp(
+					chunkPtr, &chunkPtr[currentOffset], blockSize
+				))
+					continue;
+
+				if (blockLength)
+					error = _driver.flushWriteBlock(chunkOffset);
+				else
+					error = _driver.flushWrite(chunkOffset, *data);
+
+				if (error)
+					return error;
+
+				bytesWritten += blockSize;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < _regionLength; i += _chipLength)
+		_driver.exitBulkWrite(i);
+
+	return NO_ERROR;
+}
+
+}
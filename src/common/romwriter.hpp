@@ -0,0 +1,74 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common/file/file.hpp"
+#include "common/rom.hpp"
+#include "common/romdrivers.hpp"
+
+namespace rom {
+
+/* Region erasing and restoring */
+
+// Before restoring, each sector is compared against the file to find out
+// whether it can be left as-is, programmed directly (as writes can only clear
+// bits) or has to be erased first.
+enum SectorState : uint8_t {
+	SECTOR_MATCH   = 0,
+	SECTOR_PROGRAM = 1,
+	SECTOR_ERASE   = 2
+};
+
+enum WriterStep {
+	WRITER_COMPARE = 0,
+	WRITER_ERASE   = 1,
+	WRITER_WRITE   = 2
+};
+
+using WriterCallback = void (*)(
+	WriterStep step, size_t part, size_t total, void *arg
+);
+
+// Erases or restores a region, operating on all of its chips in parallel. The
+// callback (if any) is invoked before each sector or chunk is processed with
+// the current offset within each chip.
+class RegionWriter {
+private:
+	const Region &_region;
+	Driver       &_driver;
+	size_t       _regionLength, _chipLength, _sectorLength, _numChips;
+
+	void _update(WriterStep step, size_t part) const;
+	SectorState _compareSector(
+		file::File &file, uint32_t offset, size_t length, uint8_t *buffer
+	) const;
+
+public:
+	WriterCallback callback;
+	void           *callbackArg;
+
+	size_t sectorsSkipped, sectorsProgrammed, sectorsErased, bytesWritten;
+
+	RegionWriter(const Region &region, Driver &driver, size_t regionLength);
+
+	DriverError erase(void);
+	DriverError restore(file::File &file);
+};
+
+}
@@ -157,7 +157,7 @@ size_t upload(uint32_t ramOffset, const void *data, size_t length, bool wait) {
 	SPU_CTRL     = ctrlReg | SPU_CTRL_XFER_DMA_WRITE;
 	_waitForStatus(SPU_CTRL_XFER_BITMASK, SPU_CTRL_XFER_DMA_WRITE);
 
-	DMA_MADR(DMA_SPU) = reinterpret_cast<uint32_t>(data);
+	DMA_MADR(DMA_SPU) = reinterpret_cast<uintptr_t>(data);
 	DMA_BCR (DMA_SPU) = _DMA_CHUNK_SIZE | (length << 16);
 	DMA_CHCR(DMA_SPU) = DMA_CHCR_WRITE | DMA_CHCR_MODE_SLICE | DMA_CHCR_ENABLE;
 
@@ -0,0 +1,1361 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common/file/fat.hpp"
+#include "common/file/file.hpp"
+#include "common/file/iso9660.hpp"
+#include "common/file/misc.hpp"
+#include "common/file/zip.hpp"
+#include "common/ide.hpp"
+#include "common/util.hpp"
+#include "host/idesim.hpp"
+#include "ps1/system.h"
+#include "vendor/ff.h"
+#include "vendor/miniz.h"
+
+/*
+ * Runs the file system drivers on top of the IDE driver and the simulated
+ * drive, reporting the number of commands issued, the amount of data
+ * transferred and the simulated time taken by each step. Usage:
+ *
+ *   filebench [options] <image>
+ *
+ * The image is always created from scratch, either by formatting it as a FAT
+ * volume and populating it or (with -i) by generating an ISO9660 image to be
+ * read from a simulated ATAPI drive. Its contents are then read back through
+ * the same providers used by the main app (including the ZIP provider, which
+ * is tested on an archive stored in the FAT volume). All data read is checked
+ * against what was written and the exit code is non-zero if any step failed.
+ */
+
+static constexpr size_t _CHUNK_LENGTH       = 0x1000;
+static constexpr size_t _DATA_FILE_LENGTH   = 0x100000;
+static constexpr size_t _SMALL_FILE_LENGTH  = 0x10000;
+static constexpr size_t _FRAG_FILE_LENGTH   = 0x40000;
+static constexpr size_t _SEEK_READ_LENGTH   = 0x200;
+static constexpr size_t _NUM_SEEKS          = 64;
+static constexpr size_t _MKFS_BUFFER_LENGTH = 0x8000;
+static constexpr size_t _DIR_BATCH_LENGTH   = 16;
+static constexpr size_t _DIR_PAGE_LENGTH    = 64;
+static constexpr size_t _SMALL_DIR_LENGTH   = 128;
+static constexpr size_t _LARGE_DIR_LENGTH   = 2048;
+
+static constexpr size_t _ISO_NUM_FILES = 64;
+static constexpr size_t _ISO_DEPTH     = 8;
+
+static constexpr size_t _ZIP_DATA_LENGTH   = 0x40000;
+static constexpr size_t _ZIP_BUFFER_LENGTH = 0x100000;
+static constexpr size_t _ZIP_NUM_DIRS      = 16;
+static constexpr size_t _ZIP_DIR_FILES     = 64;
+static constexpr size_t _ZIP_NUM_FILES     = _ZIP_NUM_DIRS * _ZIP_DIR_FILES;
+static constexpr size_t _ZIP_MAX_ENTRIES   = _ZIP_NUM_FILES + 1;
+
+static const char _USAGE[]{
+	"Usage: %s [options] <image>\n"
+	"\n"
+	"Options:\n"
+	"  -z KB     size of the image to create (default 65536)\n"
+	"  -i        generate an ISO9660 image and test the ISO9660 provider\n"
+	"  -T        leave out the path table from the ISO9660 image\n"
+	"  -t        log all commands to stderr\n"
+};
+
+/* Test data */
+
+static uint8_t _buffer[_DATA_FILE_LENGTH] __attribute__((aligned(4)));
+
+// The contents of each test file are derived from its offset and a per-file
+// seed, so that any chunk can be checked without keeping a copy of the file.
+static void _fillChunk(uint8_t *output, size_t length, uint32_t seed) {
+	for (; length; length--) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		*(output++) = uint8_t(seed);
+	}
+}
+
+static uint32_t _getChunkSeed(uint32_t seed, uint64_t offset) {
+	return (seed * 0x9e3779b9) ^ uint32_t(offset / _CHUNK_LENGTH) ^ 0x573;
+}
+
+/* Step counters */
+
+struct StepCounters {
+public:
+	uint64_t time, bytesRead, bytesWritten;
+	uint32_t commands;
+};
+
+static StepCounters _stepStart;
+static uint32_t     _failures = 0;
+
+static void _getCounters(StepCounters &output) {
+	auto &stats = ide::devices[0].stats;
+
+	output.time         = getHostTime();
+	output.bytesRead    = stats.bytesRead;
+	output.bytesWritten = stats.bytesWritten;
+	output.commands     = 0;
+
+	for (auto count : stats.commands)
+		output.commands += count;
+}
+
+static void _beginStep(void) {
+	_getCounters(_stepStart);
+}
+
+static void _endStep(const char *name, bool success) {
+	StepCounters end;
+
+	_getCounters(end);
+
+	printf(
+		"%-16s %6u commands, %9llu bytes read, %9llu bytes written, "
+		"%10.3f ms\n",
+		name, end.commands - _stepStart.commands,
+		(unsigned long long) (end.bytesRead - _stepStart.bytesRead),
+		(unsigned long long) (end.bytesWritten - _stepStart.bytesWritten),
+		double(end.time - _stepStart.time) / 1.0e6
+	);
+
+	if (!success) {
+		fprintf(stderr, "%s failed verification\n", name);
+		_failures++;
+	}
+}
+
+/* File helpers */
+
+static void _fillFile(uint8_t *output, size_t length, uint32_t seed) {
+	for (size_t offset = 0; offset < length; offset += _CHUNK_LENGTH)
+		_fillChunk(
+			&output[offset], util::min(_CHUNK_LENGTH, length - offset),
+			_getChunkSeed(seed, offset)
+		);
+}
+
+static bool _writeData(
+	file::Provider &provider, const char *path, const void *data,
+	size_t length
+) {
+	auto file = provider.openFile(path, file::WRITE | file::FORCE_CREATE);
+
+	if (!file)
+		return false;
+
+	bool success = (file->write(data, length) == length);
+
+	file->close();
+	delete file;
+	return success;
+}
+
+static bool _writeFile(
+	file::Provider &provider, const char *path, size_t length, uint32_t seed,
+	size_t writeLength
+) {
+	auto file = provider.openFile(path, file::WRITE | file::FORCE_CREATE);
+
+	if (!file)
+		return false;
+
+	bool success = true;
+
+	for (size_t offset = 0; success && (offset < length);) {
+		auto chunkLength = util::min(_CHUNK_LENGTH, length - offset);
+
+		_fillChunk(_buffer, chunkLength, _getChunkSeed(seed, offset));
+
+		for (size_t i = 0; i < chunkLength; i += writeLength) {
+			auto actual = util::min(writeLength, chunkLength - i);
+
+			if (file->write(&_buffer[i], actual) != actual) {
+				success = false;
+				break;
+			}
+		}
+
+		offset += chunkLength;
+	}
+
+	file->close();
+	delete file;
+	return success;
+}
+
+static bool _verifyChunk(
+	const uint8_t *data, uint64_t offset, size_t length, uint32_t seed
+) {
+	// Chunks may be verified starting from any offset, so the expected data is
+	// generated for the whole chunk containing it.
+	static uint8_t expected[_CHUNK_LENGTH];
+
+	while (length) {
+		auto chunkOffset = size_t(offset % _CHUNK_LENGTH);
+		auto chunkLength = util::min(length, _CHUNK_LENGTH - chunkOffset);
+
+		_fillChunk(expected, _CHUNK_LENGTH, _getChunkSeed(seed, offset));
+
+		if (__builtin_memcmp(data, &expected[chunkOffset], chunkLength))
+			return false;
+
+		data   += chunkLength;
+		offset += chunkLength;
+		length -= chunkLength;
+	}
+
+	return true;
+}
+
+static bool _readFile(
+	file::Provider &provider, const char *path, size_t length, uint32_t seed,
+	size_t chunkLength
+) {
+	auto file = provider.openFile(path, file::READ);
+
+	if (!file)
+		return false;
+
+	bool success = (file->size == length);
+
+	for (size_t offset = 0; success && (offset < length);) {
+		auto actual = file->read(_buffer, chunkLength);
+
+		if (!actual || !_verifyChunk(_buffer, offset, actual, seed))
+			success = false;
+
+		offset += actual;
+	}
+
+	file->close();
+	delete file;
+	return success;
+}
+
+static bool _writeInterleaved(
+	file::Provider &provider, const char *path1, const char *path2,
+	size_t length, uint32_t seed
+) {
+	// Writing two files a chunk at a time causes their clusters to be
+	// allocated alternately, fragmenting both of them.
+	file::File *files[2]{
+		provider.openFile(path1, file::WRITE | file::FORCE_CREATE),
+		provider.openFile(path2, file::WRITE | file::FORCE_CREATE)
+	};
+
+	bool success = files[0] && files[1];
+
+	for (size_t offset = 0; success && (offset < length);) {
+		auto chunkLength = util::min(_CHUNK_LENGTH, length - offset);
+
+		for (uint32_t i = 0; i < 2; i++) {
+			_fillChunk(_buffer, chunkLength, _getChunkSeed(seed + i, offset));
+
+			if (files[i]->write(_buffer, chunkLength) != chunkLength)
+				success = false;
+		}
+
+		offset += chunkLength;
+	}
+
+	for (auto file : files) {
+		if (file) {
+			file->close();
+			delete file;
+		}
+	}
+
+	return success;
+}
+
+static bool _seekFile(
+	file::Provider &provider, const char *path, uint32_t flags, size_t length,
+	uint32_t seed
+) {
+	auto file = provider.openFile(path, flags);
+
+	if (!file)
+		return false;
+
+	bool     success = (file->size == length);
+	uint32_t state   = seed;
+
+	for (size_t i = 0; success && (i < _NUM_SEEKS); i++) {
+		state = state * 1103515245 + 12345;
+
+		uint64_t offset = (state >> 8) % (length / _SEEK_READ_LENGTH);
+		offset         *= _SEEK_READ_LENGTH;
+
+		if (
+			(file->seek(offset) != offset) ||
+			(file->read(_buffer, _SEEK_READ_LENGTH) != _SEEK_READ_LENGTH) ||
+			!_verifyChunk(_buffer, offset, _SEEK_READ_LENGTH, seed)
+		)
+			success = false;
+	}
+
+	file->close();
+	delete file;
+	return success;
+}
+
+/* FAT tests */
+
+static bool _mountFAT(file::FATProvider &fat, uint32_t clusterLength) {
+	static uint8_t work[_MKFS_BUFFER_LENGTH];
+
+	MKFS_PARM params{
+		.fmt     = FM_ANY | FM_SFD,
+		.n_fat   = 1,
+		.align   = 0,
+		.n_root  = 0,
+		.au_size = clusterLength
+	};
+
+	if (f_mkfs("0:", &params, work, sizeof(work)) || !fat.init(0)) {
+		fprintf(stderr, "failed to format the image\n");
+		_failures++;
+		return false;
+	}
+
+	return true;
+}
+
+static void _testFAT(void) {
+	file::FATProvider fat;
+
+	if (!_mountFAT(fat, 0))
+		return;
+
+	// The files are written in chunks much smaller than the write buffer,
+	// which should nonetheless end up being sent to the drive in large
+	// transfers.
+	_beginStep();
+	_endStep(
+		"fat-write",
+		_writeFile(fat, "DATA.BIN", _DATA_FILE_LENGTH, 1, _CHUNK_LENGTH)
+	);
+
+	_beginStep();
+	_endStep(
+		"fat-small-write",
+		_writeFile(fat, "SMALL.BIN", _SMALL_FILE_LENGTH, 2, 512)
+	);
+
+	_beginStep();
+	_endStep(
+		"fat-read",
+		_readFile(fat, "DATA.BIN", _DATA_FILE_LENGTH, 1, _CHUNK_LENGTH)
+	);
+
+	_beginStep();
+	_endStep(
+		"fat-small-read",
+		_readFile(fat, "SMALL.BIN", _SMALL_FILE_LENGTH, 2, _CHUNK_LENGTH)
+	);
+
+	fat.close();
+}
+
+static void _testFATSeek(void) {
+	file::FATProvider fat;
+
+	// The volume is reformatted with single-sector clusters in order to get
+	// cluster chains spanning several FAT sectors even with small files.
+	if (!_mountFAT(fat, 512))
+		return;
+
+	_beginStep();
+	_endStep(
+		"fat-frag-write",
+		_writeInterleaved(fat, "FRAG1.BIN", "FRAG2.BIN", _FRAG_FILE_LENGTH, 3)
+	);
+
+	_beginStep();
+	_endStep(
+		"fat-seek",
+		_seekFile(fat, "FRAG1.BIN", file::READ, _FRAG_FILE_LENGTH, 3)
+	);
+
+	// Files opened for writing cannot use fast seek mode, so seeking in them
+	// requires following the cluster chain from the beginning of the file.
+	_beginStep();
+	_endStep(
+		"fat-seek-chain",
+		_seekFile(
+			fat, "FRAG2.BIN", file::READ | file::WRITE, _FRAG_FILE_LENGTH, 4
+		)
+	);
+
+	fat.close();
+}
+
+static bool _readPrefix(
+	file::Provider &provider, const char *path, size_t length, uint32_t seed
+) {
+	auto file = provider.openFile(path, file::READ);
+
+	if (!file)
+		return false;
+
+	bool success = (file->read(_buffer, length) == length) &&
+		_verifyChunk(_buffer, 0, length, seed);
+
+	file->close();
+	delete file;
+	return success;
+}
+
+static size_t _countEntries(file::Provider &provider, const char *path) {
+	auto dir = provider.openDirectory(path);
+
+	if (!dir)
+		return 0;
+
+	// Entries are read in batches of the same size used by the file browser.
+	file::FileInfo entries[_DIR_BATCH_LENGTH];
+	size_t         count = 0, actual;
+
+	while ((actual = dir->getEntries(entries, util::countOf(entries))))
+		count += actual;
+
+	dir->close();
+	delete dir;
+	return count;
+}
+
+static bool _createFiles(
+	file::Provider &provider, const char *path, size_t count
+) {
+	if (!provider.createDirectory(path))
+		return false;
+
+	for (size_t i = 0; i < count; i++) {
+		char filePath[32];
+
+		snprintf(filePath, sizeof(filePath), "%s/F%05d.BIN", path, int(i));
+
+		auto file =
+			provider.openFile(filePath, file::WRITE | file::FORCE_CREATE);
+
+		if (!file)
+			return false;
+
+		file->close();
+		delete file;
+	}
+
+	return true;
+}
+
+static bool _listTwoPass(
+	file::Provider &provider, const char *path, size_t expected
+) {
+	// This is how the file browser used to load directories, opening them once
+	// to count their entries and then again to actually load them.
+	for (int i = 0; i < 2; i++) {
+		auto dir = provider.openDirectory(path);
+
+		if (!dir)
+			return false;
+
+		file::FileInfo entry;
+		size_t         count = 0;
+
+		while (dir->getEntry(entry))
+			count++;
+
+		dir->close();
+		delete dir;
+
+		if (count != expected)
+			return false;
+	}
+
+	return true;
+}
+
+static bool _readFirstPage(file::Provider &provider, const char *path) {
+	// The file browser only fills the first page synchronously when loading a
+	// directory, leaving the rest to be enumerated in the background.
+	auto dir = provider.openDirectory(path);
+
+	if (!dir)
+		return false;
+
+	file::FileInfo entries[_DIR_BATCH_LENGTH];
+	size_t         count = 0, actual;
+
+	while (count < _DIR_PAGE_LENGTH) {
+		actual = dir->getEntries(entries, _DIR_BATCH_LENGTH);
+
+		if (!actual)
+			break;
+
+		count += actual;
+	}
+
+	dir->close();
+	delete dir;
+	return (count == _DIR_PAGE_LENGTH);
+}
+
+/* FAT directory tests */
+
+static void _testFATDirectory(void) {
+	file::FATProvider fat;
+
+	if (!_mountFAT(fat, 0))
+		return;
+	if (
+		!_createFiles(fat, "SMALL", _SMALL_DIR_LENGTH) ||
+		!_createFiles(fat, "LARGE", _LARGE_DIR_LENGTH)
+	) {
+		fprintf(stderr, "failed to populate the directory\n");
+		_failures++;
+		return;
+	}
+
+	// Enumerating a directory in a single pass using batched reads should take
+	// half as many reads as counting its entries and then loading them.
+	_beginStep();
+	_endStep(
+		"fat-dir-two-pass", _listTwoPass(fat, "LARGE", _LARGE_DIR_LENGTH)
+	);
+
+	_beginStep();
+	_endStep(
+		"fat-dir-batched", _countEntries(fat, "LARGE") == _LARGE_DIR_LENGTH
+	);
+
+	// Loading the first page of a directory should take the same amount of
+	// time regardless of how many entries the directory has.
+	_beginStep();
+	_endStep("fat-page-small", _readFirstPage(fat, "SMALL"));
+
+	_beginStep();
+	_endStep("fat-page-large", _readFirstPage(fat, "LARGE"));
+
+	fat.close();
+}
+
+/* VFS tests */
+
+static bool _checkVFSSize(
+	file::Provider &vfs, const char *path, size_t expected
+) {
+	file::FileInfo info;
+
+	if (!vfs.getFileInfo(info, path))
+		return false;
+
+	return (info.size == expected);
+}
+
+static bool _lookupVFSPaths(file::Provider &vfs) {
+	// The same few paths are looked up over and over, as the main app does with
+	// its configuration files and autoboot probes. One of them is missing.
+	file::FileInfo info;
+
+	for (int i = 0; i < 16; i++) {
+		if (!_checkVFSSize(vfs, "hdd:/DATA.BIN", 1000))
+			return false;
+		if (!_checkVFSSize(vfs, "hdd:/DIR/NESTED.BIN", 2000))
+			return false;
+		if (vfs.getFileInfo(info, "hdd:/MISSING.BIN"))
+			return false;
+	}
+
+	return true;
+}
+
+static bool _checkVFSWrites(file::Provider &vfs, file::Provider &fat) {
+	// Files written or created through the VFS as well as directly through
+	// the underlying provider must be picked up by the next lookup.
+	if (!_writeData(vfs, "hdd:/DATA.BIN", _buffer, 3000))
+		return false;
+	if (!_checkVFSSize(vfs, "hdd:/DATA.BIN", 3000))
+		return false;
+
+	if (!_writeData(fat, "DIR/NESTED.BIN", _buffer, 4000))
+		return false;
+	if (!_checkVFSSize(vfs, "hdd:/DIR/NESTED.BIN", 4000))
+		return false;
+
+	if (!_writeData(fat, "MISSING.BIN", _buffer, 5000))
+		return false;
+
+	return _checkVFSSize(vfs, "hdd:/MISSING.BIN", 5000);
+}
+
+static void _testVFS(void) {
+	file::FATProvider fat;
+	file::VFSProvider vfs;
+
+	if (!_mountFAT(fat, 0))
+		return;
+	if (
+		!_writeData(fat, "DATA.BIN", _buffer, 1000) ||
+		!fat.createDirectory("DIR") ||
+		!_writeData(fat, "DIR/NESTED.BIN", _buffer, 2000)
+	) {
+		fprintf(stderr, "failed to populate the volume\n");
+		_failures++;
+		return;
+	}
+
+	vfs.mount("hdd:", &fat);
+
+	// Only the first lookup of each path should reach the FAT provider.
+	_beginStep();
+	_endStep("vfs-lookup", _lookupVFSPaths(vfs));
+
+	_beginStep();
+	_endStep("vfs-lookup-again", _lookupVFSPaths(vfs));
+
+	_beginStep();
+	_endStep("vfs-write", _checkVFSWrites(vfs, fat));
+
+	vfs.unmount("hdd:");
+	fat.close();
+}
+
+/* ISO9660 image generator */
+
+struct ISOEntry {
+public:
+	const char *name;
+	uint32_t   lba, length;
+	bool       directory;
+};
+
+static constexpr uint32_t _ISO_PVD_LBA        = 16;
+static constexpr uint32_t _ISO_PATH_TABLE_LBA = 18;
+static constexpr uint32_t _ISO_ROOT_LBA       = 20;
+
+static char _isoFileNames[_ISO_NUM_FILES][16];
+static char _isoLevelNames[_ISO_DEPTH][8];
+
+static inline file::ISOUint16 _toISOUint16(uint16_t value) {
+	return { value, __builtin_bswap16(value) };
+}
+
+static inline file::ISOUint32 _toISOUint32(uint32_t value) {
+	return { value, __builtin_bswap32(value) };
+}
+
+static inline uint32_t _getNumSectors(size_t length) {
+	return (length + ide::ATAPI_SECTOR_SIZE - 1) / ide::ATAPI_SECTOR_SIZE;
+}
+
+static inline size_t _getISONameLength(const char *name) {
+	// The current and parent directory entries are named "\x00" and "\x01";
+	// the former is passed as an empty string, whose null terminator then ends
+	// up being copied as the name.
+	return util::max(__builtin_strlen(name), size_t(1));
+}
+
+static size_t _writeISODirectory(
+	uint8_t *output, const ISOEntry *entries, size_t count
+) {
+	// If no output buffer is given, only the directory's length is computed.
+	// Records are padded so that none of them crosses a sector boundary.
+	size_t offset = 0;
+
+	for (; count; count--, entries++) {
+		auto nameLength   = _getISONameLength(entries->name);
+		auto recordLength = (sizeof(file::ISORecord) + nameLength + 1) & ~1;
+		auto sectorOffset = offset % ide::ATAPI_SECTOR_SIZE;
+
+		if ((sectorOffset + recordLength) > ide::ATAPI_SECTOR_SIZE)
+			offset += ide::ATAPI_SECTOR_SIZE - sectorOffset;
+
+		if (output) {
+			auto record = reinterpret_cast<file::ISORecord *>(&output[offset]);
+
+			__builtin_memset(record, 0, recordLength);
+			record->recordLength = uint8_t(recordLength);
+			record->lba          = _toISOUint32(entries->lba);
+			record->length       = _toISOUint32(entries->length);
+			record->flags        =
+				entries->directory ? file::ISO_RECORD_DIRECTORY : 0;
+			record->volumeNumber = _toISOUint16(1);
+			record->nameLength   = uint8_t(nameLength);
+
+			__builtin_memcpy(record + 1, entries->name, nameLength);
+		}
+
+		offset += recordLength;
+	}
+
+	return _getNumSectors(offset) * ide::ATAPI_SECTOR_SIZE;
+}
+
+static size_t _writeISOPathTable(
+	uint8_t *output, const ISOEntry *dirs, size_t count, bool bigEndian
+) {
+	// Each directory in the chain is the parent of the next one, so the order
+	// they are passed in is also a valid path table order.
+	size_t offset = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		auto nameLength = _getISONameLength(dirs[i].name);
+		auto entry      =
+			reinterpret_cast<file::ISOPathTableEntry *>(&output[offset]);
+
+		__builtin_memset(entry, 0, sizeof(file::ISOPathTableEntry) + 2);
+		entry->nameLength  = uint8_t(nameLength);
+		entry->lba         = dirs[i].lba;
+		entry->parentIndex = uint16_t(i ? i : 1);
+
+		if (bigEndian) {
+			entry->lba         = __builtin_bswap32(entry->lba);
+			entry->parentIndex = __builtin_bswap16(entry->parentIndex);
+		}
+
+		__builtin_memcpy(entry + 1, dirs[i].name, nameLength);
+		offset += entry->getEntryLength();
+	}
+
+	return offset;
+}
+
+static bool _writeSectors(
+	int fd, uint32_t lba, const void *data, size_t length
+) {
+	auto offset = off_t(lba) * ide::ATAPI_SECTOR_SIZE;
+
+	return pwrite(fd, data, length, offset) == ssize_t(length);
+}
+
+static bool _writeISOFile(int fd, uint32_t lba, size_t length, uint32_t seed) {
+	for (size_t offset = 0; offset < length; offset += _CHUNK_LENGTH) {
+		auto chunkLength = util::min(_CHUNK_LENGTH, length - offset);
+
+		_fillChunk(_buffer, chunkLength, _getChunkSeed(seed, offset));
+
+		if (!_writeSectors(
+			fd, lba + _getNumSectors(offset), _buffer, chunkLength
+		))
+			return false;
+	}
+
+	return true;
+}
+
+static size_t _getISOFileLength(size_t index) {
+	return 100 + index * 50;
+}
+
+static bool _buildISO(int fd, bool pathTable) {
+	// The image contains a root directory with a large data file and many
+	// small files, plus a chain of nested directories with a single file at
+	// the bottom. All directories (root included) are listed in dirs[] in path
+	// table order.
+	ISOEntry root[4 + _ISO_NUM_FILES], levels[_ISO_DEPTH][3];
+	ISOEntry dirs[1 + _ISO_DEPTH];
+
+	for (size_t i = 0; i < _ISO_DEPTH; i++) {
+		auto name = _isoLevelNames[i];
+
+		snprintf(name, sizeof(_isoLevelNames[i]), "LEVEL%d", int(i + 1));
+	}
+
+	root[0] = { "",                0, 0,                 true  };
+	root[1] = { "\x01",            0, 0,                 true  };
+	root[2] = { "DATA.BIN;1",      0, _DATA_FILE_LENGTH, false };
+	root[3] = { _isoLevelNames[0], 0, 0,                 true  };
+
+	for (size_t i = 0; i < _ISO_NUM_FILES; i++) {
+		auto name = _isoFileNames[i];
+
+		snprintf(name, sizeof(_isoFileNames[i]), "FILE%03d.BIN;1", int(i));
+		root[4 + i] = { name, 0, uint32_t(_getISOFileLength(i)), false };
+	}
+
+	for (size_t i = 0; i < _ISO_DEPTH; i++) {
+		levels[i][0] = { "",     0, 0, true };
+		levels[i][1] = { "\x01", 0, 0, true };
+
+		if (i < (_ISO_DEPTH - 1))
+			levels[i][2] = { _isoLevelNames[i + 1], 0, 0, true };
+		else
+			levels[i][2] = { "DEEP.BIN;1", 0, _SMALL_FILE_LENGTH, false };
+	}
+
+	// Lay out all directories, followed by the files.
+	dirs[0]        = { "", _ISO_ROOT_LBA, 0, true };
+	dirs[0].length = _writeISODirectory(nullptr, root, util::countOf(root));
+
+	for (size_t i = 0; i < _ISO_DEPTH; i++) {
+		auto &dir  = dirs[i + 1];
+		auto &prev = dirs[i];
+
+		dir.name      = _isoLevelNames[i];
+		dir.lba       = prev.lba + _getNumSectors(prev.length);
+		dir.length    = _writeISODirectory(nullptr, levels[i], 3);
+		dir.directory = true;
+	}
+
+	auto &last = dirs[_ISO_DEPTH];
+	auto lba   = last.lba + _getNumSectors(last.length);
+
+	for (size_t i = 2; i < util::countOf(root); i++) {
+		if (i == 3)
+			continue;
+
+		root[i].lba = lba;
+		lba        += _getNumSectors(root[i].length);
+	}
+
+	auto &deep = levels[_ISO_DEPTH - 1][2];
+	deep.lba   = lba;
+	lba       += _getNumSectors(deep.length);
+
+	// Fill in the links between directories, then write them out.
+	for (size_t i = 0; i <= _ISO_DEPTH; i++) {
+		auto entries = i ? levels[i - 1] : root;
+		auto &parent = dirs[i ? (i - 1) : 0];
+
+		entries[0].lba    = dirs[i].lba;
+		entries[0].length = dirs[i].length;
+		entries[1].lba    = parent.lba;
+		entries[1].length = parent.length;
+
+		if (i < _ISO_DEPTH) {
+			auto &child = entries[i ? 2 : 3];
+
+			child.lba    = dirs[i + 1].lba;
+			child.length = dirs[i + 1].length;
+		}
+	}
+
+	for (size_t i = 0; i <= _ISO_DEPTH; i++) {
+		auto entries = i ? levels[i - 1] : root;
+		auto count   = i ? 3 : util::countOf(root);
+
+		__builtin_memset(_buffer, 0, dirs[i].length);
+		_writeISODirectory(_buffer, entries, count);
+
+		if (!_writeSectors(fd, dirs[i].lba, _buffer, dirs[i].length))
+			return false;
+	}
+
+	// Write the path tables and volume descriptors.
+	size_t pathTableLength = 0;
+
+	for (uint32_t i = 0; i < 2; i++) {
+		__builtin_memset(_buffer, 0, ide::ATAPI_SECTOR_SIZE);
+		pathTableLength = _writeISOPathTable(_buffer, dirs, 1 + _ISO_DEPTH, i);
+
+		if (!_writeSectors(
+			fd, _ISO_PATH_TABLE_LBA + i, _buffer, ide::ATAPI_SECTOR_SIZE
+		))
+			return false;
+	}
+
+	file::ISOPrimaryVolumeDesc pvd;
+
+	__builtin_memset(&pvd, 0, sizeof(pvd));
+	__builtin_memset(pvd.volume, ' ', sizeof(pvd.volume));
+	__builtin_memcpy(pvd.volume, "FILEBENCH", 9);
+	__builtin_memcpy(pvd.magic, "CD001", 5);
+
+	pvd.type                  = file::ISO_TYPE_PRIMARY;
+	pvd.version               = 1;
+	pvd.volumeLength          = _toISOUint32(lba);
+	pvd.numVolumes            = _toISOUint16(1);
+	pvd.volumeNumber          = _toISOUint16(1);
+	pvd.sectorLength          = _toISOUint16(ide::ATAPI_SECTOR_SIZE);
+	pvd.pathTableLength       = _toISOUint32(pathTable ? pathTableLength : 0);
+	pvd.pathTableLEOffsets[0] = _ISO_PATH_TABLE_LBA;
+	pvd.pathTableBEOffsets[0] = __builtin_bswap32(_ISO_PATH_TABLE_LBA + 1);
+	pvd.isoVersion            = 1;
+
+	_writeISODirectory(
+		reinterpret_cast<uint8_t *>(&pvd.root), &root[0], 1
+	);
+
+	if (!_writeSectors(fd, _ISO_PVD_LBA, &pvd, sizeof(pvd)))
+		return false;
+
+	__builtin_memset(&pvd, 0, sizeof(pvd));
+	__builtin_memcpy(pvd.magic, "CD001", 5);
+
+	pvd.type    = file::ISO_TYPE_TERMINATOR;
+	pvd.version = 1;
+
+	if (!_writeSectors(fd, _ISO_PVD_LBA + 1, &pvd, sizeof(pvd)))
+		return false;
+
+	// Write the contents of all files.
+	if (!_writeISOFile(fd, root[2].lba, _DATA_FILE_LENGTH, 5))
+		return false;
+	if (!_writeISOFile(fd, deep.lba, _SMALL_FILE_LENGTH, 6))
+		return false;
+
+	for (size_t i = 0; i < _ISO_NUM_FILES; i++) {
+		if (!_writeISOFile(
+			fd, root[4 + i].lba, _getISOFileLength(i), 0x100 + i
+		))
+			return false;
+	}
+
+	return !ftruncate(fd, off_t(lba) * ide::ATAPI_SECTOR_SIZE);
+}
+
+/* ISO9660 tests */
+
+static bool _lookupISOFiles(file::Provider &provider) {
+	for (size_t i = 0; i < _ISO_NUM_FILES; i++) {
+		file::FileInfo info;
+		char           path[16];
+
+		snprintf(path, sizeof(path), "/FILE%03d.BIN", int(i));
+
+		if (!provider.getFileInfo(info, path))
+			return false;
+		if (info.size != _getISOFileLength(i))
+			return false;
+	}
+
+	return true;
+}
+
+static bool _lookupDeepFile(file::Provider &provider) {
+	file::FileInfo info;
+	char           path[80];
+	size_t         length = 0;
+
+	for (size_t i = 0; i < _ISO_DEPTH; i++)
+		length += snprintf(
+			&path[length], sizeof(path) - length, "%s/", _isoLevelNames[i]
+		);
+
+	snprintf(&path[length], sizeof(path) - length, "DEEP.BIN");
+
+	if (!provider.getFileInfo(info, path))
+		return false;
+
+	return (info.size == _SMALL_FILE_LENGTH);
+}
+
+static void _testISO(void) {
+	file::ISO9660Provider iso;
+
+	_beginStep();
+	_endStep("iso-mount", iso.init(0));
+
+	// If the path table is present, the directory containing a deeply nested
+	// file should be located through it without reading any of its parents.
+	_beginStep();
+	_endStep("iso-deep-lookup", _lookupDeepFile(iso));
+
+	// Looking up files in a directory should only read it once. Repeated
+	// lookups should then be served entirely from the directory cache and path
+	// index.
+	_beginStep();
+	_endStep("iso-lookup", _lookupISOFiles(iso));
+
+	_beginStep();
+	_endStep("iso-lookup-again", _lookupISOFiles(iso));
+
+	// Small unaligned reads should be served from the file's buffer, which is
+	// refilled with as many sectors as it can hold while the file is read
+	// sequentially. Large aligned reads should bypass the buffer entirely.
+	_beginStep();
+	_endStep(
+		"iso-small-read",
+		_readFile(iso, "DATA.BIN", _DATA_FILE_LENGTH, 5, 1000)
+	);
+
+	_beginStep();
+	_endStep(
+		"iso-whole-read",
+		_readFile(iso, "DATA.BIN", _DATA_FILE_LENGTH, 5, _DATA_FILE_LENGTH)
+	);
+
+	iso.close();
+}
+
+/* ZIP archive generator */
+
+struct ZIPEntry {
+public:
+	const char *name;
+	uint32_t   offset, crc, compressedLength, length;
+};
+
+class ZIPBuilder {
+private:
+	uint8_t  *_output;
+	size_t   _length, _maxLength, _numEntries;
+	ZIPEntry _entries[_ZIP_MAX_ENTRIES];
+
+	void _put16(uint16_t value);
+	void _put32(uint32_t value);
+	void _putHeader(const ZIPEntry &entry, bool central);
+
+public:
+	inline ZIPBuilder(uint8_t *output, size_t maxLength)
+	: _output(output), _length(0), _maxLength(maxLength), _numEntries(0) {}
+
+	bool addFile(const char *name, const void *data, size_t length);
+	size_t finish(void);
+};
+
+static constexpr size_t _ZIP_LOCAL_HEADER_LENGTH   = 30;
+static constexpr size_t _ZIP_CENTRAL_HEADER_LENGTH = 46;
+static constexpr size_t _ZIP_END_RECORD_LENGTH     = 22;
+
+void ZIPBuilder::_put16(uint16_t value) {
+	_output[_length++] = uint8_t(value);
+	_output[_length++] = uint8_t(value >> 8);
+}
+
+void ZIPBuilder::_put32(uint32_t value) {
+	_put16(uint16_t(value));
+	_put16(uint16_t(value >> 16));
+}
+
+void ZIPBuilder::_putHeader(const ZIPEntry &entry, bool central) {
+	auto nameLength = __builtin_strlen(entry.name);
+
+	// All entries are deflated and dated 1 January 1980.
+	_put32(central ? 0x02014b50 : 0x04034b50);
+
+	if (central)
+		_put16(20);
+
+	_put16(20);
+	_put16(0);
+	_put16(MZ_DEFLATED);
+	_put16(0);
+	_put16((1 << 5) | 1);
+	_put32(entry.crc);
+	_put32(entry.compressedLength);
+	_put32(entry.length);
+	_put16(uint16_t(nameLength));
+	_put16(0);
+
+	if (central) {
+		_put16(0);
+		_put16(0);
+		_put16(0);
+		_put32(0);
+		_put32(entry.offset);
+	}
+
+	__builtin_memcpy(&_output[_length], entry.name, nameLength);
+	_length += nameLength;
+}
+
+bool ZIPBuilder::addFile(const char *name, const void *data, size_t length) {
+	auto headerLength = _ZIP_LOCAL_HEADER_LENGTH + __builtin_strlen(name);
+
+	if (
+		(_numEntries >= _ZIP_MAX_ENTRIES) ||
+		((_length + headerLength) > _maxLength)
+	)
+		return false;
+
+	auto &entry = _entries[_numEntries];
+
+	entry.name   = name;
+	entry.offset = _length;
+	entry.crc    =
+		util::zipCRC32(reinterpret_cast<const uint8_t *>(data), length);
+	entry.length = length;
+
+	// The local header can only be written once the length of the compressed
+	// data is known.
+	entry.compressedLength = tdefl_compress_mem_to_mem(
+		&_output[_length + headerLength], _maxLength - _length - headerLength,
+		data, length, TDEFL_DEFAULT_MAX_PROBES
+	);
+
+	if (!entry.compressedLength)
+		return false;
+
+	_putHeader(entry, false);
+	_length += entry.compressedLength;
+	_numEntries++;
+	return true;
+}
+
+size_t ZIPBuilder::finish(void) {
+	auto directoryOffset = _length;
+	auto directoryLength = _ZIP_END_RECORD_LENGTH;
+
+	for (size_t i = 0; i < _numEntries; i++)
+		directoryLength += _ZIP_CENTRAL_HEADER_LENGTH
+			+ __builtin_strlen(_entries[i].name);
+
+	if ((_length + directoryLength) > _maxLength)
+		return 0;
+
+	for (size_t i = 0; i < _numEntries; i++)
+		_putHeader(_entries[i], true);
+
+	directoryLength = _length - directoryOffset;
+
+	_put32(0x06054b50);
+	_put16(0);
+	_put16(0);
+	_put16(uint16_t(_numEntries));
+	_put16(uint16_t(_numEntries));
+	_put32(uint32_t(directoryLength));
+	_put32(uint32_t(directoryOffset));
+	_put16(0);
+
+	return _length;
+}
+
+/* ZIP tests */
+
+static uint8_t _zipBuffer[_ZIP_BUFFER_LENGTH];
+static char    _zipFileNames[_ZIP_NUM_FILES][24];
+
+static size_t _getZIPFileLength(size_t index) {
+	return 16 + (index * 7) % 100;
+}
+
+static size_t _buildZIP(void) {
+	// The archive contains a large file in its root, plus many small files in
+	// nested directories that only exist implicitly as part of their paths.
+	ZIPBuilder builder(_zipBuffer, sizeof(_zipBuffer));
+
+	_fillFile(_buffer, _ZIP_DATA_LENGTH, 7);
+
+	if (!builder.addFile("DATA.BIN", _buffer, _ZIP_DATA_LENGTH))
+		return 0;
+
+	for (size_t i = 0; i < _ZIP_NUM_FILES; i++) {
+		auto name   = _zipFileNames[i];
+		auto length = _getZIPFileLength(i);
+
+		snprintf(
+			name, sizeof(_zipFileNames[i]), "DIR%02d/SUB/FILE%03d.BIN",
+			int(i / _ZIP_DIR_FILES), int(i % _ZIP_DIR_FILES)
+		);
+		_fillFile(_buffer, length, 0x1000 + i);
+
+		if (!builder.addFile(name, _buffer, length))
+			return 0;
+	}
+
+	return builder.finish();
+}
+
+static bool _lookupZIPFiles(file::Provider &provider) {
+	for (size_t i = 0; i < _ZIP_NUM_FILES; i++) {
+		file::FileInfo info;
+
+		if (!provider.getFileInfo(info, _zipFileNames[i]))
+			return false;
+		if (info.size != _getZIPFileLength(i))
+			return false;
+	}
+
+	return true;
+}
+
+static bool _listZIPDirectories(file::Provider &provider) {
+	// The root holds the large file and all top-level directories, each of
+	// which in turn holds a single subdirectory.
+	if (_countEntries(provider, "") != (1 + _ZIP_NUM_DIRS))
+		return false;
+
+	for (size_t i = 0; i < _ZIP_NUM_DIRS; i++) {
+		char path[16];
+
+		snprintf(path, sizeof(path), "DIR%02d", int(i));
+
+		if (_countEntries(provider, path) != 1)
+			return false;
+
+		snprintf(path, sizeof(path), "/dir%02d//sub", int(i));
+
+		if (_countEntries(provider, path) != _ZIP_DIR_FILES)
+			return false;
+	}
+
+	return true;
+}
+
+static void _testZIP(void) {
+	file::FATProvider fat;
+	file::ZIPProvider zip;
+
+	if (!_mountFAT(fat, 0))
+		return;
+
+	auto length = _buildZIP();
+
+	if (!length || !_writeData(fat, "ARCHIVE.ZIP", _zipBuffer, length)) {
+		fprintf(stderr, "failed to write the ZIP archive\n");
+		_failures++;
+		return;
+	}
+
+	auto file = fat.openFile("ARCHIVE.ZIP", file::READ);
+
+	_beginStep();
+	_endStep("zip-mount", file && zip.init(file));
+
+	// Reading the beginning of a file should only decompress (and thus read
+	// from the drive) as much data as needed. Seeking backwards requires
+	// decompression to be restarted, but must still return the right data.
+	_beginStep();
+	_endStep("zip-prefix-read", _readPrefix(zip, "DATA.BIN", 1000, 7));
+
+	_beginStep();
+	_endStep(
+		"zip-stream-read",
+		_readFile(zip, "DATA.BIN", _ZIP_DATA_LENGTH, 7, 1000)
+	);
+
+	_beginStep();
+	_endStep(
+		"zip-seek",
+		_seekFile(zip, "DATA.BIN", file::READ, _ZIP_DATA_LENGTH, 7)
+	);
+
+	// Looking up nested files and listing directories should be served from
+	// the index built when mounting the archive, without reading anything
+	// from the drive.
+	_beginStep();
+	_endStep("zip-lookup", _lookupZIPFiles(zip));
+
+	_beginStep();
+	_endStep("zip-list", _listZIPDirectories(zip));
+
+	_beginStep();
+	_endStep(
+		"zip-nested-read",
+		_readFile(
+			zip, _zipFileNames[_ZIP_NUM_FILES - 1],
+			_getZIPFileLength(_ZIP_NUM_FILES - 1), 0x1000 + _ZIP_NUM_FILES - 1,
+			_CHUNK_LENGTH
+		)
+	);
+
+	zip.close();
+
+	if (file) {
+		file->close();
+		delete file;
+	}
+
+	fat.close();
+}
+
+/* Main */
+
+int main(int argc, char **argv) {
+	host::IDEDrive drive;
+
+	uint64_t imageLength = 0x4000000;
+	bool     iso         = false, pathTable = true;
+	int      option;
+
+	util::initZipCRC32();
+
+	while ((option = getopt(argc, argv, "z:iTt")) >= 0) {
+		switch (option) {
+			case 'z':
+				imageLength = strtoull(optarg, nullptr, 0) * 1024;
+				break;
+
+			case 'i':
+				iso = true;
+				break;
+
+			case 'T':
+				pathTable = false;
+				break;
+
+			case 't':
+				drive.traceOutput = stderr;
+				break;
+
+			default:
+				fprintf(stderr, _USAGE, argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != (argc - 1)) {
+		fprintf(stderr, _USAGE, argv[0]);
+		return 1;
+	}
+
+	auto path = argv[optind];
+	int  fd   = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0) {
+		fprintf(stderr, "failed to create %s\n", path);
+		return 1;
+	}
+
+	bool success =
+		iso ? _buildISO(fd, pathTable) : !ftruncate(fd, off_t(imageLength));
+
+	close(fd);
+
+	if (!success) {
+		fprintf(stderr, "failed to write %s\n", path);
+		return 1;
+	}
+	if (!drive.open(path, iso, iso)) {
+		fprintf(stderr, "failed to open %s\n", path);
+		return 1;
+	}
+
+	host::ideBus.attach(0, &drive);
+
+	auto &dev  = ide::devices[0];
+	auto error = dev.enumerate();
+
+	if (error) {
+		fprintf(stderr, "enumeration failed: %s\n", ide::getErrorString(error));
+		return 1;
+	}
+
+	dev.resetStats();
+
+	if (iso) {
+		_testISO();
+	} else {
+		_testFAT();
+		_testFATSeek();
+		_testZIP();
+		_testFATDirectory();
+		_testVFS();
+	}
+
+	return _failures ? 1 : 0;
+}
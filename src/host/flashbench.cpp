@@ -0,0 +1,469 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+#include "common/file/file.hpp"
+#include "common/rom.hpp"
+#include "common/romdrivers.hpp"
+#include "common/romwriter.hpp"
+#include "common/util.hpp"
+#include "host/flashemu.hpp"
+#include "ps1/system.h"
+
+/*
+ * Runs the flash drivers against an emulated card through the same region
+ * writer used by the ROM erase and restore workers, reporting the time taken
+ * by each phase in simulated time. Usage:
+ *
+ *   flashbench [options]
+ *
+ * The whole card is erased first, then prefilled so that restoring an image
+ * finds a mix of sectors that already match, sectors that only need to be
+ * programmed and sectors that have to be erased first. The card's contents are
+ * verified against the image afterwards, both in aligned chunks and in spans
+ * crossing each bank boundary.
+ */
+
+static constexpr size_t _VERIFY_CHUNK_LENGTH = 0x8000;
+static constexpr size_t _EDGE_SPAN_OFFSET    = 0x3002;
+static constexpr size_t _EDGE_SPAN_LENGTH    = 0x7ffc;
+
+static const char _USAGE[]{
+	"Usage: %s [options]\n"
+	"\n"
+	"Card options:\n"
+	"  -m TYPE   chip type (am29f016, mbm29f016a, mbm29f017a, am29f040,\n"
+	"            mbm29f040a, 28f016s5, 28f640j5; default am29f016)\n"
+	"  -c COUNT  number of chips, counting 8-bit pairs as one (default 2)\n"
+	"  -f        emulate the onboard flash rather than a PCMCIA card\n"
+	"  -A NS     bus access time\n"
+	"  -P US     program time\n"
+	"  -Q US     write buffer program time\n"
+	"  -X US     sector erase time\n"
+	"  -e OFFSET fail all operations covering the given byte\n"
+	"  -E N      fail every Nth program or erase operation\n"
+	"  -W        write-protect all sectors (or pull VPP low on Intel chips)\n"
+	"  -B        ignore the unlock bypass command\n"
+	"  -t        log all chip operations to stderr\n"
+};
+
+/* Image file */
+
+// Read-only file backed by the image to be restored, standing in for the file
+// the restore worker would open.
+class ImageFile : public file::File {
+private:
+	const uint8_t *_data;
+	uint64_t      _offset;
+
+public:
+	inline ImageFile(const uint8_t *data, size_t length)
+	: _data(data), _offset(0) {
+		size = length;
+	}
+
+	size_t read(void *output, size_t length) {
+		length = size_t(util::min(uint64_t(length), size - _offset));
+
+		__builtin_memcpy(output, &_data[_offset], length);
+		_offset += length;
+		return length;
+	}
+	uint64_t seek(uint64_t offset) {
+		_offset = util::min(offset, size);
+		return _offset;
+	}
+	uint64_t tell(void) const {
+		return _offset;
+	}
+};
+
+/* Benchmark state */
+
+static constexpr int _NUM_STEPS = 3;
+
+static const char *const _STEP_NAMES[_NUM_STEPS]{
+	"restore/compare",
+	"restore/erase",
+	"restore/write"
+};
+
+// Splits the simulated time spent by the region writer across its steps, as
+// reported through the writer's progress callback.
+struct StepTimer {
+public:
+	int      step;
+	uint64_t lastTime, times[_NUM_STEPS];
+};
+
+static uint32_t _randomState = 0x573;
+static uint8_t  _verifyBuffer[_VERIFY_CHUNK_LENGTH]
+	__attribute__((aligned(4)));
+
+static uint32_t _random(void) {
+	_randomState ^= _randomState << 13;
+	_randomState ^= _randomState >> 17;
+	_randomState ^= _randomState << 5;
+	return _randomState;
+}
+
+static void _updateTimer(StepTimer &timer, int step) {
+	uint64_t time = getHostTime();
+
+	if (timer.step >= 0)
+		timer.times[timer.step] += time - timer.lastTime;
+
+	timer.step     = step;
+	timer.lastTime = time;
+}
+
+static void _timerCallback(
+	rom::WriterStep step, size_t part, size_t total, void *arg
+) {
+	_updateTimer(*reinterpret_cast<StepTimer *>(arg), step);
+}
+
+static void _printTime(const char *name, uint64_t time, uint64_t bytes) {
+	double seconds = double(time) / 1.0e9;
+	double rate    = seconds ? (double(bytes) / seconds / 1.0e3) : 0.0;
+
+	printf(
+		"%-16s %10llu bytes, %10.3f ms, %9.3f KB/s\n", name,
+		(unsigned long long) bytes, double(time) / 1.0e6, rate
+	);
+}
+
+static void _printError(rom::DriverError error) {
+	fprintf(stderr, "operation failed: %s\n", rom::getErrorString(error));
+}
+
+/* Workload setup */
+
+// Fills the image to be restored with random data and sets up each sector on
+// the card so that it either has bits that need to be set (and thus has to be
+// erased), only has bits that need to be cleared or already matches the image,
+// cycling through the three states starting from the first one.
+static void _prepareCard(
+	host::FlashCard &card, uint8_t *image, size_t regionLength,
+	size_t chipLength, size_t sectorLength
+) {
+	auto data = card.getData();
+
+	// The region may be shorter than the card's chips (see
+	// FlashRegion::getActualLength()), in which case only part of the last
+	// chip is set up.
+	for (size_t i = 0; i < regionLength; i += sectorLength) {
+		auto state = ((i % chipLength) / sectorLength + i / chipLength + 2) % 3;
+
+		for (size_t j = i; j < (i + sectorLength); j++) {
+			image[j] = uint8_t(_random());
+
+			switch (state) {
+				case rom::SECTOR_MATCH:
+					data[j] = image[j];
+					break;
+
+				case rom::SECTOR_PROGRAM:
+					data[j] = image[j] | uint8_t(_random());
+					break;
+
+				default:
+					data[j] = uint8_t(_random()) | ~image[j];
+			}
+		}
+	}
+}
+
+static uint32_t _verify(
+	const rom::Region &region, const uint8_t *image, size_t regionLength
+) {
+	uint32_t mismatches = 0;
+
+	for (size_t i = 0; i < regionLength; i += _VERIFY_CHUNK_LENGTH) {
+		auto length = util::min(_VERIFY_CHUNK_LENGTH, regionLength - i);
+
+		region.read(_verifyBuffer, i, length);
+
+		if (__builtin_memcmp(_verifyBuffer, &image[i], length))
+			mismatches++;
+	}
+
+	return mismatches;
+}
+
+// Reads and checksums a span straddling each bank boundary, starting and ending
+// at offsets not aligned to banks or chunks, then checksums the whole region in
+// a single call.
+static uint32_t _verifyBankEdges(
+	const rom::FlashRegion &region, const uint8_t *image, size_t regionLength,
+	uint32_t &numSpans
+) {
+	uint32_t mismatches = 0;
+
+	for (
+		size_t edge = rom::FLASH_BANK_LENGTH; edge < regionLength;
+		edge += rom::FLASH_BANK_LENGTH
+	) {
+		auto offset = edge - _EDGE_SPAN_OFFSET;
+		auto length = util::min(_EDGE_SPAN_LENGTH, regionLength - offset);
+
+		region.read(_verifyBuffer, offset, length);
+
+		auto crc = region.zipCRC32(offset, length);
+
+		if (
+			__builtin_memcmp(_verifyBuffer, &image[offset], length) ||
+			(crc != util::zipCRC32(&image[offset], length))
+		)
+			mismatches++;
+
+		numSpans++;
+	}
+
+	auto crc = region.zipCRC32(0, regionLength);
+
+	if (crc != util::zipCRC32(image, regionLength))
+		mismatches++;
+
+	numSpans++;
+	return mismatches;
+}
+
+/* Main */
+
+int main(int argc, char **argv) {
+	host::FlashCard card;
+
+	int  type = host::CHIP_AM29F016, numChips = 2;
+	bool onboard = false, bypass = true;
+	int  access = -1, program = -1, buffer = -1, erase = -1;
+	int  option;
+
+	util::initZipCRC32();
+
+	while ((option = getopt(argc, argv, "m:c:fA:P:Q:X:e:E:WBt")) >= 0) {
+		switch (option) {
+			case 'm':
+				for (type = host::NUM_FLASH_CHIP_TYPES - 1; type >= 0; type--) {
+					if (!strcasecmp(optarg, host::FLASH_CHIP_INFO[type].name))
+						break;
+				}
+
+				if (type < 0) {
+					fprintf(stderr, "unknown chip type: %s\n", optarg);
+					return 1;
+				}
+				break;
+
+			case 'c':
+				numChips = atoi(optarg);
+				break;
+
+			case 'f':
+				onboard = true;
+				break;
+
+			case 'A':
+				access = atoi(optarg);
+				break;
+
+			case 'P':
+				program = atoi(optarg);
+				break;
+
+			case 'Q':
+				buffer = atoi(optarg);
+				break;
+
+			case 'X':
+				erase = atoi(optarg);
+				break;
+
+			case 'e':
+				card.errorOffset = strtoll(optarg, nullptr, 0);
+				break;
+
+			case 'E':
+				card.errorInterval = strtoul(optarg, nullptr, 0);
+				break;
+
+			case 'W':
+				card.writeProtected = true;
+				break;
+
+			case 'B':
+				bypass = false;
+				break;
+
+			case 't':
+				card.traceOutput = stderr;
+				break;
+
+			default:
+				fprintf(stderr, _USAGE, argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc) {
+		fprintf(stderr, _USAGE, argv[0]);
+		return 1;
+	}
+
+	if (!card.init(host::FlashChipType(type), numChips)) {
+		fprintf(stderr, "failed to allocate the card's contents\n");
+		return 1;
+	}
+
+	if (access >= 0)
+		card.accessTime = access;
+	if (program >= 0)
+		card.programTime = program;
+	if (buffer >= 0)
+		card.bufferProgramTime = buffer;
+	if (erase >= 0)
+		card.sectorEraseTime = erase;
+	if (!bypass)
+		card.unlockBypass = false;
+
+	host::flashBus.attach(
+		onboard ? host::SLOT_FLASH : host::SLOT_PCMCIA1, &card
+	);
+
+	auto &region = onboard ? rom::flash : rom::pcmcia[0];
+	auto id      = region.getJEDECID();
+
+	// Mirror how the main app picks the length of the region to operate on,
+	// but never go past the end of the emulated card.
+	size_t regionLength = util::min(
+		onboard ? region.regionLength : region.getActualLength(),
+		card.getLength()
+	);
+	auto   driver       = region.newDriver();
+	size_t chipLength   = driver->getChipSize().chipLength;
+	size_t sectorLength = driver->getChipSize().eraseSectorLength;
+
+	printf(
+		"card: %d x %s, %u bytes, id=0x%08x, detected %u bytes, "
+		"%u byte blocks\n\n",
+		numChips, card.getInfo().name, unsigned(card.getLength()), id,
+		unsigned(regionLength), unsigned(driver->getBlockLength())
+	);
+
+	if (!chipLength) {
+		fprintf(stderr, "chip not recognized by the drivers\n");
+		delete driver;
+		return 1;
+	}
+	if (chipLength != card.getUnitLength()) {
+		fprintf(
+			stderr, "driver chip length (%u) does not match the card's (%u)\n",
+			unsigned(chipLength), unsigned(card.getUnitLength())
+		);
+		delete driver;
+		return 1;
+	}
+
+	auto image = new uint8_t[regionLength];
+
+	StepTimer eraseTimer, restoreTimer;
+
+	util::clear(eraseTimer);
+	util::clear(restoreTimer);
+	eraseTimer.step   = -1;
+	restoreTimer.step = -1;
+
+	rom::RegionWriter eraser(region, *driver, regionLength);
+
+	eraser.callback    = &_timerCallback;
+	eraser.callbackArg = &eraseTimer;
+
+	auto error = eraser.erase();
+
+	_updateTimer(eraseTimer, -1);
+	_prepareCard(card, image, regionLength, chipLength, sectorLength);
+
+	ImageFile         file(image, regionLength);
+	rom::RegionWriter writer(region, *driver, regionLength);
+
+	writer.callback    = &_timerCallback;
+	writer.callbackArg = &restoreTimer;
+
+	if (!error)
+		error = writer.restore(file);
+
+	_updateTimer(restoreTimer, -1);
+
+	// Deleting the driver also takes the chips out of bulk write mode, which
+	// must happen before their contents can be read back.
+	delete driver;
+
+	if (error)
+		_printError(error);
+
+	_printTime(
+		"erase", eraseTimer.times[rom::WRITER_ERASE],
+		eraser.sectorsErased * sectorLength
+	);
+
+	uint64_t restoreBytes[_NUM_STEPS]{
+		regionLength,
+		writer.sectorsErased * sectorLength,
+		writer.bytesWritten
+	};
+
+	for (int i = 0; i < _NUM_STEPS; i++)
+		_printTime(_STEP_NAMES[i], restoreTimer.times[i], restoreBytes[i]);
+
+	auto mismatches = error ? 0 : _verify(region, image, regionLength);
+
+	if (mismatches)
+		fprintf(stderr, "%u chunks failed verification\n", mismatches);
+
+	uint32_t numSpans = 0;
+
+	host::flashBus.bankSwitches = 0;
+
+	auto edgeMismatches =
+		error ? 0 : _verifyBankEdges(region, image, regionLength, numSpans);
+
+	if (edgeMismatches)
+		fprintf(stderr, "%u spans failed verification\n", edgeMismatches);
+
+	auto &stats = card.stats;
+
+	printf(
+		"\nsectors: %u skipped, %u programmed, %u erased\n"
+		"bank edges: %u spans, %u bank switches\n"
+		"bus: %llu reads, %llu writes\n"
+		"chips: %u programs, %u buffer programs, %u sector erases, "
+		"%u chip erases, %u failures\n",
+		unsigned(writer.sectorsSkipped), unsigned(writer.sectorsProgrammed),
+		unsigned(writer.sectorsErased), numSpans,
+		host::flashBus.bankSwitches, (unsigned long long) stats.reads,
+		(unsigned long long) stats.writes, stats.programs,
+		stats.bufferPrograms, stats.sectorErases, stats.chipErases,
+		stats.failures
+	);
+
+	delete[] image;
+	return (error || mismatches || edgeMismatches) ? 1 : 0;
+}
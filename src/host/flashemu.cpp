@@ -0,0 +1,956 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "common/io.hpp"
+#include "common/rom.hpp"
+#include "common/util.hpp"
+#include "host/flashemu.hpp"
+#include "ps1/registers573.h"
+#include "ps1/system.h"
+
+namespace host {
+
+/* Register proxies */
+
+FlashBus      flashBus;
+FlashRegister flashRegisters[FLASH_WINDOW_LENGTH / 2];
+BankRegister  bankCtrlRegister;
+
+// All inputs are active-low and thus idle high, with no PCMCIA cards inserted.
+InputRegister miscInRegister{ 0xffff }, jammaMainRegister{ 0xffff };
+InputRegister jammaExt1Register{ 0xffff }, jammaExt2Register{ 0xffff };
+
+// The RTC is stopped at midnight on Monday, 1 January 2024 (all fields BCD).
+uint16_t rtcRegisters[8]{ 0x00, 0x00, 0x00, 0x00, 0x02, 0x01, 0x01, 0x24 };
+
+FlashRegister::operator uint16_t(void) const {
+	return flashBus.read(uint32_t(this - flashRegisters) * 2);
+}
+
+FlashRegister &FlashRegister::operator=(uint16_t value) {
+	flashBus.write(uint32_t(this - flashRegisters) * 2, value);
+	return *this;
+}
+
+BankRegister::operator uint16_t(void) const {
+	return flashBus.getBankCtrl();
+}
+
+BankRegister &BankRegister::operator=(uint16_t value) {
+	flashBus.setBankCtrl(value);
+	return *this;
+}
+
+/* Chip models */
+
+const FlashChipInfo FLASH_CHIP_INFO[NUM_FLASH_CHIP_TYPES]{
+	{
+		.name              = "AM29F016",
+		.manufacturerID    = 0x01,
+		.deviceID          = 0xad,
+		.intel             = false,
+		.wide              = false,
+		.unlockBypass      = true,
+		.chipLength        = 0x200000,
+		.sectorLength      = 0x10000,
+		.bufferLength      = 0,
+		.programTime       = 7,
+		.bufferProgramTime = 0,
+		.sectorEraseTime   = 1000000,
+		.chipEraseTime     = 25000000
+	}, {
+		.name              = "MBM29F016A",
+		.manufacturerID    = 0x04,
+		.deviceID          = 0xad,
+		.intel             = false,
+		.wide              = false,
+		.unlockBypass      = false,
+		.chipLength        = 0x200000,
+		.sectorLength      = 0x10000,
+		.bufferLength      = 0,
+		.programTime       = 8,
+		.bufferProgramTime = 0,
+		.sectorEraseTime   = 1000000,
+		.chipEraseTime     = 32000000
+	}, {
+		.name              = "MBM29F017A",
+		.manufacturerID    = 0x04,
+		.deviceID          = 0x3d,
+		.intel             = false,
+		.wide              = false,
+		.unlockBypass      = false,
+		.chipLength        = 0x200000,
+		.sectorLength      = 0x10000,
+		.bufferLength      = 0,
+		.programTime       = 8,
+		.bufferProgramTime = 0,
+		.sectorEraseTime   = 1000000,
+		.chipEraseTime     = 32000000
+	}, {
+		.name              = "AM29F040",
+		.manufacturerID    = 0x01,
+		.deviceID          = 0xa4,
+		.intel             = false,
+		.wide              = false,
+		.unlockBypass      = false,
+		.chipLength        = 0x80000,
+		.sectorLength      = 0x10000,
+		.bufferLength      = 0,
+		.programTime       = 7,
+		.bufferProgramTime = 0,
+		.sectorEraseTime   = 1000000,
+		.chipEraseTime     = 8000000
+	}, {
+		.name              = "MBM29F040A",
+		.manufacturerID    = 0x04,
+		.deviceID          = 0xa4,
+		.intel             = false,
+		.wide              = false,
+		.unlockBypass      = false,
+		.chipLength        = 0x80000,
+		.sectorLength      = 0x10000,
+		.bufferLength      = 0,
+		.programTime       = 8,
+		.bufferProgramTime = 0,
+		.sectorEraseTime   = 1000000,
+		.chipEraseTime     = 8000000
+	}, {
+		.name              = "28F016S5",
+		.manufacturerID    = 0x89,
+		.deviceID          = 0xaa,
+		.intel             = true,
+		.wide              = false,
+		.unlockBypass      = false,
+		.chipLength        = 0x200000,
+		.sectorLength      = 0x10000,
+		.bufferLength      = 0,
+		.programTime       = 6,
+		.bufferProgramTime = 0,
+		.sectorEraseTime   = 600000,
+		.chipEraseTime     = 0
+	}, {
+		.name              = "28F640J5",
+		.manufacturerID    = 0x89,
+		.deviceID          = 0x15,
+		.intel             = true,
+		.wide              = true,
+		.unlockBypass      = false,
+		.chipLength        = 0x800000,
+		.sectorLength      = 0x20000,
+		.bufferLength      = 32,
+		.programTime       = 210,
+		.bufferProgramTime = 218,
+		.sectorEraseTime   = 1000000,
+		.chipEraseTime     = 0
+	}
+};
+
+/* Command and status definitions */
+
+// These are deliberately not shared with the drivers, so that the emulated
+// chips follow the datasheets rather than the drivers' own assumptions.
+enum JEDECChipCommand : uint8_t {
+	_JEDEC_RESET         = 0xf0,
+	_JEDEC_UNLOCK1       = 0xaa,
+	_JEDEC_UNLOCK2       = 0x55,
+	_JEDEC_AUTOSELECT    = 0x90,
+	_JEDEC_PROGRAM       = 0xa0,
+	_JEDEC_ERASE         = 0x80,
+	_JEDEC_CHIP_ERASE    = 0x10,
+	_JEDEC_SECTOR_ERASE  = 0x30,
+	_JEDEC_UNLOCK_BYPASS = 0x20,
+	_JEDEC_BYPASS_RESET1 = 0x90,
+	_JEDEC_BYPASS_RESET2 = 0x00
+};
+
+enum JEDECChipStatus : uint8_t {
+	_JEDEC_DQ2 = 1 << 2, // Toggles when reading a sector being erased
+	_JEDEC_DQ3 = 1 << 3, // Set once an erase operation has started
+	_JEDEC_DQ5 = 1 << 5, // Set if the operation exceeded its time limit
+	_JEDEC_DQ6 = 1 << 6, // Toggles on each read while busy
+	_JEDEC_DQ7 = 1 << 7  // Complement of the data being programmed
+};
+
+enum IntelChipCommand : uint8_t {
+	_INTEL_READ_ARRAY   = 0xff,
+	_INTEL_READ_ID      = 0x90,
+	_INTEL_READ_STATUS  = 0x70,
+	_INTEL_CLEAR_STATUS = 0x50,
+	_INTEL_PROGRAM      = 0x40,
+	_INTEL_PROGRAM_ALT  = 0x10,
+	_INTEL_ERASE        = 0x20,
+	_INTEL_CONFIRM      = 0xd0,
+	_INTEL_WRITE_BUFFER = 0xe8
+};
+
+enum IntelChipStatus : uint8_t {
+	_INTEL_SR1 = 1 << 1, // Block locked
+	_INTEL_SR3 = 1 << 3, // VPP too low
+	_INTEL_SR4 = 1 << 4, // Program error
+	_INTEL_SR5 = 1 << 5, // Erase error
+	_INTEL_SR7 = 1 << 7  // Write state machine ready
+};
+
+static constexpr uint32_t _UNLOCK_ADDR_MASK = 0x7ff;
+static constexpr uint32_t _UNLOCK_ADDR1     = 0x555;
+static constexpr uint32_t _UNLOCK_ADDR2     = 0x2aa;
+
+// Writes to sectors protected on JEDEC chips are ignored, but the chip still
+// goes busy for a short time before returning to read mode.
+static constexpr int _PROTECTED_PROGRAM_TIME = 1;
+static constexpr int _PROTECTED_ERASE_TIME   = 100;
+
+static constexpr int _DEFAULT_ACCESS_TIME = 500;
+
+/* Emulated chip */
+
+FlashChip::FlashChip(void)
+: _card(nullptr), _info(nullptr), _data(nullptr), _index(0) {
+	reset();
+}
+
+void FlashChip::_trace(const char *format, ...) const {
+	if (!_card->traceOutput)
+		return;
+
+	va_list ap;
+
+	fprintf(
+		_card->traceOutput, "[%12.3f ms] flash%d: ",
+		double(getHostTime()) / 1.0e6, _index
+	);
+	va_start(ap, format);
+	vfprintf(_card->traceOutput, format, ap);
+	va_end(ap);
+	fputc('\n', _card->traceOutput);
+}
+
+uint16_t FlashChip::_getWord(uint32_t addr) const {
+	if (_info->wide)
+		return reinterpret_cast<const uint16_t *>(_data)[addr];
+	else
+		return _data[addr * 2];
+}
+
+void FlashChip::_setWord(uint32_t addr, uint16_t value) {
+	if (_info->wide)
+		reinterpret_cast<uint16_t *>(_data)[addr] = value;
+	else
+		_data[addr * 2] = value & 0xff;
+}
+
+bool FlashChip::_isUnlockAddress(uint32_t addr, uint32_t expected) const {
+	// Only the lowest 11 address lines are decoded when checking command
+	// addresses, so both 0x555/0x2aa and 0x5555/0x2aaa are accepted.
+	return ((addr & _UNLOCK_ADDR_MASK) == expected);
+}
+
+uint32_t FlashChip::_getCardOffset(uint32_t addr) const {
+	// Each chip's data is interleaved with the other chip in the pair (if
+	// any), so addresses are always multiplied by 2.
+	return uint32_t(_data - _card->_data) + addr * 2;
+}
+
+void FlashChip::_start(
+	FlashOperation op, uint32_t addr, uint32_t length, int time
+) {
+	_mode      = MODE_BUSY;
+	_operation = op;
+	_opAddress = addr;
+	_opLength  = length;
+	_readyTime = getHostTime() + uint64_t(util::max(time, 0)) * 1000;
+	_protected = false;
+	_failed    = _card->_checkFault(_getCardOffset(addr), length * 2);
+
+	switch (op) {
+		case OP_PROGRAM:
+			_card->stats.programs++;
+			break;
+
+		case OP_BUFFER_PROGRAM:
+			_card->stats.bufferPrograms++;
+			break;
+
+		case OP_ERASE_SECTOR:
+			_card->stats.sectorErases++;
+			break;
+
+		case OP_ERASE_CHIP:
+			_card->stats.chipErases++;
+			break;
+
+		default:
+			break;
+	}
+
+	// Protected sectors on JEDEC chips are handled here, while Intel chips
+	// never start the operation at all if VPP is too low.
+	if (_card->writeProtected) {
+		_protected = true;
+		_failed    = false;
+		_readyTime = getHostTime() + 1000 * (
+			(op == OP_PROGRAM) ? _PROTECTED_PROGRAM_TIME : _PROTECTED_ERASE_TIME
+		);
+	}
+
+	_status &= ~_INTEL_SR7;
+
+	_trace(
+		"op %d start, addr=0x%06x, len=0x%x%s", op, addr, length,
+		_failed ? " (will fail)" : ""
+	);
+}
+
+void FlashChip::_complete(void) {
+	if (!_protected && !_failed) {
+		switch (_operation) {
+			case OP_PROGRAM:
+				_setWord(_opAddress, _getWord(_opAddress) & _opValue);
+				break;
+
+			case OP_BUFFER_PROGRAM:
+				for (int i = 0; i < _bufferCount; i++) {
+					uint32_t addr = _bufferAddress + i;
+
+					_setWord(addr, _getWord(addr) & _buffer[i]);
+				}
+				break;
+
+			case OP_ERASE_SECTOR:
+			case OP_ERASE_CHIP:
+				for (uint32_t i = 0; i < _opLength; i++)
+					_setWord(_opAddress + i, 0xffff);
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	if (_failed)
+		_card->stats.failures++;
+
+	_trace(
+		"op %d %s", _operation,
+		_protected ? "ignored" : (_failed ? "failed" : "done")
+	);
+
+	if (_info->intel) {
+		_mode    = MODE_READ_STATUS;
+		_status |= _INTEL_SR7;
+
+		if (_failed)
+			_status |= (_operation >= OP_ERASE_SECTOR)
+				? _INTEL_SR5
+				: _INTEL_SR4;
+	} else {
+		// JEDEC chips stay busy with DQ5 set until reset after a failure.
+		_mode = _failed ? MODE_FAILED : MODE_READ_ARRAY;
+	}
+
+	if (_mode != MODE_FAILED)
+		_operation = OP_NONE;
+}
+
+void FlashChip::_sequenceError(void) {
+	// Improper command sequences set both error flags on Intel chips.
+	_mode    = MODE_READ_STATUS;
+	_status |= _INTEL_SR4 | _INTEL_SR5;
+
+	_trace("command sequence error");
+}
+
+uint16_t FlashChip::_jedecRead(uint32_t addr) {
+	switch (_mode) {
+		case MODE_ID:
+			// Address bit 1 selects the sector protection status, which is
+			// always reported as unprotected.
+			switch (addr & 3) {
+				case 0:
+					return _info->manufacturerID;
+
+				case 1:
+					return _info->deviceID;
+
+				default:
+					return 0;
+			}
+
+		case MODE_BUSY:
+		case MODE_FAILED: {
+			uint8_t status = 0;
+
+			_toggle = !_toggle;
+
+			if (_toggle)
+				status |= _JEDEC_DQ6;
+			if (_mode == MODE_FAILED)
+				status |= _JEDEC_DQ5;
+
+			if (_operation == OP_PROGRAM) {
+				status |= ~_opValue & _JEDEC_DQ7;
+			} else {
+				status |= _JEDEC_DQ3;
+
+				if (
+					_toggle && (addr >= _opAddress) &&
+					(addr < (_opAddress + _opLength))
+				)
+					status |= _JEDEC_DQ2;
+			}
+
+			return status;
+		}
+
+		default:
+			return _getWord(addr);
+	}
+}
+
+void FlashChip::_jedecWrite(uint32_t addr, uint8_t value) {
+	auto sectorWords = uint32_t(_info->sectorLength);
+	auto chipWords   = uint32_t(_info->chipLength);
+
+	switch (_mode) {
+		case MODE_BUSY:
+			// Erase suspend is not emulated.
+			break;
+
+		case MODE_FAILED:
+			// Resetting the chip returns it to the mode it was in prior to the
+			// failed operation (which may be unlock bypass mode).
+			if (value == _JEDEC_RESET) {
+				_mode      = MODE_READ_ARRAY;
+				_operation = OP_NONE;
+			}
+			break;
+
+		case MODE_PROGRAM_SETUP:
+			_opValue = value;
+			_start(OP_PROGRAM, addr, 1, _card->programTime);
+
+			// Attempting to change a bit from 0 to 1 makes the chip time out,
+			// as the bit never reads back as programmed.
+			if (value & ~_getWord(addr))
+				_failed = !_protected;
+			break;
+
+		case MODE_UNLOCK1:
+			if (
+				(value == _JEDEC_UNLOCK2) &&
+				_isUnlockAddress(addr, _UNLOCK_ADDR2)
+			)
+				_mode = MODE_UNLOCK2;
+			else
+				_mode = MODE_READ_ARRAY;
+			break;
+
+		case MODE_UNLOCK2:
+			_mode = MODE_READ_ARRAY;
+
+			if (!_isUnlockAddress(addr, _UNLOCK_ADDR1))
+				break;
+
+			switch (value) {
+				case _JEDEC_AUTOSELECT:
+					_mode = MODE_ID;
+					break;
+
+				case _JEDEC_PROGRAM:
+					_mode = MODE_PROGRAM_SETUP;
+					break;
+
+				case _JEDEC_ERASE:
+					_mode = MODE_ERASE_SETUP;
+					break;
+
+				case _JEDEC_UNLOCK_BYPASS:
+					if (_card->unlockBypass) {
+						_bypass = true;
+						_trace("entered unlock bypass");
+					}
+					break;
+			}
+			break;
+
+		case MODE_ERASE_SETUP:
+			if (
+				(value == _JEDEC_UNLOCK1) &&
+				_isUnlockAddress(addr, _UNLOCK_ADDR1)
+			)
+				_mode = MODE_ERASE_UNLOCK1;
+			else
+				_mode = MODE_READ_ARRAY;
+			break;
+
+		case MODE_ERASE_UNLOCK1:
+			if (
+				(value == _JEDEC_UNLOCK2) &&
+				_isUnlockAddress(addr, _UNLOCK_ADDR2)
+			)
+				_mode = MODE_ERASE_UNLOCK2;
+			else
+				_mode = MODE_READ_ARRAY;
+			break;
+
+		case MODE_ERASE_UNLOCK2:
+			if (
+				(value == _JEDEC_CHIP_ERASE) &&
+				_isUnlockAddress(addr, _UNLOCK_ADDR1)
+			)
+				_start(OP_ERASE_CHIP, 0, chipWords, _card->chipEraseTime);
+			else if (value == _JEDEC_SECTOR_ERASE)
+				_start(
+					OP_ERASE_SECTOR, addr - (addr % sectorWords), sectorWords,
+					_card->sectorEraseTime
+				);
+			else
+				_mode = MODE_READ_ARRAY;
+			break;
+
+		case MODE_BYPASS_RESET:
+			_mode = MODE_READ_ARRAY;
+
+			if (value == _JEDEC_BYPASS_RESET2) {
+				_bypass = false;
+				_trace("exited unlock bypass");
+			}
+			break;
+
+		default:
+			// In unlock bypass mode the program command can be issued at any
+			// address without a handshake, and the reset command is ignored.
+			if (_bypass) {
+				if (value == _JEDEC_PROGRAM)
+					_mode = MODE_PROGRAM_SETUP;
+				else if (value == _JEDEC_BYPASS_RESET1)
+					_mode = MODE_BYPASS_RESET;
+				break;
+			}
+
+			if (value == _JEDEC_RESET)
+				_mode = MODE_READ_ARRAY;
+			else if (
+				(_mode == MODE_READ_ARRAY) && (value == _JEDEC_UNLOCK1) &&
+				_isUnlockAddress(addr, _UNLOCK_ADDR1)
+			)
+				_mode = MODE_UNLOCK1;
+			break;
+	}
+}
+
+uint16_t FlashChip::_intelRead(uint32_t addr) {
+	switch (_mode) {
+		case MODE_READ_ARRAY:
+			return _getWord(addr);
+
+		case MODE_ID:
+			return (addr & 1) ? _info->deviceID : _info->manufacturerID;
+
+		case MODE_BUFFER_COUNT:
+			// The extended status register is returned after a write to buffer
+			// command, with bit 7 signalling that the buffer is available
+			// (which it always is here).
+			return _INTEL_SR7;
+
+		case MODE_BUSY:
+			return _status & ~_INTEL_SR7;
+
+		default:
+			return _status;
+	}
+}
+
+void FlashChip::_intelWrite(uint32_t addr, uint16_t value) {
+	int     shift       = _info->wide ? 1 : 0;
+	auto    sectorWords = uint32_t(_info->sectorLength >> shift);
+	auto    bufferWords = uint32_t(_info->bufferLength >> shift);
+	uint8_t command     = value & 0xff;
+
+	if (!_info->wide)
+		value &= 0xff;
+
+	switch (_mode) {
+		case MODE_BUSY:
+			// Suspending operations is not emulated, and reading the status
+			// register is always possible while busy.
+			break;
+
+		case MODE_PROGRAM_SETUP:
+			if (_card->writeProtected) {
+				_mode    = MODE_READ_STATUS;
+				_status |= _INTEL_SR3 | _INTEL_SR4;
+				_card->stats.failures++;
+				break;
+			}
+
+			_opValue = value;
+			_start(OP_PROGRAM, addr, 1, _card->programTime);
+			break;
+
+		case MODE_ERASE_SETUP:
+			if (command != _INTEL_CONFIRM) {
+				_sequenceError();
+				break;
+			}
+			if (_card->writeProtected) {
+				_mode    = MODE_READ_STATUS;
+				_status |= _INTEL_SR3 | _INTEL_SR5;
+				_card->stats.failures++;
+				break;
+			}
+
+			_start(
+				OP_ERASE_SECTOR, addr - (addr % sectorWords), sectorWords,
+				_card->sectorEraseTime
+			);
+			break;
+
+		case MODE_BUFFER_COUNT:
+			_bufferCount = command + 1;
+			_bufferIndex = 0;
+
+			if (uint32_t(_bufferCount) > bufferWords) {
+				_sequenceError();
+				break;
+			}
+
+			for (auto &word : _buffer)
+				word = 0xffff;
+
+			_mode = MODE_BUFFER_DATA;
+			break;
+
+		case MODE_BUFFER_DATA:
+			// All data must fall within the buffer's aligned address range.
+			if ((addr - _bufferAddress) >= bufferWords) {
+				_sequenceError();
+				break;
+			}
+
+			_buffer[addr - _bufferAddress] = value;
+
+			if (++_bufferIndex >= _bufferCount)
+				_mode = MODE_BUFFER_CONFIRM;
+			break;
+
+		case MODE_BUFFER_CONFIRM:
+			if (command != _INTEL_CONFIRM) {
+				_sequenceError();
+				break;
+			}
+			if (_card->writeProtected) {
+				_mode    = MODE_READ_STATUS;
+				_status |= _INTEL_SR3 | _INTEL_SR4;
+				_card->stats.failures++;
+				break;
+			}
+
+			// The buffer is always programmed in its entirety, so words that
+			// were not loaded are left as 0xffff (i.e. unchanged).
+			_bufferCount = int(bufferWords);
+			_start(
+				OP_BUFFER_PROGRAM, _bufferAddress, bufferWords,
+				_card->bufferProgramTime
+			);
+			break;
+
+		default:
+			switch (command) {
+				case _INTEL_READ_ID:
+					_mode = MODE_ID;
+					break;
+
+				case _INTEL_READ_STATUS:
+					_mode = MODE_READ_STATUS;
+					break;
+
+				case _INTEL_CLEAR_STATUS:
+					_status &= ~(
+						_INTEL_SR1 | _INTEL_SR3 | _INTEL_SR4 | _INTEL_SR5
+					);
+					break;
+
+				case _INTEL_PROGRAM:
+				case _INTEL_PROGRAM_ALT:
+					_mode = MODE_PROGRAM_SETUP;
+					break;
+
+				case _INTEL_ERASE:
+					_mode = MODE_ERASE_SETUP;
+					break;
+
+				case _INTEL_WRITE_BUFFER:
+					if (bufferWords) {
+						_mode          = MODE_BUFFER_COUNT;
+						_bufferAddress = addr - (addr % bufferWords);
+						break;
+					}
+					[[fallthrough]];
+
+				default:
+					// Any unrecognized command (including JEDEC commands sent
+					// while probing) returns the chip to read array mode.
+					_mode = MODE_READ_ARRAY;
+					break;
+			}
+			break;
+	}
+}
+
+void FlashChip::init(FlashCard &card, uint8_t *data, int index) {
+	_card  = &card;
+	_info  = card._info;
+	_data  = data;
+	_index = index;
+
+	reset();
+}
+
+void FlashChip::reset(void) {
+	_mode      = MODE_READ_ARRAY;
+	_operation = OP_NONE;
+	_bypass    = false;
+	_failed    = false;
+	_protected = false;
+	_toggle    = false;
+	_status    = _INTEL_SR7;
+	_readyTime = 0;
+
+	_opAddress     = 0;
+	_opLength      = 0;
+	_opValue       = 0;
+	_bufferAddress = 0;
+	_bufferCount   = 0;
+	_bufferIndex   = 0;
+}
+
+void FlashChip::update(void) {
+	if ((_mode != MODE_BUSY) || (getHostTime() < _readyTime))
+		return;
+
+	_complete();
+}
+
+uint16_t FlashChip::read(uint32_t addr) {
+	update();
+
+	return _info->intel ? _intelRead(addr) : _jedecRead(addr);
+}
+
+void FlashChip::write(uint32_t addr, uint16_t value) {
+	update();
+
+	if (_info->intel)
+		_intelWrite(addr, value);
+	else
+		_jedecWrite(addr, value & 0xff);
+}
+
+/* Emulated card */
+
+FlashCard::FlashCard(void)
+:
+_info(&FLASH_CHIP_INFO[0]), _data(nullptr), _length(0), _unitLength(0),
+_numChips(0), _lanes(1), _chips(nullptr), _numOperations(0), programTime(0),
+bufferProgramTime(0), sectorEraseTime(0), chipEraseTime(0),
+accessTime(_DEFAULT_ACCESS_TIME), errorOffset(-1), errorInterval(0),
+writeProtected(false), unlockBypass(false), traceOutput(nullptr) {
+	util::clear(stats);
+}
+
+FlashCard::~FlashCard(void) {
+	release();
+}
+
+bool FlashCard::_checkFault(uint32_t offset, size_t length) {
+	_numOperations++;
+
+	if (errorInterval && !(_numOperations % errorInterval))
+		return true;
+	if (errorOffset < 0)
+		return false;
+
+	// Both chips in a pair are covered by the same offset range, so the fault
+	// is only injected into the chip on the respective half of the bus.
+	auto target = uint64_t(errorOffset);
+
+	if (!_info->wide && ((target ^ offset) & 1))
+		return false;
+
+	return (target >= offset) && (target < (offset + length));
+}
+
+bool FlashCard::init(FlashChipType type, int numUnits) {
+	release();
+
+	if ((type < 0) || (type >= NUM_FLASH_CHIP_TYPES) || (numUnits <= 0))
+		return false;
+
+	_info       = &FLASH_CHIP_INFO[type];
+	_lanes      = _info->wide ? 1 : 2;
+	_unitLength = _info->chipLength * _lanes;
+	_length     = _unitLength * numUnits;
+	_numChips   = numUnits * _lanes;
+
+	_data  = new uint8_t[_length];
+	_chips = new FlashChip[_numChips];
+
+	__builtin_memset(_data, 0xff, _length);
+
+	for (int i = 0; i < _numChips; i++)
+		_chips[i].init(
+			*this, &_data[(i / _lanes) * _unitLength + (i % _lanes)], i
+		);
+
+	programTime       = _info->programTime;
+	bufferProgramTime = _info->bufferProgramTime;
+	sectorEraseTime   = _info->sectorEraseTime;
+	chipEraseTime     = _info->chipEraseTime;
+	unlockBypass      = _info->unlockBypass;
+	_numOperations    = 0;
+
+	util::clear(stats);
+	return true;
+}
+
+void FlashCard::release(void) {
+	if (_data) {
+		delete[] _data;
+		_data = nullptr;
+	}
+	if (_chips) {
+		delete[] _chips;
+		_chips = nullptr;
+	}
+
+	_length   = 0;
+	_numChips = 0;
+}
+
+uint16_t FlashCard::read(uint32_t offset) {
+	stats.reads++;
+
+	uint32_t ptr  = offset % _length;
+	uint32_t unit = ptr / _unitLength;
+	uint32_t addr = (ptr % _unitLength) / 2;
+
+	// 8-bit chips each drive one half of the bus, while 16-bit chips return
+	// both bytes at once.
+	if (_info->wide)
+		return _chips[unit].read(addr);
+
+	uint16_t low  = _chips[unit * 2 + 0].read(addr) & 0xff;
+	uint16_t high = _chips[unit * 2 + 1].read(addr) & 0xff;
+
+	return low | (high << 8);
+}
+
+void FlashCard::write(uint32_t offset, uint16_t value) {
+	stats.writes++;
+
+	uint32_t ptr  = offset % _length;
+	uint32_t unit = ptr / _unitLength;
+	uint32_t addr = (ptr % _unitLength) / 2;
+
+	if (_info->wide) {
+		_chips[unit].write(addr, value);
+	} else {
+		_chips[unit * 2 + 0].write(addr, value & 0xff);
+		_chips[unit * 2 + 1].write(addr, value >> 8);
+	}
+}
+
+/* Emulated bus */
+
+static constexpr int _BANK_MASK      = 0x3f;
+static constexpr int _BANKS_PER_SLOT = 16;
+
+// The card detection inputs are active-low and read through SYS573_MISC_IN.
+static const uint16_t _CARD_DETECT_BITS[]{
+	0,
+	io::JAMMA_PCMCIA_CD1 >> 16,
+	io::JAMMA_PCMCIA_CD2 >> 16
+};
+
+FlashBus::FlashBus(void)
+: _bankCtrl(0), bankSwitches(0) {
+	for (auto &card : cards)
+		card = nullptr;
+}
+
+FlashCard *FlashBus::_getCard(uint32_t &offset) const {
+	int bank = _bankCtrl & _BANK_MASK;
+	int slot = bank / _BANKS_PER_SLOT;
+
+	if (slot >= int(util::countOf(cards)))
+		return nullptr;
+
+	auto card = cards[slot];
+
+	if (!card || !card->getLength())
+		return nullptr;
+
+	size_t ptr = (bank % _BANKS_PER_SLOT) * rom::FLASH_BANK_LENGTH + offset;
+	offset     = uint32_t(ptr % card->getLength());
+
+	return card;
+}
+
+void FlashBus::attach(FlashSlot slot, FlashCard *card) {
+	cards[slot] = card;
+
+	auto bit = _CARD_DETECT_BITS[slot];
+
+	if (!bit)
+		return;
+
+	if (card)
+		miscInRegister.value &= ~bit;
+	else
+		miscInRegister.value |= bit;
+}
+
+uint16_t FlashBus::read(uint32_t offset) {
+	auto card = _getCard(offset);
+
+	// With no card present, the bus floats high.
+	if (!card) {
+		advanceHostTime(_DEFAULT_ACCESS_TIME);
+		return 0xffff;
+	}
+
+	advanceHostTime(card->accessTime);
+	return card->read(offset);
+}
+
+void FlashBus::write(uint32_t offset, uint16_t value) {
+	auto card = _getCard(offset);
+
+	if (!card) {
+		advanceHostTime(_DEFAULT_ACCESS_TIME);
+		return;
+	}
+
+	advanceHostTime(card->accessTime);
+	card->write(offset, value);
+}
+
+}
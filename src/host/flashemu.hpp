@@ -0,0 +1,258 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace host {
+
+/* Chip models */
+
+enum FlashChipType {
+	CHIP_AM29F016   = 0,
+	CHIP_MBM29F016A = 1,
+	CHIP_MBM29F017A = 2,
+	CHIP_AM29F040   = 3,
+	CHIP_MBM29F040A = 4,
+	CHIP_28F016S5   = 5,
+	CHIP_28F640J5   = 6
+};
+
+// All lengths are in bytes and all timings are typical values (from the
+// respective datasheets) in microseconds. 8-bit chips are always emulated in
+// pairs, one on each half of the 16-bit bus.
+struct FlashChipInfo {
+public:
+	const char *name;
+	uint8_t    manufacturerID, deviceID;
+	bool       intel, wide, unlockBypass;
+
+	size_t chipLength, sectorLength, bufferLength;
+	int    programTime, bufferProgramTime, sectorEraseTime, chipEraseTime;
+};
+
+static constexpr int NUM_FLASH_CHIP_TYPES = 7;
+
+extern const FlashChipInfo FLASH_CHIP_INFO[NUM_FLASH_CHIP_TYPES];
+
+/* Emulated chip */
+
+enum FlashChipMode {
+	MODE_READ_ARRAY     =  0,
+	MODE_UNLOCK1        =  1,
+	MODE_UNLOCK2        =  2,
+	MODE_ID             =  3,
+	MODE_PROGRAM_SETUP  =  4,
+	MODE_ERASE_SETUP    =  5,
+	MODE_ERASE_UNLOCK1  =  6,
+	MODE_ERASE_UNLOCK2  =  7,
+	MODE_BYPASS_RESET   =  8,
+	MODE_READ_STATUS    =  9,
+	MODE_BUFFER_COUNT   = 10,
+	MODE_BUFFER_DATA    = 11,
+	MODE_BUFFER_CONFIRM = 12,
+	MODE_BUSY           = 13,
+	MODE_FAILED         = 14
+};
+
+enum FlashOperation {
+	OP_NONE           = 0,
+	OP_PROGRAM        = 1,
+	OP_BUFFER_PROGRAM = 2,
+	OP_ERASE_SECTOR   = 3,
+	OP_ERASE_CHIP     = 4
+};
+
+static constexpr int MAX_BUFFER_WORDS = 32;
+
+class FlashCard;
+
+// Command-level model of a single JEDEC (AMD/Fujitsu) or Intel flash chip.
+// Addresses are in units of the chip's data bus width, i.e. bytes for 8-bit
+// chips and halfwords for 16-bit ones. Like the emulated IDE drives, chips are
+// updated lazily: program and erase operations only complete once the chip is
+// accessed after the respective latency has elapsed.
+class FlashChip {
+private:
+	FlashCard           *_card;
+	const FlashChipInfo *_info;
+	uint8_t             *_data;
+	int                 _index;
+
+	FlashChipMode  _mode;
+	FlashOperation _operation;
+	bool           _bypass, _failed, _protected, _toggle;
+	uint8_t        _status;
+
+	uint64_t _readyTime;
+	uint32_t _opAddress, _opLength;
+	uint16_t _opValue;
+
+	uint32_t _bufferAddress;
+	int      _bufferCount, _bufferIndex;
+	uint16_t _buffer[MAX_BUFFER_WORDS];
+
+	void _trace(const char *format, ...) const;
+
+	uint16_t _getWord(uint32_t addr) const;
+	void _setWord(uint32_t addr, uint16_t value);
+	bool _isUnlockAddress(uint32_t addr, uint32_t expected) const;
+	uint32_t _getCardOffset(uint32_t addr) const;
+
+	void _start(FlashOperation op, uint32_t addr, uint32_t length, int time);
+	void _complete(void);
+	void _sequenceError(void);
+
+	uint16_t _jedecRead(uint32_t addr);
+	void _jedecWrite(uint32_t addr, uint8_t value);
+	uint16_t _intelRead(uint32_t addr);
+	void _intelWrite(uint32_t addr, uint16_t value);
+
+public:
+	FlashChip(void);
+
+	void init(FlashCard &card, uint8_t *data, int index);
+	void reset(void);
+	void update(void);
+
+	inline FlashChipMode getMode(void) const {
+		return _mode;
+	}
+	inline bool isBypassEnabled(void) const {
+		return _bypass;
+	}
+
+	uint16_t read(uint32_t addr);
+	void write(uint32_t addr, uint16_t value);
+};
+
+/* Emulated card */
+
+struct FlashCardStats {
+public:
+	uint64_t reads, writes;
+	uint32_t programs, bufferPrograms, sectorErases, chipErases, failures;
+};
+
+// A set of identical chips occupying a contiguous address range, i.e. the
+// onboard flash or a PCMCIA card. The card's contents are kept in host memory
+// and can be accessed directly through getData() without going through the
+// emulated chips.
+class FlashCard {
+	friend class FlashChip;
+
+private:
+	const FlashChipInfo *_info;
+	uint8_t             *_data;
+	size_t              _length, _unitLength;
+	int                 _numChips, _lanes;
+	FlashChip           *_chips;
+	uint32_t            _numOperations;
+
+	bool _checkFault(uint32_t offset, size_t length);
+
+public:
+	// Timings (programTime etc. in microseconds, accessTime in nanoseconds).
+	// These default to the chip's typical values and can be freely changed.
+	int programTime, bufferProgramTime, sectorEraseTime, chipEraseTime;
+	int accessTime;
+
+	// Fault injection. errorOffset makes any program or erase operation
+	// covering the given byte fail, while errorInterval makes every Nth
+	// operation (counted across all chips) fail. writeProtected makes all
+	// sectors behave as protected (JEDEC chips) or emulates VPP being too low
+	// (Intel chips). Setting unlockBypass to false makes JEDEC chips ignore
+	// the unlock bypass command, as older revisions of the chips do.
+	int64_t  errorOffset;
+	uint32_t errorInterval;
+	bool     writeProtected, unlockBypass;
+
+	FlashCardStats stats;
+	FILE           *traceOutput;
+
+	FlashCard(void);
+	~FlashCard(void);
+
+	// The number of chips is counted the same way as the drivers do, i.e. a
+	// pair of 8-bit chips counts as a single 16-bit chip.
+	bool init(FlashChipType type, int numUnits);
+	void release(void);
+
+	inline const FlashChipInfo &getInfo(void) const {
+		return *_info;
+	}
+	inline uint8_t *getData(void) const {
+		return _data;
+	}
+	inline size_t getLength(void) const {
+		return _length;
+	}
+	inline size_t getUnitLength(void) const {
+		return _unitLength;
+	}
+
+	uint16_t read(uint32_t offset);
+	void write(uint32_t offset, uint16_t value);
+};
+
+/* Emulated bus */
+
+enum FlashSlot {
+	SLOT_FLASH   = 0,
+	SLOT_PCMCIA1 = 1,
+	SLOT_PCMCIA2 = 2
+};
+
+// Forwards accesses to the 4 MB bank window at the beginning of DEV0 to the
+// card selected through the bank switch register (both of which are proxied
+// to this class by the host version of ps1/registers573.h). Banks past the end
+// of a card mirror its contents, as on real cards. Writes to the bank switch
+// register that select a different bank are counted in bankSwitches.
+class FlashBus {
+private:
+	uint16_t _bankCtrl;
+
+	FlashCard *_getCard(uint32_t &offset) const;
+
+public:
+	FlashCard *cards[3];
+	uint32_t  bankSwitches;
+
+	FlashBus(void);
+
+	void attach(FlashSlot slot, FlashCard *card);
+
+	inline uint16_t getBankCtrl(void) const {
+		return _bankCtrl;
+	}
+	inline void setBankCtrl(uint16_t value) {
+		if (value != _bankCtrl)
+			bankSwitches++;
+
+		_bankCtrl = value;
+	}
+
+	uint16_t read(uint32_t offset);
+	void write(uint32_t offset, uint16_t value);
+};
+
+// Bus accessed by the drivers through the bank window.
+extern FlashBus flashBus;
+
+}
@@ -0,0 +1,662 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common/ide.hpp"
+#include "common/util.hpp"
+#include "host/idesim.hpp"
+#include "ps1/system.h"
+
+/*
+ * Runs the IDE driver against the simulated drive and reports the throughput
+ * achieved in simulated time, along with the driver's own statistics. Usage:
+ *
+ *   idebench [options] <image>
+ *
+ * The image is treated as a raw hard drive image, or as an ISO9660 image if an
+ * ATAPI drive is being emulated. The write test overwrites the image's contents
+ * and is only run if explicitly requested. A blank image can be created on the
+ * fly, which allows the benchmark to be run as a test without any other setup.
+ * The exit code is non-zero if any request failed.
+ *
+ * The driver can optionally be set up to wait for the IDE IRQ, in which case it
+ * runs as if it were in a worker thread and yields to a model of the main app's
+ * loop. Running the benchmark with each of the two main loop models shows how
+ * much latency is added by only switching back to the worker once per frame.
+ *
+ * A second, identical drive can be attached to the bus. Both drives are then
+ * enumerated concurrently the same way the main app does, i.e. by identifying
+ * them first and then polling them until they are ready, while the benchmark
+ * itself only runs on the primary drive.
+ */
+
+static constexpr size_t   _MAX_CHUNK_LENGTH = 0x20000;
+static constexpr uint64_t _FRAME_TIME       = 16683333; // 59.94 Hz
+static constexpr int      _POLL_DELAY       = 100000;
+static constexpr int      _READY_TIMEOUT    = 30000000;
+
+static const char _USAGE[]{
+	"Usage: %s [options] <image>\n"
+	"\n"
+	"Drive options:\n"
+	"  -a        emulate an ATAPI CD-ROM drive (2048-byte sectors)\n"
+	"  -x        report LBA48 support (ATA only)\n"
+	"  -p MODE   highest PIO mode supported (0-4, default 4)\n"
+	"  -m COUNT  sectors per DRQ block in multiple mode (default 16)\n"
+	"  -d MODE   highest multiword DMA mode supported (0-2, default none)\n"
+	"  -L US     command latency\n"
+	"  -S US     seek latency\n"
+	"  -T US     per-sector media access time\n"
+	"  -U US     spin-up time\n"
+	"  -e LBA    fail all accesses to the given sector\n"
+	"  -E N      fail every Nth media access\n"
+	"  -H N      hang every Nth command until the drive is reset\n"
+	"  -M        abort READ/WRITE MULTIPLE commands\n"
+	"  -D MODE   abort DMA commands (abort) or never transfer data (stall)\n"
+	"  -O        reject IDLE and SET CD SPEED commands\n"
+	"  -t        log all commands to stderr\n"
+	"  -2        attach an identical secondary drive backed by the same image\n"
+	"\n"
+	"Benchmark options:\n"
+	"  -z KB     create the image, or resize it, before opening it\n"
+	"  -s KB     amount of data to transfer sequentially (default 4096)\n"
+	"  -c COUNT  sectors per request (default 64 for ATA, 16 for ATAPI)\n"
+	"  -n COUNT  number of random reads (default 256)\n"
+	"  -r COUNT  ATAPI readahead cache length in sectors (default 0)\n"
+	"  -P MODE   select the quiet or performance drive profile before testing\n"
+	"  -w        also run a sequential write test (destroys image contents)\n"
+	"  -i MODE   wait for the IRQ and yield to a main loop that switches back\n"
+	"            on the next frame (frame) or once the IRQ fires (irq)\n"
+};
+
+/* Benchmark state */
+
+struct BenchmarkResult {
+public:
+	uint64_t bytes, time;
+	uint32_t requests, failures;
+};
+
+enum YieldMode {
+	YIELD_NONE  = 0,
+	YIELD_FRAME = 1,
+	YIELD_IRQ   = 2
+};
+
+struct YieldStats {
+public:
+	YieldMode      mode;
+	host::IDEDrive *drive;
+
+	uint64_t time;
+	uint32_t yields, irqWakeups, missedIRQs;
+};
+
+static Thread   _workerThread;
+static uint8_t  _buffer[_MAX_CHUNK_LENGTH] __attribute__((aligned(4)));
+static uint32_t _randomState = 0x573;
+
+static uint32_t _random(void) {
+	_randomState ^= _randomState << 13;
+	_randomState ^= _randomState >> 17;
+	_randomState ^= _randomState << 5;
+	return _randomState;
+}
+
+static uint32_t _printResult(
+	const char *name, const BenchmarkResult &result
+) {
+	double seconds = double(result.time) / 1.0e9;
+	double rate    = seconds ? (double(result.bytes) / seconds / 1.0e6) : 0.0;
+	double latency = result.requests
+		? (double(result.time) / 1.0e3 / double(result.requests))
+		: 0.0;
+
+	printf(
+		"%-10s %10llu bytes, %4u requests, %3u failed, %9.3f ms, %7.3f MB/s, "
+		"%9.1f us/request\n",
+		name, (unsigned long long) result.bytes, result.requests,
+		result.failures, double(result.time) / 1.0e6, rate, latency
+	);
+	return result.failures;
+}
+
+static void _printYieldStats(const YieldStats &stats) {
+	printf(
+		"yield      %4u waits, %4u woken by IRQ, %3u missed IRQs, %9.3f ms\n",
+		stats.yields, stats.irqWakeups, stats.missedIRQs,
+		double(stats.time) / 1.0e6
+	);
+}
+
+static void _checkError(
+	ide::DeviceError error, uint64_t lba, BenchmarkResult &result
+) {
+	if (!error)
+		return;
+
+	result.failures++;
+	fprintf(
+		stderr, "request at lba=0x%llx failed: %s\n", (unsigned long long) lba,
+		ide::getErrorString(error)
+	);
+}
+
+static inline uint32_t _getPattern(
+	uint64_t lba, size_t offset, size_t sectorSize
+) {
+	return uint32_t(lba + (offset * 4) / sectorSize) ^ (offset * 0x9e3779b9);
+}
+
+// Creates a blank image of the given length, or truncates or extends an
+// existing one, so that the benchmark does not depend on any external files.
+static bool _createImage(const char *path, uint64_t length) {
+	int file = open(path, O_WRONLY | O_CREAT, 0644);
+
+	if (file < 0)
+		return false;
+
+	bool success = !ftruncate(file, off_t(length));
+
+	close(file);
+	return success;
+}
+
+/* Enumeration */
+
+// Mirrors the main app's IDE initialization worker, detecting all drives first
+// and then polling them until each one is ready, so that they can spin up at
+// the same time.
+static ide::DeviceError _enumerateAll(int numDrives, uint64_t *readyTimes) {
+	bool pending[2]{ false };
+	auto error = ide::NO_ERROR;
+
+	for (int i = 0; i < numDrives; i++) {
+		auto detectError = ide::devices[i].detect(!i);
+
+		readyTimes[i] = getHostTime();
+		pending[i]    = !detectError;
+		error         = detectError ? detectError : error;
+	}
+
+	for (int left = numDrives, elapsed = 0; left; elapsed += _POLL_DELAY) {
+		left = 0;
+
+		for (int i = 0; i < numDrives; i++) {
+			if (!pending[i])
+				continue;
+
+			auto pollError = ide::devices[i].poll(false);
+
+			if (
+				(pollError == ide::NOT_YET_READY) ||
+				(pollError == ide::DISC_CHANGED)
+			) {
+				if (elapsed < _READY_TIMEOUT) {
+					left++;
+					continue;
+				}
+
+				pollError = ide::STATUS_TIMEOUT;
+			}
+
+			readyTimes[i] = getHostTime();
+			pending[i]    = false;
+			error         = pollError ? pollError : error;
+		}
+
+		if (left)
+			delayMicroseconds(_POLL_DELAY);
+	}
+
+	return error;
+}
+
+/* Main loop model */
+
+// Stands in for the main thread whenever the driver yields to it. Both models
+// assume the main thread is otherwise idle; the frame model matches the main
+// loop switching to the worker once per frame, while the IRQ model matches it
+// also switching back as soon as the IRQ handler has flagged the drive as
+// ready.
+static void _mainThread(void *arg) {
+	auto &stats   = *reinterpret_cast<YieldStats *>(arg);
+	auto drive    = stats.drive;
+	auto now      = getHostTime();
+	auto frameEnd = (now / _FRAME_TIME + 1) * _FRAME_TIME;
+
+	// Let the drive go through any steps that do not raise an IRQ (such as
+	// starting to execute an ATAPI packet) until the end of the frame, as the
+	// emulated drive only advances its state when accessed.
+	bool irq;
+	auto readyTime = drive->getReadyTime(&irq);
+
+	while (!irq && (readyTime < frameEnd)) {
+		advanceHostTime(util::max(readyTime, getHostTime()) - getHostTime());
+		drive->update();
+
+		readyTime = drive->getReadyTime(&irq);
+	}
+
+	auto irqTime = host::ideBus.getIRQTime();
+	auto resume  = frameEnd;
+
+	if ((stats.mode == YIELD_IRQ) && (irqTime < frameEnd)) {
+		resume = util::max(irqTime, now);
+		stats.irqWakeups++;
+	}
+
+	// A command completing while INTRQ is masked would leave the worker
+	// waiting until the next frame even with the IRQ model.
+	if (irq && (readyTime < resume) && (irqTime != readyTime))
+		stats.missedIRQs++;
+
+	advanceHostTime(resume - now);
+
+	if (irqTime <= resume)
+		ide::handleInterrupt();
+
+	stats.time += resume - now;
+	stats.yields++;
+}
+
+/* Tests */
+
+static BenchmarkResult _sequentialRead(
+	ide::Device &dev, uint64_t capacity, size_t sectorSize, size_t chunk,
+	uint64_t total
+) {
+	BenchmarkResult result;
+	uint64_t        start = getHostTime();
+
+	util::clear(result);
+
+	for (uint64_t lba = 0; (lba < capacity) && (result.bytes < total);) {
+		size_t count = size_t(util::min(uint64_t(chunk), capacity - lba));
+
+		_checkError(dev.readData(_buffer, lba, count), lba, result);
+
+		result.bytes += count * sectorSize;
+		result.requests++;
+		lba += count;
+	}
+
+	result.time = getHostTime() - start;
+	return result;
+}
+
+static BenchmarkResult _randomRead(
+	ide::Device &dev, uint64_t capacity, size_t sectorSize, size_t chunk,
+	uint32_t numRequests
+) {
+	BenchmarkResult result;
+	uint64_t        start = getHostTime();
+
+	util::clear(result);
+
+	chunk = size_t(util::min(uint64_t(chunk), capacity));
+
+	for (uint32_t i = 0; i < numRequests; i++) {
+		uint64_t lba = _random() % (capacity - chunk + 1);
+
+		_checkError(dev.readData(_buffer, lba, chunk), lba, result);
+
+		result.bytes += chunk * sectorSize;
+		result.requests++;
+	}
+
+	result.time = getHostTime() - start;
+	return result;
+}
+
+static BenchmarkResult _sequentialWrite(
+	ide::Device &dev, uint64_t capacity, size_t sectorSize, size_t chunk,
+	uint64_t total
+) {
+	BenchmarkResult result;
+	uint32_t        mismatches = 0;
+
+	util::clear(result);
+
+	for (uint64_t lba = 0; (lba < capacity) && (result.bytes < total);) {
+		size_t count = size_t(util::min(uint64_t(chunk), capacity - lba));
+
+		// Only the write itself is timed, while reading the data back is used
+		// to verify that it actually made it to the image.
+		auto   data   = reinterpret_cast<uint32_t *>(_buffer);
+		size_t length = count * sectorSize / 4;
+
+		for (size_t i = 0; i < length; i++)
+			data[i] = _getPattern(lba, i, sectorSize);
+
+		uint64_t start = getHostTime();
+		auto     error = dev.writeData(_buffer, lba, count);
+
+		error = error ? error : dev.flushCache();
+
+		result.time += getHostTime() - start;
+		_checkError(error, lba, result);
+
+		if (!error && !dev.readData(_buffer, lba, count)) {
+			for (size_t i = 0; i < length; i++) {
+				if (data[i] == _getPattern(lba, i, sectorSize))
+					continue;
+
+				mismatches++;
+				break;
+			}
+		}
+
+		result.bytes += count * sectorSize;
+		result.requests++;
+		lba += count;
+	}
+
+	if (mismatches)
+		fprintf(stderr, "%u requests failed verification\n", mismatches);
+
+	result.failures += mismatches;
+	return result;
+}
+
+/* Main */
+
+int main(int argc, char **argv) {
+	host::IDEDrive drive, secondDrive;
+
+	bool     atapi = false, writeTest = false, twoDrives = false;
+	uint64_t total = 4096, imageLength = 0;
+	size_t   chunk = 0, readahead = 0;
+	uint32_t numRandom = 256;
+	int      latency = -1, seek = -1, sector = -1, profile = -1;
+	int      option;
+
+	YieldStats yieldStats;
+
+	util::clear(yieldStats);
+	yieldStats.drive = &drive;
+
+	while (
+		(option = getopt(
+			argc, argv, "axp:m:d:L:S:T:U:e:E:H:MD:Ot2z:s:c:n:r:P:wi:"
+		)) >= 0
+	) {
+		switch (option) {
+			case 'a':
+				atapi = true;
+				break;
+
+			case 'x':
+				drive.lba48 = true;
+				break;
+
+			case 'p':
+				drive.pioMode = atoi(optarg);
+				break;
+
+			case 'm':
+				drive.maxMultiSectorCount = atoi(optarg);
+				break;
+
+			case 'd':
+				drive.dmaMode = atoi(optarg);
+				break;
+
+			case 'L':
+				latency = atoi(optarg);
+				break;
+
+			case 'S':
+				seek = atoi(optarg);
+				break;
+
+			case 'T':
+				sector = atoi(optarg);
+				break;
+
+			case 'U':
+				drive.spinUpTime = atoi(optarg);
+				break;
+
+			case 'e':
+				drive.errorLBA = strtoll(optarg, nullptr, 0);
+				break;
+
+			case 'E':
+				drive.errorInterval = strtoul(optarg, nullptr, 0);
+				break;
+
+			case 'H':
+				drive.hangInterval = strtoul(optarg, nullptr, 0);
+				break;
+
+			case 'M':
+				drive.abortMultiple = true;
+				break;
+
+			case 'D':
+				if (!strcmp(optarg, "abort")) {
+					drive.abortDMA = true;
+				} else if (!strcmp(optarg, "stall")) {
+					drive.stallDMA = true;
+				} else {
+					fprintf(stderr, "unknown DMA fault: %s\n", optarg);
+					return 1;
+				}
+				break;
+
+			case 'O':
+				drive.abortPowerCommands = true;
+				break;
+
+			case 't':
+				drive.traceOutput = stderr;
+				break;
+
+			case '2':
+				twoDrives = true;
+				break;
+
+			case 'z':
+				imageLength = strtoull(optarg, nullptr, 0) * 1024;
+				break;
+
+			case 's':
+				total = strtoull(optarg, nullptr, 0);
+				break;
+
+			case 'c':
+				chunk = strtoul(optarg, nullptr, 0);
+				break;
+
+			case 'n':
+				numRandom = strtoul(optarg, nullptr, 0);
+				break;
+
+			case 'r':
+				readahead = strtoul(optarg, nullptr, 0);
+				break;
+
+			case 'P':
+				if (!strcmp(optarg, "quiet")) {
+					profile = ide::PROFILE_QUIET;
+				} else if (!strcmp(optarg, "performance")) {
+					profile = ide::PROFILE_PERFORMANCE;
+				} else {
+					fprintf(stderr, "unknown drive profile: %s\n", optarg);
+					return 1;
+				}
+				break;
+
+			case 'w':
+				writeTest = true;
+				break;
+
+			case 'i':
+				if (!strcmp(optarg, "frame")) {
+					yieldStats.mode = YIELD_FRAME;
+				} else if (!strcmp(optarg, "irq")) {
+					yieldStats.mode = YIELD_IRQ;
+				} else {
+					fprintf(stderr, "unknown main loop model: %s\n", optarg);
+					return 1;
+				}
+				break;
+
+			default:
+				fprintf(stderr, _USAGE, argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != (argc - 1)) {
+		fprintf(stderr, _USAGE, argv[0]);
+		return 1;
+	}
+
+	// Pick defaults roughly matching a CompactFlash card or a 48x CD-ROM drive
+	// for any timing left unspecified.
+	drive.commandTime = (latency >= 0) ? latency : (atapi ? 1000 : 100);
+	drive.seekTime    = (seek    >= 0) ? seek    : (atapi ? 80000 : 0);
+	drive.sectorTime  = (sector  >= 0) ? sector  : (atapi ? 280 : 25);
+
+	if (imageLength && !_createImage(argv[optind], imageLength)) {
+		fprintf(stderr, "failed to create %s\n", argv[optind]);
+		return 1;
+	}
+	if (!drive.open(argv[optind], atapi, !writeTest || atapi)) {
+		fprintf(stderr, "failed to open %s\n", argv[optind]);
+		return 1;
+	}
+
+	host::ideBus.attach(0, &drive);
+
+	int      numDrives = 1;
+	uint64_t readyTimes[2];
+
+	if (twoDrives) {
+		secondDrive.lba48               = drive.lba48;
+		secondDrive.pioMode             = drive.pioMode;
+		secondDrive.maxMultiSectorCount = drive.maxMultiSectorCount;
+		secondDrive.dmaMode             = drive.dmaMode;
+		secondDrive.commandTime         = drive.commandTime;
+		secondDrive.seekTime            = drive.seekTime;
+		secondDrive.sectorTime          = drive.sectorTime;
+		secondDrive.spinUpTime          = drive.spinUpTime;
+		secondDrive.traceOutput         = drive.traceOutput;
+
+		if (!secondDrive.open(argv[optind], atapi)) {
+			fprintf(stderr, "failed to open %s\n", argv[optind]);
+			return 1;
+		}
+
+		host::ideBus.attach(1, &secondDrive);
+		numDrives = 2;
+	}
+
+	auto &dev  = ide::devices[0];
+	auto error = _enumerateAll(numDrives, readyTimes);
+
+	if (error) {
+		fprintf(stderr, "enumeration failed: %s\n", ide::getErrorString(error));
+		return 1;
+	}
+
+	size_t   sectorSize = dev.getSectorSize();
+	uint64_t capacity   = atapi ? drive.getCapacity() : dev.capacity;
+
+	if (!chunk)
+		chunk = atapi ? 16 : 64;
+
+	chunk  = util::min(chunk, _MAX_CHUNK_LENGTH / sectorSize);
+	total *= 1024;
+
+	if (readahead && !dev.setReadaheadLength(readahead))
+		fprintf(stderr, "failed to allocate readahead cache\n");
+
+	for (int i = 0; i < numDrives; i++)
+		printf(
+			"drive: %s, %s, %llu sectors, %u sectors per block, "
+			"enumerated in %.3f ms\n",
+			ide::devices[i].model, atapi ? "ATAPI" : "ATA",
+			(unsigned long long) capacity,
+			unsigned(ide::devices[i].multiSectorCount),
+			double(readyTimes[i]) / 1.0e6
+		);
+
+	dev.resetStats();
+
+	if (yieldStats.mode) {
+		dev.flags |= ide::DEVICE_IRQ;
+		setHostThread(&_workerThread, &_mainThread, &yieldStats);
+	}
+
+	uint32_t failures = 0;
+
+	if (profile >= 0) {
+		auto error = dev.setProfile(ide::DriveProfile(profile));
+
+		if (error) {
+			fprintf(
+				stderr, "failed to set drive profile: %s\n",
+				ide::getErrorString(error)
+			);
+			failures++;
+		}
+	}
+
+	failures += _printResult(
+		"seq read",
+		_sequentialRead(dev, capacity, sectorSize, chunk, total)
+	);
+	failures += _printResult(
+		"rand read",
+		_randomRead(dev, capacity, sectorSize, chunk, numRandom)
+	);
+
+	if (writeTest && !atapi)
+		failures += _printResult(
+			"seq write",
+			_sequentialWrite(dev, capacity, sectorSize, chunk, total)
+		);
+
+	setHostThread(nullptr, nullptr, nullptr);
+
+	if (yieldStats.mode)
+		_printYieldStats(yieldStats);
+
+	char stats[4096];
+
+	dev.formatStats(stats, sizeof(stats));
+	printf("\n%s", stats);
+	printf("dma: %s\n", (dev.flags & ide::DEVICE_DMA) ? "enabled" : "disabled");
+
+	if (yieldStats.missedIRQs) {
+		fprintf(
+			stderr, "%u commands completed without raising an IRQ\n",
+			yieldStats.missedIRQs
+		);
+		return 1;
+	}
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,1260 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "common/ide.hpp"
+#include "common/idedefs.hpp"
+#include "common/util.hpp"
+#include "host/idesim.hpp"
+#include "ps1/registers573.h"
+#include "ps1/system.h"
+
+namespace host {
+
+/* Register proxies */
+
+IDEBus ideBus;
+
+IDERegister ideCS0Registers[8]{
+	{ 0, 0 }, { 0, 1 }, { 0, 2 }, { 0, 3 }, { 0, 4 }, { 0, 5 }, { 0, 6 }, { 0, 7 }
+};
+IDERegister ideCS1Registers[8]{
+	{ 1, 0 }, { 1, 1 }, { 1, 2 }, { 1, 3 }, { 1, 4 }, { 1, 5 }, { 1, 6 }, { 1, 7 }
+};
+
+IDERegister::operator uint16_t(void) const {
+	return ideBus.read(cs, reg);
+}
+
+IDERegister &IDERegister::operator=(uint16_t value) {
+	ideBus.write(cs, reg, value);
+	return *this;
+}
+
+/* Utilities */
+
+// Minimum PIO cycle times for each mode, in nanoseconds. Each register access
+// made by the driver advances the simulated time by the cycle time of the
+// currently selected mode.
+static const int _PIO_CYCLE_TIMES[]{ 600, 383, 240, 180, 120 };
+
+// Minimum cycle times for each multiword DMA mode, in nanoseconds. Each
+// halfword moved by a DMA transfer takes one cycle.
+static const int _DMA_CYCLE_TIMES[]{ 480, 150, 120 };
+
+static constexpr int      _MAX_PIO_MODE      = 4;
+static constexpr int      _MAX_DMA_MODE      = 2;
+static constexpr int      _MAX_MULTI_SECTORS = 128;
+static constexpr size_t   _PACKET_LENGTH     = 12;
+static constexpr uint16_t _ATAPI_SIGNATURE   = 0xeb14;
+static constexpr uint32_t _MAX_LBA28_SECTORS = 0x0fffffff;
+
+static constexpr size_t _BUFFER_LENGTH =
+	_MAX_MULTI_SECTORS * ide::ATA_SECTOR_SIZE;
+
+static void _copyString(uint16_t *output, const char *input, size_t length) {
+	// Strings in the identification block are padded with spaces and stored
+	// with each pair of characters swapped.
+	auto ptr = reinterpret_cast<uint8_t *>(output);
+
+	for (size_t i = 0; i < length; i++) {
+		char value = *input ? *(input++) : ' ';
+
+		ptr[i ^ 1] = value;
+	}
+}
+
+static inline uint32_t _getBE32(const uint8_t *data) {
+	return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+static inline uint16_t _getBE16(const uint8_t *data) {
+	return (data[0] << 8) | data[1];
+}
+
+/* Emulated drive */
+
+IDEDrive::IDEDrive(void)
+:
+_file(-1), _numSectors(0), _readyTime(0), _spinUpEnd(0), _startTime(0),
+_accessTime(_PIO_CYCLE_TIMES[0]), _dmaCycleTime(0), _phase(PHASE_IDLE),
+_action(ACTION_NONE), _features(0), _deviceSel(0), _status(0), _error(0),
+_command(0), _packetCommand(0), _lba(0), _lastLBA(0), _remaining(0),
+_blockSectors(0), _maxBlockSectors(1), _multiSectorCount(0), _spunDown(true),
+_dma(false), _bufferOffset(0), _bufferLength(0), _unitAttention(0),
+_numCommands(0), _numMediaAccesses(0), index(0), atapi(false), readOnly(true),
+lba48(false), pioMode(_MAX_PIO_MODE), maxMultiSectorCount(16), dmaMode(-1),
+resetTime(1000), commandTime(100), seekTime(5000), sectorTime(50),
+spinUpTime(0), errorLBA(-1), errorInterval(0), hangInterval(0),
+abortMultiple(false), abortDMA(false), stallDMA(false),
+abortPowerCommands(false), resetUnitAttention(true), traceOutput(nullptr) {
+	_buffer = new uint8_t[_BUFFER_LENGTH];
+
+	util::clear(_count);
+	util::clear(_sector);
+	util::clear(_cylinderL);
+	util::clear(_cylinderH);
+	util::clear(_sense);
+}
+
+IDEDrive::~IDEDrive(void) {
+	close();
+	delete[] _buffer;
+}
+
+void IDEDrive::_trace(const char *format, ...) const {
+	if (!traceOutput)
+		return;
+
+	va_list ap;
+
+	fprintf(
+		traceOutput, "[%12.3f ms] ide%d: ", double(getHostTime()) / 1.0e6,
+		index
+	);
+	va_start(ap, format);
+	vfprintf(traceOutput, format, ap);
+	va_end(ap);
+	fputc('\n', traceOutput);
+}
+
+void IDEDrive::_setBusy(int time, IDEDriveAction action) {
+	_phase     = PHASE_BUSY;
+	_action    = action;
+	_status    = ide::CS0_STATUS_BSY;
+	_readyTime = getHostTime() + uint64_t(util::max(time, 0)) * 1000;
+}
+
+void IDEDrive::_setIdle(uint8_t status) {
+	_phase  = PHASE_IDLE;
+	_action = ACTION_NONE;
+	_status = status;
+
+	if (atapi)
+		_count[0] = ide::CS0_COUNT_IO | ide::CS0_COUNT_CD;
+}
+
+void IDEDrive::_complete(void) {
+	_error = 0;
+
+	if (atapi)
+		_setIdle(ide::CS0_STATUS_DRDY);
+	else
+		_setIdle(ide::CS0_STATUS_DRDY | ide::CS0_STATUS_DSC);
+
+	_trace(
+		"cmd 0x%02x done, %llu us", _command,
+		(unsigned long long) ((getHostTime() - _startTime) / 1000)
+	);
+}
+
+void IDEDrive::_abort(uint8_t error) {
+	_error = error;
+	_setIdle(ide::CS0_STATUS_DRDY | ide::CS0_STATUS_ERR);
+
+	_trace("cmd 0x%02x failed, err=0x%02x", _command, error);
+}
+
+void IDEDrive::_checkCondition(
+	ide::ATAPISenseKey key, uint16_t asc, uint64_t lba
+) {
+	util::clear(_sense);
+
+	_sense.errorCode        = lba ? 0xf0 : 0x70;
+	_sense.senseKey         = key;
+	_sense.additionalLength = sizeof(ide::SenseData) - 8;
+	_sense.asc              = asc & 0xff;
+	_sense.ascQualifier     = asc >> 8;
+
+	if (lba) {
+		_sense.info[0] = (lba >> 24) & 0xff;
+		_sense.info[1] = (lba >> 16) & 0xff;
+		_sense.info[2] = (lba >>  8) & 0xff;
+		_sense.info[3] = (lba >>  0) & 0xff;
+	}
+
+	_error = (key << 4) | ide::CS0_ERROR_ABRT;
+	_setIdle(ide::CS0_STATUS_DRDY | ide::CS0_STATUS_CHK);
+
+	_trace(
+		"packet 0x%02x failed, key=0x%x, asc=0x%02x, ascq=0x%02x",
+		_packetCommand, key, _sense.asc, _sense.ascQualifier
+	);
+}
+
+void IDEDrive::_mediaError(uint8_t error) {
+	if (atapi)
+		_checkCondition(
+			ide::SENSE_KEY_MEDIUM_ERROR, ide::ASC_UNRECOVERED_READ_ERROR, _lba
+		);
+	else
+		_abort(error);
+}
+
+void IDEDrive::_startDataIn(size_t length) {
+	_phase        = PHASE_DATA_IN;
+	_bufferOffset = 0;
+	_bufferLength = length;
+
+	// ATAPI drives report the length of each DRQ block in the cylinder
+	// registers. The driver always sets the byte count limit to one sector, so
+	// there is no need to split blocks any further.
+	if (atapi) {
+		_status       = ide::CS0_STATUS_DRDY | ide::CS0_STATUS_DRQ;
+		_count[0]     = ide::CS0_COUNT_IO;
+		_cylinderL[0] = (length >> 0) & 0xff;
+		_cylinderH[0] = (length >> 8) & 0xff;
+	} else {
+		_status = 0
+			| ide::CS0_STATUS_DRDY
+			| ide::CS0_STATUS_DSC
+			| ide::CS0_STATUS_DRQ;
+	}
+}
+
+void IDEDrive::_startDataOut(size_t length) {
+	_phase        = PHASE_DATA_OUT;
+	_bufferOffset = 0;
+	_bufferLength = length;
+	_status       = 0
+		| ide::CS0_STATUS_DRDY
+		| ide::CS0_STATUS_DSC
+		| ide::CS0_STATUS_DRQ;
+}
+
+void IDEDrive::_finishDataIn(void) {
+	// Blocks not read from the medium (identification and sense data) have no
+	// sectors associated with them.
+	if (!_blockSectors) {
+		_complete();
+		return;
+	}
+
+	_lba       += _blockSectors;
+	_lastLBA    = _lba;
+	_remaining -= _blockSectors;
+
+	if (!_remaining) {
+		_complete();
+		return;
+	}
+
+	auto count = util::min(_remaining, _maxBlockSectors);
+
+	_setBusy(int(count) * sectorTime, ACTION_READ_BLOCK);
+}
+
+void IDEDrive::_finishDataOut(void) {
+	if (_phase == PHASE_PACKET)
+		_setBusy(commandTime, ACTION_PACKET);
+	else
+		_setBusy(
+			_getSeekTime(_lba) + int(_blockSectors) * sectorTime,
+			ACTION_WRITE_BLOCK
+		);
+}
+
+uint64_t IDEDrive::_getLBA(bool ext) const {
+	if (ext)
+		return 0
+			| (uint64_t(_sector[0])    <<  0)
+			| (uint64_t(_cylinderL[0]) <<  8)
+			| (uint64_t(_cylinderH[0]) << 16)
+			| (uint64_t(_sector[1])    << 24)
+			| (uint64_t(_cylinderL[1]) << 32)
+			| (uint64_t(_cylinderH[1]) << 40);
+	else
+		return 0
+			| (_sector[0]        <<  0)
+			| (_cylinderL[0]     <<  8)
+			| (_cylinderH[0]     << 16)
+			| ((_deviceSel & 15) << 24);
+}
+
+uint32_t IDEDrive::_getCount(bool ext) const {
+	// A sector count of zero is interpreted as the largest count possible.
+	if (ext) {
+		uint32_t count = _count[0] | (_count[1] << 8);
+
+		return count ? count : (1 << 16);
+	} else {
+		return _count[0] ? _count[0] : (1 << 8);
+	}
+}
+
+bool IDEDrive::_checkFault(uint64_t lba, size_t count) {
+	_numMediaAccesses++;
+
+	if (errorInterval && !(_numMediaAccesses % errorInterval))
+		return true;
+	if (
+		(errorLBA >= 0) && (uint64_t(errorLBA) >= lba) &&
+		(uint64_t(errorLBA) < (lba + count))
+	) {
+		// Report the exact sector that failed.
+		_lba = uint64_t(errorLBA);
+		return true;
+	}
+
+	return false;
+}
+
+bool IDEDrive::_readMedia(uint64_t lba, size_t count) {
+	auto sectorSize = getSectorSize();
+	auto length     = count * sectorSize;
+
+	return (pread(_file, _buffer, length, lba * sectorSize) == ssize_t(length));
+}
+
+bool IDEDrive::_writeMedia(uint64_t lba, size_t count) {
+	auto sectorSize = getSectorSize();
+	auto length     = count * sectorSize;
+
+	return (pwrite(_file, _buffer, length, lba * sectorSize) == ssize_t(length));
+}
+
+int IDEDrive::_getSeekTime(uint64_t lba) {
+	int time = (lba != _lastLBA) ? seekTime : 0;
+
+	// ATA drives spin up transparently on the first media access after being
+	// put in standby mode.
+	if (_spunDown && !atapi) {
+		_spunDown = false;
+		time     += spinUpTime;
+
+		_trace("spinning up");
+	}
+
+	return time;
+}
+
+bool IDEDrive::_checkReady(void) {
+	auto time = getHostTime();
+
+	if (_spunDown) {
+		_spunDown  = false;
+		_spinUpEnd = time + uint64_t(spinUpTime) * 1000;
+
+		_trace("spinning up");
+	}
+
+	if (time < _spinUpEnd) {
+		_checkCondition(
+			ide::SENSE_KEY_NOT_READY, ide::ASC_NOT_READY_IN_PROGRESS
+		);
+		return false;
+	}
+
+	return true;
+}
+
+/* Command handling */
+
+void IDEDrive::_identify(void) {
+	auto &block = *reinterpret_cast<ide::IdentifyBlock *>(_buffer);
+
+	util::clear(block);
+
+	int mode = util::min(util::max(pioMode, 0), _MAX_PIO_MODE);
+
+	if (atapi) {
+		block.deviceFlags = 0
+			| ide::IDENTIFY_DEV_PACKET_LENGTH_12
+			| ide::IDENTIFY_DEV_DRQ_TYPE_FAST
+			| ide::IDENTIFY_DEV_REMOVABLE
+			| ide::IDENTIFY_DEV_ATAPI_TYPE_CDROM
+			| ide::IDENTIFY_DEV_ATAPI;
+
+		_copyString(
+			block.model, "573in1 SIMULATED ATAPI CD-ROM", sizeof(block.model)
+		);
+	} else {
+		auto count = uint32_t(util::min(
+			_numSectors, uint64_t(_MAX_LBA28_SECTORS)
+		));
+
+		block.deviceFlags         = 1 << 6; // Non-removable
+		block.maxMultiSectorCount =
+			0x8000 | util::min(maxMultiSectorCount, _MAX_MULTI_SECTORS);
+		block.sectorCount[0]      = (count >>  0) & 0xffff;
+		block.sectorCount[1]      = (count >> 16) & 0xffff;
+
+		if (_multiSectorCount)
+			block.multiSectorSettings = 0x100 | _multiSectorCount;
+
+		// Word 83 bit 12 and 13 report FLUSH CACHE and FLUSH CACHE EXT support
+		// respectively, while bit 10 reports LBA48 support.
+		block.commandSetFlags[1] = (1 << 14) | (1 << 12);
+
+		if (lba48) {
+			block.commandSetFlags[1] |= (1 << 13) | (1 << 10);
+
+			for (int i = 0; i < 4; i++)
+				block.sectorCountExt[i] = (_numSectors >> (i * 16)) & 0xffff;
+		}
+
+		_copyString(
+			block.model, "573in1 SIMULATED ATA DRIVE", sizeof(block.model)
+		);
+	}
+
+	_copyString(
+		block.serialNumber, "SIM0000000001", sizeof(block.serialNumber)
+	);
+	_copyString(block.revision, "1.0", sizeof(block.revision));
+
+	block.capabilities        =
+		ide::IDENTIFY_CAP_FLAG_LBA | ide::IDENTIFY_CAP_FLAG_IORDY;
+
+	// Word 63 reports the multiword DMA modes supported in the lower byte and
+	// the currently selected one in the upper byte.
+	int highestDMAMode = util::min(dmaMode, _MAX_DMA_MODE);
+
+	if (highestDMAMode >= 0) {
+		block.capabilities |= ide::IDENTIFY_CAP_FLAG_DMA;
+		block.dmaModeFlags  = (1 << (highestDMAMode + 1)) - 1;
+
+		for (int i = 0; i <= highestDMAMode; i++) {
+			if (_dmaCycleTime == _DMA_CYCLE_TIMES[i])
+				block.dmaModeFlags |= 1 << (i + 8);
+		}
+	}
+	block.timingValidityFlags = (1 << 1) | (1 << 0);
+	block.versionMajor        = 0x7e; // ATA-1 to ATA-6
+
+	if (mode >= 4)
+		block.pioModeFlags = (1 << 1) | (1 << 0);
+	else if (mode == 3)
+		block.pioModeFlags = 1 << 0;
+
+	block.cycleTimings[2]    = _PIO_CYCLE_TIMES[mode];
+	block.cycleTimings[3]    = _PIO_CYCLE_TIMES[mode];
+	block.commandSetFlags[2] = 1 << 14;
+	block.commandSetFlags[3] = block.commandSetFlags[0];
+	block.commandSetFlags[4] = block.commandSetFlags[1];
+	block.commandSetFlags[5] = block.commandSetFlags[2];
+
+	block.checksum  = 0xa5;
+	block.checksum |= ((-int(util::sum(
+		_buffer, ide::ATA_SECTOR_SIZE - 1
+	))) & 0xff) << 8;
+
+	_blockSectors = 0;
+	_bufferLength = sizeof(ide::IdentifyBlock);
+	_setBusy(commandTime, ACTION_DATA_IN);
+}
+
+void IDEDrive::_setFeatures(void) {
+	if (_features != ide::FEATURE_TRANSFER_MODE) {
+		// All other features are accepted and ignored.
+		_setBusy(commandTime, ACTION_COMPLETE);
+		return;
+	}
+
+	uint8_t type = _count[0] & ~7, mode = _count[0] & 7;
+
+	if (type == ide::TRANSFER_MODE_PIO_DEFAULT) {
+		_accessTime = _PIO_CYCLE_TIMES[0];
+	} else if (
+		(type == ide::TRANSFER_MODE_PIO) &&
+		(mode <= util::min(pioMode, _MAX_PIO_MODE))
+	) {
+		_accessTime = _PIO_CYCLE_TIMES[mode];
+
+		_trace("PIO cycle time set to %d ns", _accessTime);
+	} else if (
+		(type == ide::TRANSFER_MODE_DMA) &&
+		(int(mode) <= util::min(dmaMode, _MAX_DMA_MODE))
+	) {
+		_dmaCycleTime = _DMA_CYCLE_TIMES[mode];
+
+		_trace("DMA cycle time set to %d ns", _dmaCycleTime);
+	} else {
+		// Ultra DMA modes are not emulated.
+		_abort();
+		return;
+	}
+
+	_setBusy(commandTime, ACTION_COMPLETE);
+}
+
+void IDEDrive::_ataTransfer(bool write, bool multiple, bool ext, bool dma) {
+	if (ext && !lba48) {
+		_abort();
+		return;
+	}
+	if (multiple && (abortMultiple || !_multiSectorCount)) {
+		_abort();
+		return;
+	}
+	if (dma && (abortDMA || !_dmaCycleTime)) {
+		_abort();
+		return;
+	}
+	if (write && readOnly) {
+		_abort();
+		return;
+	}
+	if (!(_deviceSel & ide::CS0_DEVICE_SEL_LBA)) {
+		// CHS addressing is not supported.
+		_abort();
+		return;
+	}
+
+	// DMA transfers are only split into blocks as large as the drive's buffer,
+	// with DMARQ deasserted while the drive is busy between them.
+	_lba             = _getLBA(ext);
+	_remaining       = _getCount(ext);
+	_dma             = dma;
+	_maxBlockSectors = multiple ? _multiSectorCount : 1;
+
+	if (dma)
+		_maxBlockSectors = _MAX_MULTI_SECTORS;
+
+	_trace(
+		"%s lba=0x%llx, count=%u, block=%u", write ? "write" : "read",
+		(unsigned long long) _lba,
+		_remaining, _maxBlockSectors
+	);
+
+	if ((_lba + _remaining) > _numSectors) {
+		_abort(ide::CS0_ERROR_IDNF);
+		return;
+	}
+
+	if (write) {
+		_setBusy(commandTime, ACTION_REQUEST_BLOCK);
+	} else {
+		auto count = util::min(_remaining, _maxBlockSectors);
+
+		_setBusy(
+			commandTime + _getSeekTime(_lba) + int(count) * sectorTime,
+			ACTION_READ_BLOCK
+		);
+	}
+}
+
+void IDEDrive::_execute(void) {
+	_startTime = getHostTime();
+	_trace(
+		"cmd 0x%02x, feat=0x%02x, cnt=0x%02x", _command, _features, _count[0]
+	);
+
+	if (_command != ide::ATA_DEVICE_RESET) {
+		_numCommands++;
+
+		if (hangInterval && !(_numCommands % hangInterval)) {
+			_phase  = PHASE_HUNG;
+			_action = ACTION_NONE;
+			_status = ide::CS0_STATUS_BSY;
+
+			_trace("cmd 0x%02x hung", _command);
+			return;
+		}
+	}
+
+	switch (_command) {
+		case ide::ATA_DEVICE_RESET:
+			if (atapi)
+				_setBusy(resetTime, ACTION_RESET);
+			else
+				_abort();
+			break;
+
+		case ide::ATA_IDENTIFY:
+			if (atapi) {
+				// ATAPI drives must abort this command and place the signature
+				// in the cylinder registers.
+				_cylinderL[0] = (_ATAPI_SIGNATURE >> 0) & 0xff;
+				_cylinderH[0] = (_ATAPI_SIGNATURE >> 8) & 0xff;
+				_abort();
+			} else {
+				_identify();
+			}
+			break;
+
+		case ide::ATA_IDENTIFY_PACKET:
+			if (atapi)
+				_identify();
+			else
+				_abort();
+			break;
+
+		case ide::ATA_PACKET:
+			_dma = _features & ide::CS0_FEATURES_DMA;
+
+			if (!atapi || (_dma && (abortDMA || !_dmaCycleTime))) {
+				_abort();
+				break;
+			}
+
+			_phase        = PHASE_PACKET;
+			_status       = ide::CS0_STATUS_DRDY | ide::CS0_STATUS_DRQ;
+			_count[0]     = ide::CS0_COUNT_CD;
+			_bufferOffset = 0;
+			_bufferLength = _PACKET_LENGTH;
+			break;
+
+		case ide::ATA_SET_FEATURES:
+			_setFeatures();
+			break;
+
+		case ide::ATA_SET_MULTIPLE_MODE:
+			// The block size must be a power of 2 no larger than the maximum
+			// reported in the identification block (or zero to disable).
+			if (
+				atapi ||
+				(_count[0] > maxMultiSectorCount) ||
+				(_count[0] > _MAX_MULTI_SECTORS) ||
+				(_count[0] & (_count[0] - 1))
+			) {
+				_abort();
+				break;
+			}
+
+			_multiSectorCount = _count[0];
+			_setBusy(commandTime, ACTION_COMPLETE);
+			break;
+
+		case ide::ATA_READ_SECTORS:
+		case ide::ATA_READ_SECTORS_EXT:
+		case ide::ATA_READ_MULTIPLE:
+		case ide::ATA_READ_MULTIPLE_EXT:
+		case ide::ATA_WRITE_SECTORS:
+		case ide::ATA_WRITE_SECTORS_EXT:
+		case ide::ATA_WRITE_MULTIPLE:
+		case ide::ATA_WRITE_MULTIPLE_EXT:
+		case ide::ATA_READ_DMA:
+		case ide::ATA_READ_DMA_EXT:
+		case ide::ATA_WRITE_DMA:
+		case ide::ATA_WRITE_DMA_EXT:
+			if (atapi) {
+				_abort();
+				break;
+			}
+
+			_ataTransfer(
+				(_command == ide::ATA_WRITE_SECTORS) ||
+				(_command == ide::ATA_WRITE_SECTORS_EXT) ||
+				(_command == ide::ATA_WRITE_MULTIPLE) ||
+				(_command == ide::ATA_WRITE_MULTIPLE_EXT) ||
+				(_command == ide::ATA_WRITE_DMA) ||
+				(_command == ide::ATA_WRITE_DMA_EXT),
+				(_command == ide::ATA_READ_MULTIPLE) ||
+				(_command == ide::ATA_READ_MULTIPLE_EXT) ||
+				(_command == ide::ATA_WRITE_MULTIPLE) ||
+				(_command == ide::ATA_WRITE_MULTIPLE_EXT),
+				(_command == ide::ATA_READ_SECTORS_EXT) ||
+				(_command == ide::ATA_READ_MULTIPLE_EXT) ||
+				(_command == ide::ATA_READ_DMA_EXT) ||
+				(_command == ide::ATA_WRITE_SECTORS_EXT) ||
+				(_command == ide::ATA_WRITE_MULTIPLE_EXT) ||
+				(_command == ide::ATA_WRITE_DMA_EXT),
+				(_command == ide::ATA_READ_DMA) ||
+				(_command == ide::ATA_READ_DMA_EXT) ||
+				(_command == ide::ATA_WRITE_DMA) ||
+				(_command == ide::ATA_WRITE_DMA_EXT)
+			);
+			break;
+
+		case ide::ATA_FLUSH_CACHE:
+		case ide::ATA_FLUSH_CACHE_EXT:
+			if (atapi || ((_command == ide::ATA_FLUSH_CACHE_EXT) && !lba48))
+				_abort();
+			else
+				_setBusy(commandTime, ACTION_COMPLETE);
+			break;
+
+		case ide::ATA_IDLE:
+			if (abortPowerCommands)
+				_abort();
+			else
+				_setBusy(commandTime, ACTION_COMPLETE);
+			break;
+
+		case ide::ATA_IDLE_IMMEDIATE:
+		case ide::ATA_CHECK_POWER_MODE:
+			_setBusy(commandTime, ACTION_COMPLETE);
+			break;
+
+		case ide::ATA_STANDBY:
+		case ide::ATA_STANDBY_IMMEDIATE:
+		case ide::ATA_SLEEP:
+			_spunDown = true;
+			_setBusy(commandTime, ACTION_COMPLETE);
+			break;
+
+		default:
+			_abort();
+	}
+}
+
+void IDEDrive::_executePacket(void) {
+	auto cmd   = _buffer[0];
+	auto param = &_buffer[1];
+
+	_packetCommand = cmd;
+
+	_trace("packet 0x%02x", cmd);
+
+	// Pending unit attention conditions are reported (and cleared) by the
+	// first command issued, unless it is a request for the sense data.
+	if (_unitAttention && (cmd != ide::ATAPI_REQUEST_SENSE)) {
+		auto asc       = _unitAttention;
+		_unitAttention = 0;
+
+		_checkCondition(ide::SENSE_KEY_UNIT_ATTENTION, asc);
+		return;
+	}
+
+	switch (cmd) {
+		case ide::ATAPI_TEST_UNIT_READY:
+			if (_checkReady())
+				_complete();
+			break;
+
+		case ide::ATAPI_REQUEST_SENSE:
+			{
+				size_t length = util::min(
+					size_t(param[3]), sizeof(ide::SenseData)
+				);
+
+				__builtin_memcpy(_buffer, &_sense, length);
+				util::clear(_sense);
+				_sense.errorCode = 0x70;
+
+				if (!length) {
+					_complete();
+					break;
+				}
+
+				_blockSectors = 0;
+				_startDataIn(length);
+			}
+			break;
+
+		case ide::ATAPI_READ10:
+		case ide::ATAPI_READ12:
+			if (!_checkReady())
+				break;
+
+			_lba             = _getBE32(&param[1]);
+			_remaining       = (cmd == ide::ATAPI_READ12)
+				? _getBE32(&param[5])
+				: _getBE16(&param[6]);
+			_maxBlockSectors = _dma
+				? (_BUFFER_LENGTH / ide::ATAPI_SECTOR_SIZE)
+				: 1;
+
+			_trace(
+				"read lba=0x%llx, count=%u", (unsigned long long) _lba,
+				_remaining
+			);
+
+			if ((_lba + _remaining) > _numSectors) {
+				_checkCondition(
+					ide::SENSE_KEY_ILLEGAL_REQUEST, ide::ASC_LBA_OUT_OF_RANGE,
+					_lba
+				);
+				break;
+			}
+			if (!_remaining) {
+				_complete();
+				break;
+			}
+
+			_setBusy(_getSeekTime(_lba) + sectorTime, ACTION_READ_BLOCK);
+			break;
+
+		case ide::ATAPI_START_STOP_UNIT:
+			switch (param[3] & 3) {
+				case ide::START_STOP_MODE_STOP_DISC:
+					_spunDown = true;
+					_complete();
+					break;
+
+				case ide::START_STOP_MODE_START_DISC:
+					// Unlike other commands, this one waits for the drive to
+					// spin up rather than reporting it is not ready.
+					if (_spunDown) {
+						_spunDown  = false;
+						_spinUpEnd = 0;
+						_setBusy(spinUpTime, ACTION_COMPLETE);
+					} else {
+						_complete();
+					}
+					break;
+
+				default:
+					_complete();
+			}
+			break;
+
+		case ide::ATAPI_SET_CD_SPEED:
+			_trace("speed=%u KB/s", _getBE16(&param[1]));
+
+			if (abortPowerCommands)
+				_checkCondition(
+					ide::SENSE_KEY_ILLEGAL_REQUEST, ide::ASC_INVALID_COMMAND
+				);
+			else
+				_complete();
+			break;
+
+		default:
+			_checkCondition(
+				ide::SENSE_KEY_ILLEGAL_REQUEST, ide::ASC_INVALID_COMMAND
+			);
+	}
+}
+
+// Carries out the action the drive is busy with once its latency has elapsed.
+// This is done on every register access, but can also be triggered without
+// accessing the drive to simulate it progressing on its own.
+void IDEDrive::update(void) {
+	if ((_phase != PHASE_BUSY) || (getHostTime() < _readyTime))
+		return;
+
+	auto action = _action;
+	_action     = ACTION_NONE;
+
+	switch (action) {
+		case ACTION_RESET:
+			// Set up the registers to contain the device signature.
+			_features     = 0;
+			_count[0]     = 1;
+			_sector[0]    = 1;
+			_cylinderL[0] = atapi ? ((_ATAPI_SIGNATURE >> 0) & 0xff) : 0;
+			_cylinderH[0] = atapi ? ((_ATAPI_SIGNATURE >> 8) & 0xff) : 0;
+			_deviceSel   &= 1 << 4;
+			_error        = 1; // Diagnostics passed
+
+			// ATAPI drives do not set DRDY until they receive a command.
+			_phase  = PHASE_IDLE;
+			_status = atapi ? 0 : (ide::CS0_STATUS_DRDY | ide::CS0_STATUS_DSC);
+
+			if (
+				atapi && resetUnitAttention &&
+				(_command != ide::ATA_DEVICE_RESET)
+			)
+				_unitAttention = ide::ASC_RESET_OCCURRED;
+
+			_trace("reset done");
+			break;
+
+		case ACTION_COMPLETE:
+			_complete();
+			break;
+
+		case ACTION_DATA_IN:
+			_startDataIn(_bufferLength);
+			break;
+
+		case ACTION_READ_BLOCK:
+			{
+				auto count = util::min(_remaining, _maxBlockSectors);
+
+				if (_checkFault(_lba, count) || !_readMedia(_lba, count)) {
+					_mediaError(ide::CS0_ERROR_UNC);
+					break;
+				}
+
+				_blockSectors = count;
+				_startDataIn(count * getSectorSize());
+			}
+			break;
+
+		case ACTION_REQUEST_BLOCK:
+			_blockSectors = util::min(_remaining, _maxBlockSectors);
+			_startDataOut(_blockSectors * getSectorSize());
+			break;
+
+		case ACTION_WRITE_BLOCK:
+			if (
+				_checkFault(_lba, _blockSectors) ||
+				!_writeMedia(_lba, _blockSectors)
+			) {
+				_mediaError(ide::CS0_ERROR_IDNF);
+				break;
+			}
+
+			_lba       += _blockSectors;
+			_lastLBA    = _lba;
+			_remaining -= _blockSectors;
+
+			if (_remaining) {
+				_blockSectors = util::min(_remaining, _maxBlockSectors);
+				_startDataOut(_blockSectors * getSectorSize());
+			} else {
+				_complete();
+			}
+			break;
+
+		case ACTION_PACKET:
+			_executePacket();
+			break;
+
+		default:
+			break;
+	}
+}
+
+/* Public API */
+
+bool IDEDrive::open(const char *path, bool _atapi, bool _readOnly) {
+	close();
+
+	_file = ::open(path, _readOnly ? O_RDONLY : O_RDWR);
+
+	if (_file < 0)
+		return false;
+
+	struct stat info;
+
+	atapi    = _atapi;
+	readOnly = _readOnly;
+
+	if (fstat(_file, &info) || !(info.st_size / getSectorSize())) {
+		close();
+		return false;
+	}
+
+	_numSectors = info.st_size / getSectorSize();
+	_lastLBA    = 0;
+	_spunDown   = true;
+	_spinUpEnd  = 0;
+
+	// Emulate the drive being powered on.
+	_command = 0;
+	_setBusy(resetTime, ACTION_RESET);
+	return true;
+}
+
+void IDEDrive::close(void) {
+	if (_file >= 0) {
+		::close(_file);
+		_file = -1;
+	}
+
+	_numSectors = 0;
+}
+
+// Returns the time at which the drive will stop being busy, or UINT64_MAX if it
+// is not busy (or hung). INTRQ is asserted at that point unless the drive is
+// coming out of reset or about to execute an ATAPI packet, which may only keep
+// it busy for longer. DMA transfers only assert it once all data has been
+// transferred.
+uint64_t IDEDrive::getReadyTime(bool *irq) const {
+	bool busy = (_phase == PHASE_BUSY) && (_action != ACTION_NONE);
+
+	if (irq) {
+		*irq = busy && (_action != ACTION_RESET) && (_action != ACTION_PACKET);
+
+		if (_dma && (
+			(_action == ACTION_READ_BLOCK) ||
+			(_action == ACTION_REQUEST_BLOCK) ||
+			((_action == ACTION_WRITE_BLOCK) && (_remaining > _blockSectors))
+		))
+			*irq = false;
+	}
+
+	return busy ? _readyTime : UINT64_MAX;
+}
+
+void IDEDrive::setReset(bool asserted) {
+	if (asserted) {
+		_phase     = PHASE_BUSY;
+		_action    = ACTION_NONE;
+		_status    = ide::CS0_STATUS_BSY;
+		_readyTime = UINT64_MAX;
+		_command   = 0;
+
+		_trace("reset");
+	} else {
+		_setBusy(resetTime, ACTION_RESET);
+	}
+}
+
+uint16_t IDEDrive::read(int cs, int reg) {
+	update();
+
+	if (cs)
+		return (reg == ide::CS1_ALT_STATUS) ? _status : 0xff;
+
+	switch (reg) {
+		case ide::CS0_DATA:
+			{
+				if (_phase != PHASE_DATA_IN)
+					return 0xffff;
+
+				uint16_t value = 0
+					| (_buffer[_bufferOffset + 0] << 0)
+					| (_buffer[_bufferOffset + 1] << 8);
+
+				_bufferOffset += 2;
+
+				if (_bufferOffset >= _bufferLength)
+					_finishDataIn();
+
+				return value;
+			}
+
+		case ide::CS0_ERROR:
+			return _error;
+
+		case ide::CS0_COUNT:
+			return _count[0];
+
+		case ide::CS0_SECTOR:
+			return _sector[0];
+
+		case ide::CS0_CYLINDER_L:
+			return _cylinderL[0];
+
+		case ide::CS0_CYLINDER_H:
+			return _cylinderH[0];
+
+		case ide::CS0_DEVICE_SEL:
+			return _deviceSel;
+
+		case ide::CS0_STATUS:
+			return _status;
+
+		default:
+			return 0xff;
+	}
+}
+
+void IDEDrive::write(int cs, int reg, uint16_t value) {
+	update();
+
+	if (cs)
+		return;
+
+	switch (reg) {
+		case ide::CS0_DATA:
+			if ((_phase != PHASE_DATA_OUT) && (_phase != PHASE_PACKET))
+				break;
+
+			_buffer[_bufferOffset + 0] = (value >> 0) & 0xff;
+			_buffer[_bufferOffset + 1] = (value >> 8) & 0xff;
+			_bufferOffset             += 2;
+
+			if (_bufferOffset >= _bufferLength)
+				_finishDataOut();
+			break;
+
+		case ide::CS0_FEATURES:
+			_features = value;
+			break;
+
+		case ide::CS0_COUNT:
+			_count[1] = _count[0];
+			_count[0] = value;
+			break;
+
+		case ide::CS0_SECTOR:
+			_sector[1] = _sector[0];
+			_sector[0] = value;
+			break;
+
+		case ide::CS0_CYLINDER_L:
+			_cylinderL[1] = _cylinderL[0];
+			_cylinderL[0] = value;
+			break;
+
+		case ide::CS0_CYLINDER_H:
+			_cylinderH[1] = _cylinderH[0];
+			_cylinderH[0] = value;
+			break;
+
+		case ide::CS0_DEVICE_SEL:
+			_deviceSel = value;
+			break;
+
+		case ide::CS0_COMMAND:
+			// Commands are ignored while busy, with the exception of DEVICE
+			// RESET on ATAPI drives.
+			if (
+				(_phase == PHASE_BUSY) || (_phase == PHASE_HUNG) ||
+				(_phase == PHASE_DATA_IN) || (_phase == PHASE_DATA_OUT)
+			) {
+				if (!atapi || (value != ide::ATA_DEVICE_RESET))
+					break;
+			}
+
+			_command = value;
+			_execute();
+			break;
+	}
+}
+
+// Moves up to the given number of bytes between the drive's buffer and memory
+// as part of a DMA transfer, returning the number of bytes actually moved. No
+// data is moved while the drive is busy or not executing a DMA command.
+size_t IDEDrive::transferDMA(void *data, size_t length, bool write) {
+	update();
+
+	auto phase = write ? PHASE_DATA_OUT : PHASE_DATA_IN;
+
+	if (!_dma || stallDMA || (_phase != phase))
+		return 0;
+
+	length = util::min(length, _bufferLength - _bufferOffset);
+
+	if (write)
+		__builtin_memcpy(&_buffer[_bufferOffset], data, length);
+	else
+		__builtin_memcpy(data, &_buffer[_bufferOffset], length);
+
+	advanceHostTime(uint64_t(length / 2) * _dmaCycleTime);
+	_bufferOffset += length;
+
+	if (_bufferOffset >= _bufferLength) {
+		if (write)
+			_finishDataOut();
+		else
+			_finishDataIn();
+	}
+
+	return length;
+}
+
+/* Emulated bus */
+
+// The DMA channel used by the driver is wired to the IDE data register on the
+// 573, with DMARQ pausing the transfer whenever the drive has no data ready.
+static void _handleDMA(void *arg) {
+	auto &bus     = *reinterpret_cast<IDEBus *>(arg);
+	auto &channel = hostDMAChannels[DMA_PIO];
+
+	bool   write  = channel.chcr & DMA_CHCR_WRITE;
+	size_t length = channel.bcr * 4;
+
+	while (length) {
+		auto moved = bus.transferDMA(
+			reinterpret_cast<void *>(channel.madr), length, write
+		);
+
+		if (!moved)
+			break;
+
+		channel.madr += moved;
+		length       -= moved;
+	}
+
+	channel.bcr = length / 4;
+
+	if (!length)
+		channel.chcr &= ~DMA_CHCR_ENABLE;
+}
+
+IDEBus::IDEBus(void)
+: _deviceCtrl(0), _selected(0) {
+	drives[0] = nullptr;
+	drives[1] = nullptr;
+
+	setHostDMAHandler(DMA_PIO, &_handleDMA, this);
+}
+
+void IDEBus::attach(int index, IDEDrive *drive) {
+	drives[index] = drive;
+
+	if (drive)
+		drive->index = index;
+}
+
+// Returns the time at which INTRQ will be asserted by the currently selected
+// drive, or UINT64_MAX if it is not going to be.
+uint64_t IDEBus::getIRQTime(void) const {
+	auto drive = drives[_selected];
+	bool irq   = false;
+
+	if (!drive || (_deviceCtrl & ide::CS1_DEVICE_CTRL_IEN))
+		return UINT64_MAX;
+
+	auto time = drive->getReadyTime(&irq);
+
+	return irq ? time : UINT64_MAX;
+}
+
+uint16_t IDEBus::read(int cs, int reg) {
+	auto drive = drives[_selected];
+
+	// With no drive present, the bus floats high and the status register reads
+	// as busy.
+	if (!drive) {
+		advanceHostTime(_PIO_CYCLE_TIMES[0]);
+		return 0xffff;
+	}
+
+	advanceHostTime(drive->getAccessTime());
+	return drive->read(cs, reg);
+}
+
+void IDEBus::write(int cs, int reg, uint16_t value) {
+	auto drive = drives[_selected];
+
+	advanceHostTime(drive ? drive->getAccessTime() : _PIO_CYCLE_TIMES[0]);
+
+	if (cs) {
+		if (reg != ide::CS1_DEVICE_CTRL)
+			return;
+
+		// Software resets apply to both drives on the bus.
+		bool reset = value & ide::CS1_DEVICE_CTRL_SRST;
+
+		if (reset != bool(_deviceCtrl & ide::CS1_DEVICE_CTRL_SRST)) {
+			for (auto other : drives) {
+				if (other)
+					other->setReset(reset);
+			}
+		}
+
+		_deviceCtrl = value;
+		return;
+	}
+
+	// Data transfers and commands only go to the selected drive, while the
+	// remaining registers are written to both drives.
+	if ((reg == ide::CS0_DATA) || (reg == ide::CS0_COMMAND)) {
+		if (drive)
+			drive->write(cs, reg, value);
+		return;
+	}
+
+	if (reg == ide::CS0_DEVICE_SEL)
+		_selected = (value >> 4) & 1;
+
+	for (auto other : drives) {
+		if (other)
+			other->write(cs, reg, value);
+	}
+}
+
+size_t IDEBus::transferDMA(void *data, size_t length, bool write) {
+	auto drive = drives[_selected];
+
+	return drive ? drive->transferDMA(data, length, write) : 0;
+}
+
+}
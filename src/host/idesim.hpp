@@ -0,0 +1,179 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "common/ide.hpp"
+
+namespace host {
+
+/* Emulated drive */
+
+enum IDEDrivePhase {
+	PHASE_IDLE     = 0,
+	PHASE_BUSY     = 1,
+	PHASE_DATA_IN  = 2,
+	PHASE_DATA_OUT = 3,
+	PHASE_PACKET   = 4,
+	PHASE_HUNG     = 5
+};
+
+enum IDEDriveAction {
+	ACTION_NONE          = 0,
+	ACTION_RESET         = 1,
+	ACTION_COMPLETE      = 2,
+	ACTION_DATA_IN       = 3,
+	ACTION_READ_BLOCK    = 4,
+	ACTION_REQUEST_BLOCK = 5,
+	ACTION_WRITE_BLOCK   = 6,
+	ACTION_PACKET        = 7
+};
+
+// Register-level model of an ATA hard drive or ATAPI CD-ROM drive backed by an
+// image file. PIO transfers and, if enabled, multiword DMA transfers through
+// the DMA channel wired to the IDE bus are emulated. All timings are in
+// microseconds of simulated time; commands complete lazily, i.e. the drive's
+// state is only updated once the driver polls it after the command's latency
+// has elapsed.
+class IDEDrive {
+private:
+	int      _file;
+	uint64_t _numSectors, _readyTime, _spinUpEnd, _startTime;
+	int      _accessTime, _dmaCycleTime;
+
+	IDEDrivePhase  _phase;
+	IDEDriveAction _action;
+
+	// The LBA48 task file is implemented as a two-entry FIFO per register,
+	// with index 0 holding the most recently written value.
+	uint8_t _features, _count[2], _sector[2], _cylinderL[2], _cylinderH[2];
+	uint8_t _deviceSel, _status, _error, _command, _packetCommand;
+
+	uint64_t _lba, _lastLBA;
+	uint32_t _remaining, _blockSectors, _maxBlockSectors, _multiSectorCount;
+	bool     _spunDown, _dma;
+
+	uint8_t *_buffer;
+	size_t   _bufferOffset, _bufferLength;
+
+	// A pending unit attention condition is stored as a packed ASC value, with
+	// zero meaning none.
+	ide::SenseData _sense;
+	uint16_t       _unitAttention;
+	uint32_t       _numCommands, _numMediaAccesses;
+
+	void _trace(const char *format, ...) const;
+	void _setBusy(int time, IDEDriveAction action);
+	void _setIdle(uint8_t status);
+	void _complete(void);
+	void _abort(uint8_t error = ide::CS0_ERROR_ABRT);
+	void _checkCondition(
+		ide::ATAPISenseKey key, uint16_t asc, uint64_t lba = 0
+	);
+	void _mediaError(uint8_t error);
+	void _startDataIn(size_t length);
+	void _startDataOut(size_t length);
+	void _finishDataIn(void);
+	void _finishDataOut(void);
+
+	uint64_t _getLBA(bool ext) const;
+	uint32_t _getCount(bool ext) const;
+	bool _checkFault(uint64_t lba, size_t count);
+	bool _readMedia(uint64_t lba, size_t count);
+	bool _writeMedia(uint64_t lba, size_t count);
+	int _getSeekTime(uint64_t lba);
+	bool _checkReady(void);
+
+	void _identify(void);
+	void _setFeatures(void);
+	void _ataTransfer(bool write, bool multiple, bool ext, bool dma);
+	void _execute(void);
+	void _executePacket(void);
+
+public:
+	int  index;
+	bool atapi, readOnly, lba48;
+
+	// Reported capabilities (a negative DMA mode disables DMA support)
+	int pioMode, maxMultiSectorCount, dmaMode;
+
+	// Latencies (in microseconds)
+	int resetTime, commandTime, seekTime, sectorTime, spinUpTime;
+
+	// Fault injection. errorLBA makes any media access covering the given
+	// sector fail, errorInterval and hangInterval make every Nth media access
+	// fail or every Nth command never complete (until the drive is reset) and
+	// abortMultiple makes the drive abort READ/WRITE MULTIPLE commands despite
+	// reporting support for multiple mode. abortDMA does the same for DMA
+	// commands, while stallDMA makes the drive accept them but never actually
+	// transfer any data. abortPowerCommands makes the drive reject the optional
+	// IDLE and SET CD SPEED commands used to select a drive profile.
+	int64_t  errorLBA;
+	uint32_t errorInterval, hangInterval;
+	bool     abortMultiple, abortDMA, stallDMA, abortPowerCommands;
+	bool     resetUnitAttention;
+
+	FILE *traceOutput;
+
+	IDEDrive(void);
+	~IDEDrive(void);
+
+	bool open(const char *path, bool _atapi, bool _readOnly = true);
+	void close(void);
+
+	inline uint64_t getCapacity(void) const {
+		return _numSectors;
+	}
+	inline size_t getSectorSize(void) const {
+		return atapi ? ide::ATAPI_SECTOR_SIZE : ide::ATA_SECTOR_SIZE;
+	}
+	inline int getAccessTime(void) const {
+		return _accessTime;
+	}
+
+	uint64_t getReadyTime(bool *irq = nullptr) const;
+	void update(void);
+	void setReset(bool asserted);
+	uint16_t read(int cs, int reg);
+	void write(int cs, int reg, uint16_t value);
+	size_t transferDMA(void *data, size_t length, bool write);
+};
+
+/* Emulated bus */
+
+class IDEBus {
+private:
+	uint8_t _deviceCtrl, _selected;
+
+public:
+	IDEDrive *drives[2];
+
+	IDEBus(void);
+
+	void attach(int index, IDEDrive *drive);
+	uint64_t getIRQTime(void) const;
+	uint16_t read(int cs, int reg);
+	void write(int cs, int reg, uint16_t value);
+	size_t transferDMA(void *data, size_t length, bool write);
+};
+
+// Bus accessed by the driver through the IDE register proxies.
+extern IDEBus ideBus;
+
+}
@@ -0,0 +1,85 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ps1/pcdrv.h"
+
+/*
+ * Host replacement for ps1/pcdrv.s. There is no debugger to forward PCDRV
+ * calls to on the host, so all of them fail as they would on a 573 with no
+ * debugger attached.
+ */
+
+/* Standard PCDRV API */
+
+int pcdrvInit(void) {
+	return -1;
+}
+
+int pcdrvCreate(const char *path, uint32_t attributes) {
+	return -1;
+}
+
+int pcdrvOpen(const char *path, PCDRVOpenMode mode) {
+	return -1;
+}
+
+int pcdrvClose(int fd) {
+	return -1;
+}
+
+int pcdrvRead(int fd, void *data, size_t length) {
+	return -1;
+}
+
+int pcdrvWrite(int fd, const void *data, size_t length) {
+	return -1;
+}
+
+int pcdrvSeek(int fd, int offset, PCDRVSeekMode mode) {
+	return -1;
+}
+
+/* Extended PCDRV API */
+
+int pcdrvCreateDir(const char *path) {
+	return -1;
+}
+
+int pcdrvRemoveDir(const char *path) {
+	return -1;
+}
+
+int pcdrvUnlink(const char *path) {
+	return -1;
+}
+
+int pcdrvChmod(const char *path, uint32_t attributes) {
+	return -1;
+}
+
+int pcdrvFindFirst(const char *path, PCDRVDirEntry *entry) {
+	return -1;
+}
+
+int pcdrvFindNext(int fd, PCDRVDirEntry *entry) {
+	return -1;
+}
+
+int pcdrvRename(const char *path, const char *newPath) {
+	return -1;
+}
@@ -0,0 +1,67 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host wrapper around ps1/registers.h. The timer counter registers are replaced
+ * with values derived from the simulated time (see ps1/system.h), so that code
+ * measuring elapsed time through the timers keeps working on the host. The DMA
+ * channel registers are replaced with plain variables, which emulated devices
+ * can act upon when waitForDMATransfer() is called, and the scratchpad area is
+ * backed by a static buffer. All other registers are left as-is and must not
+ * be accessed.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include_next "ps1/registers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Returns the current value of the given timer's counter, derived from
+ * the simulated time (host only).
+ *
+ * @param index
+ */
+uint16_t getHostTimerValue(int index);
+
+// The address register is widened to hold a host pointer.
+typedef struct {
+	uintptr_t madr;
+	uint32_t  bcr, chcr;
+} HostDMAChannel;
+
+extern HostDMAChannel hostDMAChannels[DMA_OTC + 1];
+extern uint32_t       hostScratchpad[1024 / 4];
+
+#ifdef __cplusplus
+}
+#endif
+
+#undef TIMER_VALUE
+#define TIMER_VALUE(N) getHostTimerValue(N)
+
+#undef DMA_MADR
+#undef DMA_BCR
+#undef DMA_CHCR
+#define DMA_MADR(N) (hostDMAChannels[N].madr)
+#define DMA_BCR(N)  (hostDMAChannels[N].bcr)
+#define DMA_CHCR(N) (hostDMAChannels[N].chcr)
+
+#define CACHE_BASE ((uintptr_t) hostScratchpad)
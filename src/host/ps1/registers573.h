@@ -0,0 +1,112 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host wrapper around ps1/registers573.h. The IDE register banks are replaced
+ * with arrays of proxy objects, which forward all accesses made by the driver
+ * to the emulated IDE bus (see host/idesim.hpp) without any further changes to
+ * the driver. The flash and PCMCIA card window and the bank switch register
+ * are proxied the same way, forwarding accesses to the emulated flash bus (see
+ * host/flashemu.hpp), while the input registers hold plain values that can be
+ * set by the simulators (e.g. to report which PCMCIA slots are populated).
+ * The RTC registers are backed by plain variables as well, holding a fixed date
+ * so that timestamps written by the file system drivers are reproducible.
+ */
+
+#pragma once
+
+#include_next "ps1/registers573.h"
+
+#ifdef __cplusplus
+#include <stddef.h>
+#include <stdint.h>
+
+namespace host {
+
+class IDERegister {
+public:
+	uint8_t cs, reg;
+
+	operator uint16_t(void) const;
+	IDERegister &operator=(uint16_t value);
+};
+
+class FlashRegister {
+public:
+	operator uint16_t(void) const;
+	FlashRegister &operator=(uint16_t value);
+};
+
+class BankRegister {
+public:
+	operator uint16_t(void) const;
+	BankRegister &operator=(uint16_t value);
+};
+
+class InputRegister {
+public:
+	uint16_t value;
+
+	inline operator uint16_t(void) const {
+		return value;
+	}
+};
+
+static constexpr size_t FLASH_WINDOW_LENGTH = 0x400000;
+
+extern IDERegister   ideCS0Registers[8], ideCS1Registers[8];
+extern FlashRegister flashRegisters[FLASH_WINDOW_LENGTH / 2];
+extern BankRegister  bankCtrlRegister;
+extern InputRegister miscInRegister, jammaMainRegister;
+extern InputRegister jammaExt1Register, jammaExt2Register;
+extern uint16_t      rtcRegisters[8];
+
+}
+
+#undef SYS573_IDE_CS0_BASE
+#undef SYS573_IDE_CS1_BASE
+#undef SYS573_MISC_IN
+#undef SYS573_JAMMA_MAIN
+#undef SYS573_JAMMA_EXT1
+#undef SYS573_JAMMA_EXT2
+#undef SYS573_BANK_CTRL
+#undef SYS573_FLASH_BASE
+#undef SYS573_RTC_CTRL
+#undef SYS573_RTC_SECOND
+#undef SYS573_RTC_MINUTE
+#undef SYS573_RTC_HOUR
+#undef SYS573_RTC_WEEKDAY
+#undef SYS573_RTC_DAY
+#undef SYS573_RTC_MONTH
+#undef SYS573_RTC_YEAR
+
+#define SYS573_IDE_CS0_BASE (host::ideCS0Registers)
+#define SYS573_IDE_CS1_BASE (host::ideCS1Registers)
+#define SYS573_MISC_IN      (host::miscInRegister)
+#define SYS573_JAMMA_MAIN   (host::jammaMainRegister)
+#define SYS573_JAMMA_EXT1   (host::jammaExt1Register)
+#define SYS573_JAMMA_EXT2   (host::jammaExt2Register)
+#define SYS573_BANK_CTRL    (host::bankCtrlRegister)
+#define SYS573_FLASH_BASE   (host::flashRegisters)
+#define SYS573_RTC_CTRL     (host::rtcRegisters[0])
+#define SYS573_RTC_SECOND   (host::rtcRegisters[1])
+#define SYS573_RTC_MINUTE   (host::rtcRegisters[2])
+#define SYS573_RTC_HOUR     (host::rtcRegisters[3])
+#define SYS573_RTC_WEEKDAY  (host::rtcRegisters[4])
+#define SYS573_RTC_DAY      (host::rtcRegisters[5])
+#define SYS573_RTC_MONTH    (host::rtcRegisters[6])
+#define SYS573_RTC_YEAR     (host::rtcRegisters[7])
+#endif
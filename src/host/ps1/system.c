@@ -0,0 +1,158 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ps1/registers.h"
+#include "ps1/system.h"
+
+/* Internal state */
+
+static Thread   _mainThread;
+static uint64_t _hostTime = 0;
+
+static ArgFunction _hostMainFunc = 0;
+static void       *_hostMainArg  = 0;
+
+static ArgFunction _hostDMAFuncs[DMA_OTC + 1];
+static void       *_hostDMAArgs[DMA_OTC + 1];
+
+HostDMAChannel hostDMAChannels[DMA_OTC + 1];
+uint32_t       hostScratchpad[1024 / 4];
+
+Thread *currentThread = &_mainThread;
+Thread *nextThread    = &_mainThread;
+
+/* Exception handler setup */
+
+void installExceptionHandler(void) {}
+void uninstallExceptionHandler(void) {}
+void setInterruptHandler(ArgFunction func, void *arg) {}
+void flushCache(void) {}
+
+void softReset(void) {
+	abort();
+}
+
+/* Serial port setup */
+
+// Log output is written to the host's standard streams, so there is no serial
+// port to set up.
+void initSerialIO(int baud) {}
+
+/* Timing */
+
+void delayMicroseconds(int time) {
+	if (time > 0)
+		_hostTime += (uint64_t) time * 1000;
+}
+
+void delayMicrosecondsBusy(int time) {
+	delayMicroseconds(time);
+}
+
+// Timer 1 is assumed to be set up to count horizontal blanking periods (as
+// done by the main app), while all other timers count the system clock.
+static const uint64_t _HBLANK_PERIOD = 63556; // NTSC line, in nanoseconds
+
+uint16_t getHostTimerValue(int index) {
+	if (index == 1)
+		return (uint16_t) (_hostTime / _HBLANK_PERIOD);
+
+	return (uint16_t) ((_hostTime * 338688) / 10000000);
+}
+
+uint64_t getHostTime(void) {
+	return _hostTime;
+}
+
+void advanceHostTime(uint64_t time) {
+	_hostTime += time;
+}
+
+/* IRQ acknowledgement */
+
+bool acknowledgeInterrupt(IRQChannel irq) {
+	if (IRQ_STAT & (1 << irq)) {
+		IRQ_STAT = ~(1 << irq);
+		return true;
+	}
+
+	return false;
+}
+
+bool waitForInterrupt(IRQChannel irq, int timeout) {
+	for (; timeout > 0; timeout -= 10) {
+		if (acknowledgeInterrupt(irq))
+			return true;
+
+		delayMicroseconds(10);
+	}
+
+	return false;
+}
+
+bool waitForDMATransfer(DMAChannel dma, int timeout) {
+	for (; timeout > 0; timeout -= 10) {
+		if (_hostDMAFuncs[dma] && (DMA_CHCR(dma) & DMA_CHCR_ENABLE))
+			_hostDMAFuncs[dma](_hostDMAArgs[dma]);
+		if (!(DMA_CHCR(dma) & DMA_CHCR_ENABLE))
+			return true;
+
+		delayMicroseconds(10);
+	}
+
+	return false;
+}
+
+void setHostDMAHandler(DMAChannel dma, ArgFunction func, void *arg) {
+	_hostDMAFuncs[dma] = func;
+	_hostDMAArgs[dma]  = arg;
+}
+
+/* Thread switching */
+
+void switchThread(Thread *thread) {
+	if (!thread)
+		thread = &_mainThread;
+
+	nextThread = thread;
+}
+
+void switchThreadImmediate(Thread *thread) {
+	switchThread(thread);
+
+	if ((nextThread == currentThread) || !_hostMainFunc)
+		return;
+
+	// Only yielding to the main thread is supported, which is simulated by
+	// calling the function registered through setHostThread().
+	_hostMainFunc(_hostMainArg);
+	nextThread = currentThread;
+}
+
+void setHostThread(Thread *thread, ArgFunction func, void *arg) {
+	if (!thread)
+		thread = &_mainThread;
+
+	currentThread = thread;
+	nextThread    = thread;
+	_hostMainFunc = func;
+	_hostMainArg  = arg;
+}
+
@@ -0,0 +1,117 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host replacement for ps1/system.h, used when building the device simulators.
+ * It exposes the same API but relies on no inline assembly; interrupts do not
+ * exist and time is simulated, i.e. delays advance a counter (which emulated
+ * devices also advance as they are accessed) instead of actually blocking.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ps1/registers.h"
+
+typedef struct {
+	uintptr_t pc, arg, sp;
+} Thread;
+
+typedef void (*VoidFunction)(void);
+typedef void (*ArgFunction)(void *arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern Thread *currentThread;
+extern Thread *nextThread;
+
+static inline void enableInterrupts(void) {}
+static inline bool disableInterrupts(void) {
+	return false;
+}
+
+// Only one thread can run on the host, so the thread structure is set up but
+// never actually switched to (see setHostThread()).
+static inline void initThread(
+	Thread *thread, ArgFunction func, void *arg, void *stack
+) {
+	thread->pc  = (uintptr_t) func;
+	thread->arg = (uintptr_t) arg;
+	thread->sp  = (uintptr_t) stack;
+}
+
+void installExceptionHandler(void);
+void uninstallExceptionHandler(void);
+void setInterruptHandler(ArgFunction func, void *arg);
+void flushCache(void);
+void softReset(void);
+
+void delayMicroseconds(int time);
+void delayMicrosecondsBusy(int time);
+bool acknowledgeInterrupt(IRQChannel irq);
+bool waitForInterrupt(IRQChannel irq, int timeout);
+bool waitForDMATransfer(DMAChannel dma, int timeout);
+
+void switchThread(Thread *thread);
+void switchThreadImmediate(Thread *thread);
+
+/**
+ * @brief Makes all code from now on run as if it were in the given thread
+ * rather than in the main thread (host only). Whenever it then yields to the
+ * main thread through switchThreadImmediate(), the provided function is called
+ * in place of the main thread and is expected to advance the simulated time
+ * until the main thread would switch back. Passing a null thread reverts to
+ * running as the main thread.
+ *
+ * @param thread
+ * @param func
+ * @param arg
+ */
+void setHostThread(Thread *thread, ArgFunction func, void *arg);
+
+/**
+ * @brief Registers a function emulating the device connected to the given DMA
+ * channel (host only). The function is called repeatedly while
+ * waitForDMATransfer() waits for the channel and is expected to move as much
+ * data as the device can currently accept or provide, updating the channel's
+ * registers and clearing DMA_CHCR_ENABLE once the transfer is complete.
+ *
+ * @param dma
+ * @param func
+ * @param arg
+ */
+void setHostDMAHandler(DMAChannel dma, ArgFunction func, void *arg);
+
+/**
+ * @brief Returns the amount of simulated time elapsed since startup in
+ * nanoseconds (host only).
+ */
+uint64_t getHostTime(void);
+
+/**
+ * @brief Advances the simulated time by the given number of nanoseconds (host
+ * only). Called by emulated devices to account for bus access times.
+ *
+ * @param time
+ */
+void advanceHostTime(uint64_t time);
+
+#ifdef __cplusplus
+}
+#endif
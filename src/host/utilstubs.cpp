@@ -0,0 +1,36 @@
+/*
+ * 573in1 - Copyright (C) 2022-2024 spicyjpeg
+ *
+ * 573in1 is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * 573in1 is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * 573in1. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "common/util.hpp"
+
+/*
+ * Replacements for the parts of common/util.cpp that can only be built for the
+ * 573. The host build compiles a copy of util.cpp with these functions cut off
+ * (see CMakeLists.txt).
+ */
+
+namespace util {
+
+[[noreturn]] void ExecutableLoader::run(
+	int rawArgc, const char *const *rawArgv
+) {
+	fprintf(stderr, "executables can only be launched on the 573\n");
+	abort();
+}
+
+}
@@ -82,8 +82,11 @@ WorkerStatusType WorkerStatus::setStatus(WorkerStatusType value) {
 
 const char *const IDE_MOUNT_POINTS[]{ "ide0:", "ide1:" };
 
+static constexpr size_t _ATAPI_READAHEAD_LENGTH = 16;
+
 FileIOManager::FileIOManager(void)
-: _resourceFile(nullptr), resourcePtr(nullptr), resourceLength(0) {
+: _resourceFile(nullptr), _driveProfile(ide::PROFILE_QUIET),
+resourcePtr(nullptr), resourceLength(0) {
 	__builtin_memset(ide, 0, sizeof(ide));
 
 	vfs.mount("resource:", &resource);
@@ -105,6 +108,10 @@ void FileIOManager::initIDE(void) {
 		// already mounted device, so if two hard drives or CD-ROMs are present
 		// the hdd:/cdrom: prefix will be assigned to the first one.
 		if (dev.flags & ide::DEVICE_ATAPI) {
+			// Enable readahead to speed up sequential reads of small chunks,
+			// which are common when parsing files on a CD-ROM.
+			dev.setReadaheadLength(_ATAPI_READAHEAD_LENGTH);
+
 			auto iso = new file::ISO9660Provider();
 
 			if (!iso->init(i)) {
@@ -128,10 +135,16 @@ void FileIOManager::initIDE(void) {
 
 		vfs.mount(IDE_MOUNT_POINTS[i], ide[i], true);
 	}
+
+	// Drives are put into the low power profile by default, as some of them
+	// would otherwise spin down very aggressively.
+	setDriveProfile(ide::PROFILE_QUIET, true);
 }
 
 void FileIOManager::closeIDE(void) {
 	for (size_t i = 0; i < util::countOf(ide::devices); i++) {
+		ide::devices[i].setReadaheadLength(0);
+
 		if (!ide[i])
 			continue;
 
@@ -146,9 +159,32 @@ void FileIOManager::closeIDE(void) {
 	vfs.unmount("hdd:");
 }
 
+void FileIOManager::setDriveProfile(ide::DriveProfile profile, bool force) {
+	if ((profile == _driveProfile) && !force)
+		return;
+
+	_driveProfile = profile;
+
+	for (auto &dev : ide::devices) {
+		if (!(dev.flags & ide::DEVICE_READY))
+			continue;
+
+		auto error = dev.setProfile(profile);
+
+		if (error)
+			LOG_APP(
+				"drive %d: %s", dev.getDriveIndex(), ide::getErrorString(error)
+			);
+	}
+}
+
 bool FileIOManager::loadResourceFile(const char *path) {
 	closeResourceFile();
 
+	// The resource archive is replaced without remounting it, so any cached
+	// information about its files must be discarded manually.
+	vfs.flushCache();
+
 	if (path)
 		_resourceFile = vfs.openFile(path, file::READ);
 
@@ -181,6 +217,7 @@ void FileIOManager::closeResourceFile(void) {
 static constexpr size_t _WORKER_STACK_SIZE = 0x20000;
 
 static constexpr int _SPLASH_SCREEN_TIMEOUT = 5;
+static constexpr int _QUIET_PROFILE_DELAY   = 10;
 
 App::App(ui::Context &ctx)
 #ifdef ENABLE_LOG_BUFFER
@@ -188,7 +225,8 @@ App::App(ui::Context &ctx)
 #else
 :
 #endif
-_ctx(ctx), _cartDriver(nullptr), _cartParser(nullptr), _identified(nullptr) {}
+_ctx(ctx), _workerIOActive(false), _cartDriver(nullptr), _cartParser(nullptr),
+_identified(nullptr) {}
 
 App::~App(void) {
 	_unloadCartData();
@@ -219,7 +257,9 @@ void App::_setupInterrupts(void) {
 		util::forcedCast<ArgFunction>(&App::_interruptHandler), this
 	);
 
-	IRQ_MASK = 1 << IRQ_VSYNC;
+	IRQ_MASK = 0
+		| (1 << IRQ_VSYNC)
+		| (1 << IRQ_PIO);
 	enableInterrupts();
 }
 
@@ -336,9 +376,23 @@ void App::_updateOverlays(void) {
 	}
 }
 
-void App::_runWorker(
-	bool (App::*func)(void), ui::Screen &next, bool goBack, bool playSound
+// Workers that access drives in the background (i.e. while the UI is still
+// usable) flag themselves while doing so. Before the worker is replaced or the
+// data it is using is changed, the main thread must let it reach a point where
+// it is no longer accessing any drive, as abandoning it halfway through a
+// command would leave the drive waiting for the rest of it.
+void App::_waitForWorkerIO(void) {
+	while (_workerIOActive)
+		switchThreadImmediate(&_workerThread);
+}
+
+// Starts a worker without showing the worker status screen, e.g. to carry out
+// a task in the background.
+void App::_startWorker(
+	bool (App::*func)(void), ui::Screen &next, bool goBack
 ) {
+	_waitForWorkerIO();
+
 	auto enable = disableInterrupts();
 
 	_workerStatus.reset(next, goBack);
@@ -353,7 +407,12 @@ void App::_runWorker(
 	);
 	if (enable)
 		enableInterrupts();
+}
 
+void App::_runWorker(
+	bool (App::*func)(void), ui::Screen &next, bool goBack, bool playSound
+) {
+	_startWorker(func, next, goBack);
 	_ctx.show(_workerStatusScreen, false, playSound);
 }
 
@@ -363,12 +422,31 @@ void App::_worker(void) {
 
 	_workerStatus.setStatus(WORKER_DONE);
 
+	// Workers performing long operations may switch the drives to the high
+	// performance profile. It is only reverted once no other worker has been
+	// started for a while, so that running several operations in a row does
+	// not keep changing the drives' speed, but always eventually reverted even
+	// if the worker failed.
+	int timeout = _ctx.time + _ctx.gpuCtx.refreshRate * _QUIET_PROFILE_DELAY;
+
+	while (_ctx.time < timeout)
+		__asm__ volatile("" ::: "memory");
+
+	_workerIOActive = true;
+	_fileIO.setDriveProfile(ide::PROFILE_QUIET);
+	_workerIOActive = false;
+
 	// Do nothing while waiting for vblank once the task is done.
 	for (;;)
 		__asm__ volatile("");
 }
 
 void App::_interruptHandler(void) {
+	// The IDE IRQ is handled first, so that the main thread will still take
+	// priority over the worker if both interrupts are pending.
+	if (acknowledgeInterrupt(IRQ_PIO))
+		ide::handleInterrupt();
+
 	if (acknowledgeInterrupt(IRQ_VSYNC)) {
 		_ctx.tick();
 
@@ -415,7 +493,20 @@ void App::_interruptHandler(void) {
 		_updateOverlays();
 
 		_ctx.draw();
-		switchThreadImmediate(&_workerThread);
+
+		// Let the worker run for the rest of the frame. If it yields early to
+		// wait for the IDE IRQ, switch back to it as soon as the IRQ fires
+		// rather than on the next frame, which would otherwise limit it to
+		// one IDE command per frame.
+		int frame = _ctx.time;
+
+		do {
+			switchThreadImmediate(&_workerThread);
+
+			while ((_ctx.time == frame) && !ide::isInterruptPending())
+				__asm__ volatile("" ::: "memory");
+		} while (_ctx.time == frame);
+
 		_ctx.gpuCtx.flip();
 	}
 }
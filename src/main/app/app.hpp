@@ -68,7 +68,8 @@ extern const char *const IDE_MOUNT_POINTS[];
 
 class FileIOManager {
 private:
-	file::File *_resourceFile;
+	file::File        *_resourceFile;
+	ide::DriveProfile _driveProfile;
 
 public:
 	const void *resourcePtr;
@@ -90,6 +91,7 @@ public:
 
 	void initIDE(void);
 	void closeIDE(void);
+	void setDriveProfile(ide::DriveProfile profile, bool force = false);
 	bool loadResourceFile(const char *path);
 	void closeResourceFile(void);
 };
@@ -198,10 +200,11 @@ private:
 	cart::CartDB        _cartDB;
 	cart::ROMHeaderDB   _romHeaderDB;
 
-	Thread       _workerThread;
-	util::Data   _workerStack;
-	WorkerStatus _workerStatus;
-	bool         (App::*_workerFunction)(void);
+	Thread        _workerThread;
+	util::Data    _workerStack;
+	WorkerStatus  _workerStatus;
+	bool          (App::*_workerFunction)(void);
+	volatile bool _workerIOActive;
 
 	cart::Driver            *_cartDriver;
 	cart::CartParser        *_cartParser;
@@ -216,6 +219,10 @@ private:
 	);
 	bool _takeScreenshot(void);
 	void _updateOverlays(void);
+	void _waitForWorkerIO(void);
+	void _startWorker(
+		bool (App::*func)(void), ui::Screen &next, bool goBack = false
+	);
 	void _runWorker(
 		bool (App::*func)(void), ui::Screen &next, bool goBack = false,
 		bool playSound = false
@@ -245,6 +252,7 @@ private:
 	// miscworkers.cpp
 	bool _ideInitWorker(void);
 	bool _fileInitWorker(void);
+	bool _fileBrowserWorker(void);
 	bool _executableWorker(void);
 	bool _atapiEjectWorker(void);
 	bool _rebootWorker(void);
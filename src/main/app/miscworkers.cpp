@@ -42,20 +42,73 @@ static const char *const _AUTOBOOT_PATHS[][2]{
 	{ "hdd:/noboot.txt",   "hdd:/psx.exe"   }
 };
 
+static constexpr int _IDE_READY_TIMEOUT = 30;     // Seconds
+static constexpr int _IDE_POLL_DELAY    = 100000; // Microseconds
+
+static int _getElapsedTime(const ui::Context &ctx, int startTime) {
+	return ((ctx.time - startTime) * 1000) / ctx.gpuCtx.refreshRate;
+}
+
 bool App::_ideInitWorker(void) {
-	for (size_t i = 0; i < util::countOf(ide::devices); i++) {
+	constexpr size_t numDevices = util::countOf(ide::devices);
+
+	// Reset and identify all drives first, then wait for them to become ready
+	// at the same time, so that the time it takes for a CD-ROM drive to spin up
+	// does not add up to the time it takes for the other drive to do the same.
+	// Only the first drive needs to reset the bus, as doing so resets both.
+	bool resetBus = true;
+	bool pending[numDevices]{ false };
+	int  startTime = _ctx.time;
+
+	for (size_t i = 0; i < numDevices; i++) {
 		auto &dev = ide::devices[i];
 
 		if (dev.flags & ide::DEVICE_READY)
 			continue;
 
-		_workerStatus.update(
-			i, util::countOf(ide::devices), WSTR("App.ideInitWorker.init")
+		_workerStatus.update(i, numDevices, WSTR("App.ideInitWorker.init"));
+
+		dev.flags |= ide::DEVICE_IRQ;
+		auto error = dev.detect(resetBus);
+		resetBus   = false;
+		pending[i] = !error;
+
+		LOG_APP(
+			"drive %d: %s, detect=%d ms", i, ide::getErrorString(error),
+			_getElapsedTime(_ctx, startTime)
 		);
+	}
+
+	int timeout = startTime + _ctx.gpuCtx.refreshRate * _IDE_READY_TIMEOUT;
+
+	for (size_t left = numDevices; left;) {
+		left = 0;
+
+		for (size_t i = 0; i < numDevices; i++) {
+			if (!pending[i])
+				continue;
 
-		auto error = dev.enumerate();
+			auto error = ide::devices[i].poll(false);
 
-		LOG_APP("drive %d: %s", i, ide::getErrorString(error));
+			if ((error == ide::NOT_YET_READY) || (error == ide::DISC_CHANGED)) {
+				if (_ctx.time < timeout) {
+					left++;
+					continue;
+				}
+
+				error = ide::STATUS_TIMEOUT;
+			}
+
+			pending[i] = false;
+
+			LOG_APP(
+				"drive %d: %s, ready=%d ms", i, ide::getErrorString(error),
+				_getElapsedTime(_ctx, startTime)
+			);
+		}
+
+		if (left)
+			delayMicroseconds(_IDE_POLL_DELAY);
 	}
 
 	_fileInitWorker();
@@ -109,12 +162,23 @@ bool App::_fileInitWorker(void) {
 	_fileIO.initIDE();
 
 	_workerStatus.update(2, 3, WSTR("App.fileInitWorker.loadResources"));
+	_fileIO.setDriveProfile(ide::PROFILE_PERFORMANCE);
 	if (_fileIO.loadResourceFile(EXTERNAL_DATA_DIR "/resource.zip"))
 		_loadResources();
 
 	return true;
 }
 
+// Enumerates the directory shown by the file browser, so that the UI never has
+// to wait for the drive while scrolling through it. Runs until the file browser
+// is hidden or starts loading another directory.
+bool App::_fileBrowserWorker(void) {
+	while (_fileBrowserScreen.runScanStep(_ctx))
+		__asm__ volatile("" ::: "memory");
+
+	return true;
+}
+
 struct Launcher {
 public:
 	const char *path;
@@ -139,6 +203,7 @@ static const Launcher _LAUNCHERS[]{
 
 bool App::_executableWorker(void) {
 	_workerStatus.update(0, 2, WSTR("App.executableWorker.init"));
+	_fileIO.setDriveProfile(ide::PROFILE_PERFORMANCE);
 
 	auto       region = _storageActionsScreen.selectedRegion;
 	const char *path  = _fileBrowserScreen.selectedPath;
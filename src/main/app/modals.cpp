@@ -293,13 +293,314 @@ void FileBrowserScreen::_setPathToChild(const char *entry) {
 	);
 }
 
+/* File browser screen */
+
+bool FileBrowserWindow::add(int index, const file::FileInfo &entry) {
+	// As entries are always added in order, only the one immediately after
+	// the last entry in the window can be added.
+	if (index != (start + length))
+		return false;
+	if (length >= FILE_BROWSER_WINDOW_LENGTH)
+		return false;
+
+	__builtin_memcpy(
+		&entries.as<file::FileInfo>()[length++], &entry, sizeof(entry)
+	);
+	return true;
+}
+
+void FileBrowserWindow::move(int first, int last) {
+	// Center the window around the given range of entries.
+	start  = util::max((first + last - FILE_BROWSER_WINDOW_LENGTH) / 2 + 1, 0);
+	length = 0;
+}
+
+static constexpr int _SCAN_BATCH_LENGTH   = 16;
+static constexpr int _FIRST_PAGE_LENGTH   = FILE_BROWSER_WINDOW_LENGTH;
+static constexpr int _VISIBLE_ITEM_MARGIN = FILE_BROWSER_WINDOW_LENGTH / 4;
+static constexpr int _CHECKPOINT_INTERVAL = 32;
+
+void FileBrowserScreen::_closeDirectory(void) {
+	if (!_directory)
+		return;
+
+	_directory->close();
+	delete _directory;
+	_directory = nullptr;
+}
+
 void FileBrowserScreen::_unloadDirectory(void) {
-	_listLength     = 0;
-	_numFiles       = 0;
-	_numDirectories = 0;
+	_closeDirectory();
 
-	_files.destroy();
-	_directories.destroy();
+	_listLength         = 0;
+	_isCounting         = false;
+	_numFiles           = 0;
+	_numDirectories     = 0;
+	_numCheckpoints     = 0;
+	_checkpointInterval = _CHECKPOINT_INTERVAL;
+
+	_files.entries.destroy();
+	_directories.entries.destroy();
+}
+
+void FileBrowserScreen::_addCheckpoint(void) {
+	int position = _directoryIndex + _fileIndex;
+
+	if (position != (_numCheckpoints * _checkpointInterval))
+		return;
+
+	// If the checkpoint list is full, drop every other checkpoint and halve
+	// the rate at which new ones are added.
+	if (_numCheckpoints >= FILE_BROWSER_MAX_CHECKPOINTS) {
+		for (int i = 0; i < (FILE_BROWSER_MAX_CHECKPOINTS / 2); i++)
+			_checkpoints[i] = _checkpoints[i * 2];
+
+		_numCheckpoints      = FILE_BROWSER_MAX_CHECKPOINTS / 2;
+		_checkpointInterval *= 2;
+	}
+
+	auto &checkpoint = _checkpoints[_numCheckpoints++];
+
+	checkpoint.directoryIndex = _directoryIndex;
+	checkpoint.fileIndex      = _fileIndex;
+}
+
+bool FileBrowserScreen::_isPassNeeded(void) const {
+	return _isCounting
+		|| !_files.isComplete(_numFiles)
+		|| !_directories.isComplete(_numDirectories);
+}
+
+bool FileBrowserScreen::_startPass(ui::Context &ctx) {
+	// Determine how far into the directory the pass can start without skipping
+	// any entry that has yet to be counted or loaded into a window, then find
+	// the closest position to it that is known.
+	int lastDirectory = _numDirectories;
+	int lastFile      = _numFiles;
+
+	if (!_directories.isComplete(_numDirectories))
+		lastDirectory = _directories.start + _directories.length;
+	if (!_files.isComplete(_numFiles))
+		lastFile = _files.start + _files.length;
+
+	int directoryIndex = 0, fileIndex = 0;
+
+	if ((lastDirectory == _numDirectories) && (lastFile == _numFiles)) {
+		directoryIndex = _numDirectories;
+		fileIndex      = _numFiles;
+	} else {
+		for (int i = _numCheckpoints - 1; i >= 0; i--) {
+			auto &checkpoint = _checkpoints[i];
+
+			if (
+				(checkpoint.directoryIndex <= lastDirectory) &&
+				(checkpoint.fileIndex <= lastFile)
+			) {
+				directoryIndex = checkpoint.directoryIndex;
+				fileIndex      = checkpoint.fileIndex;
+				break;
+			}
+		}
+	}
+
+	// If the directory is still open, try seeking within it first. Providers
+	// that can only enumerate sequentially may still be able to carry on from
+	// their current position, as long as they have not gone past it.
+	if (_directory) {
+		if (_directory->seek(directoryIndex + fileIndex)) {
+			_directoryIndex = directoryIndex;
+			_fileIndex      = fileIndex;
+			return true;
+		}
+		if ((_directoryIndex <= lastDirectory) && (_fileIndex <= lastFile))
+			return true;
+
+		_closeDirectory();
+	}
+
+	_directory = APP->_fileIO.vfs.openDirectory(_currentPath);
+
+	if (!_directory)
+		return false;
+
+	if (!_directory->seek(directoryIndex + fileIndex)) {
+		directoryIndex = 0;
+		fileIndex      = 0;
+	}
+
+	_directoryIndex = directoryIndex;
+	_fileIndex      = fileIndex;
+	return true;
+}
+
+// Adds a batch of entries read from the directory to the windows. If fewer
+// entries than requested were returned, the end of the directory has been
+// reached.
+void FileBrowserScreen::_addEntries(
+	const file::FileInfo *entries, int count, int requested
+) {
+	for (int i = 0; i < count; i++) {
+		auto &entry = entries[i];
+
+		_addCheckpoint();
+
+		// Entries are only counted the first time they are encountered, as a
+		// pass may start before the last counted entry.
+		if (entry.attributes & file::DIRECTORY) {
+			if (_directoryIndex >= _numDirectories) {
+				// Directories are listed before files, so keep the same file
+				// selected if it gets pushed down by a new directory.
+				if (_activeItem >= (_listLength - _numFiles))
+					_activeItem++;
+
+				_numDirectories++;
+				_listLength++;
+			}
+
+			_directories.add(_directoryIndex++, entry);
+		} else {
+			if (_fileIndex >= _numFiles) {
+				_numFiles++;
+				_listLength++;
+			}
+
+			_files.add(_fileIndex++, entry);
+		}
+	}
+
+	if (count < requested) {
+		// Once the end of the directory is reached, start another pass if any
+		// of the windows was moved while it was being counted and still has to
+		// be filled. Windows moved later on trigger a new pass immediately.
+		bool wasCounting = _isCounting;
+
+		_closeDirectory();
+		_isCounting = false;
+
+		if (wasCounting && _isPassNeeded())
+			_passRequested = true;
+	} else if (!_isPassNeeded()) {
+		// Close the directory as soon as both windows have been filled rather
+		// than keeping it open until the end of the pass.
+		_closeDirectory();
+	}
+}
+
+// Enumerates entries synchronously. This is only done to fill the first page
+// when loading a directory, so that its contents can be checked right away.
+void FileBrowserScreen::_scanEntries(int count) {
+	file::FileInfo batch[_SCAN_BATCH_LENGTH];
+
+	while (_directory && (count > 0)) {
+		int length = util::min(count, _SCAN_BATCH_LENGTH);
+		int actual = _directory->getEntries(batch, length);
+		count     -= length;
+
+		_addEntries(batch, actual, length);
+	}
+}
+
+void FileBrowserScreen::_startScan(ui::Context &ctx) {
+	// Resume counting or filling the windows if the directory was closed in
+	// the meantime.
+	if (!_directory && _isPassNeeded())
+		_passRequested = true;
+
+	_scanActive = true;
+	APP->_startWorker(&App::_fileBrowserWorker, *this);
+}
+
+void FileBrowserScreen::_stopScan(ui::Context &ctx) {
+	// Wait for the worker to finish the batch it is reading (if any), after
+	// which it will stop.
+	_scanActive = false;
+	APP->_waitForWorkerIO();
+}
+
+// Called repeatedly by the file browser worker to read the next batch of
+// entries, or to start another pass if needed. Returns false once the worker
+// should stop.
+bool FileBrowserScreen::runScanStep(ui::Context &ctx) {
+	auto enable = disableInterrupts();
+	bool active = _scanActive;
+
+	APP->_workerIOActive = active;
+
+	if (enable)
+		enableInterrupts();
+	if (!active)
+		return false;
+
+	if (_passRequested) {
+		_passRequested = false;
+
+		if (!_startPass(ctx)) {
+			LOG_APP("failed to reopen %s", _currentPath);
+			_isCounting = false;
+		}
+	}
+
+	if (_directory) {
+		file::FileInfo batch[_SCAN_BATCH_LENGTH];
+
+		int actual = _directory->getEntries(batch, _SCAN_BATCH_LENGTH);
+
+		enable = disableInterrupts();
+		_addEntries(batch, actual, _SCAN_BATCH_LENGTH);
+
+		if (enable)
+			enableInterrupts();
+	}
+
+	APP->_workerIOActive = false;
+	return true;
+}
+
+void FileBrowserScreen::_updateWindows(ui::Context &ctx) {
+	// Determine which entries are currently (or about to become) visible and
+	// move the windows if they no longer cover them.
+	int first = _activeItem - _VISIBLE_ITEM_MARGIN;
+	int last  = _activeItem + _VISIBLE_ITEM_MARGIN;
+
+	if (!_isRoot) {
+		first--;
+		last--;
+	}
+
+	bool moved = false;
+
+	int firstDir = util::max(first, 0);
+	int lastDir  = util::min(last, _numDirectories - 1);
+
+	if ((firstDir <= lastDir) && !_directories.covers(firstDir, lastDir)) {
+		_directories.move(firstDir, lastDir);
+		moved = true;
+	}
+
+	int firstFile = util::max(first - _numDirectories, 0);
+	int lastFile  = util::min(last - _numDirectories, _numFiles - 1);
+
+	if ((firstFile <= lastFile) && !_files.covers(firstFile, lastFile)) {
+		_files.move(firstFile, lastFile);
+		moved = true;
+	}
+
+	// If the directory is still being counted, the moved windows will be
+	// filled by the next pass. Otherwise have the worker start a new pass from
+	// the closest checkpoint (or carry on with the current one, if possible).
+	if (moved && !_isCounting)
+		_passRequested = true;
+}
+
+const file::FileInfo *FileBrowserScreen::_getEntry(
+	int index, bool &isDirectory
+) const {
+	isDirectory = (index < _numDirectories);
+
+	if (isDirectory)
+		return _directories.get(index);
+	else
+		return _files.get(index - _numDirectories);
 }
 
 const char *FileBrowserScreen::_getItemName(ui::Context &ctx, int index) const {
@@ -313,16 +614,12 @@ const char *FileBrowserScreen::_getItemName(ui::Context &ctx, int index) const {
 	if (index < 0) {
 		name[0] = CH_PARENT_DIR_ICON;
 		path    = STR("FileBrowserScreen.parentDir");
-	} else if (index < _numDirectories) {
-		auto entries = _directories.as<file::FileInfo>();
-
-		name[0] = CH_DIR_ICON;
-		path    = entries[index].name;
 	} else {
-		auto entries = _files.as<file::FileInfo>();
+		bool isDirectory;
+		auto entry = _getEntry(index, isDirectory);
 
-		name[0] = CH_FILE_ICON;
-		path    = entries[index - _numDirectories].name;
+		name[0] = isDirectory ? CH_DIR_ICON : CH_FILE_ICON;
+		path    = entry ? entry->name : STR("FileBrowserScreen.loading");
 	}
 
 	name[1] = ' ';
@@ -334,63 +631,48 @@ const char *FileBrowserScreen::_getItemName(ui::Context &ctx, int index) const {
 int FileBrowserScreen::loadDirectory(
 	ui::Context &ctx, const char *path, bool updateCurrent
 ) {
+	_stopScan(ctx);
 	_unloadDirectory();
 
-	// Count the number of files and subfolders in the current directory, so
-	// that we can allocate enough space for them.
 	auto directory = APP->_fileIO.vfs.openDirectory(path);
 
 	if (!directory)
 		return -1;
 
-	file::FileInfo info;
+	if (updateCurrent)
+		__builtin_strncpy(_currentPath, path, sizeof(_currentPath));
 
-	while (directory->getEntry(info)) {
-		if (info.attributes & file::DIRECTORY)
-			_numDirectories++;
-		else
-			_numFiles++;
+	if (
+		!_files.entries.allocate<file::FileInfo>(FILE_BROWSER_WINDOW_LENGTH) ||
+		!_directories.entries.allocate<file::FileInfo>(
+			FILE_BROWSER_WINDOW_LENGTH
+		)
+	) {
+		directory->close();
+		delete directory;
+		return -1;
 	}
 
-	directory->close();
-	delete directory;
+	_directory      = directory;
+	_isCounting     = true;
+	_fileIndex      = 0;
+	_directoryIndex = 0;
+
+	_files.start        = 0;
+	_files.length       = 0;
+	_directories.start  = 0;
+	_directories.length = 0;
 
 	_activeItem = 0;
-	_listLength = _numFiles + _numDirectories;
 	_isRoot     = bool(!__builtin_strchr(path, '/'));
+	_listLength = _isRoot ? 0 : 1;
 
-	if (!_isRoot)
-		_listLength++;
+	// Only enumerate enough entries to fill the first page here. The rest of
+	// the directory will be counted in the background by a worker while the
+	// list is already being displayed.
+	_scanEntries(_FIRST_PAGE_LENGTH);
 
 	LOG_APP("files=%d, dirs=%d", _numFiles, _numDirectories);
-
-	file::FileInfo *files       = nullptr;
-	file::FileInfo *directories = nullptr;
-
-	if (_numFiles)
-		files       = _files.allocate<file::FileInfo>(_numFiles);
-	if (_numDirectories)
-		directories = _directories.allocate<file::FileInfo>(_numDirectories);
-
-	// Iterate over all entries again to populate the newly allocated arrays.
-	directory = APP->_fileIO.vfs.openDirectory(path);
-
-	if (!directory)
-		return -1;
-
-	while (directory->getEntry(info)) {
-		auto ptr = (info.attributes & file::DIRECTORY)
-			? (directories++) : (files++);
-
-		__builtin_memcpy(ptr, &info, sizeof(file::FileInfo));
-	}
-
-	directory->close();
-	delete directory;
-
-	if (updateCurrent)
-		__builtin_strncpy(_currentPath, path, sizeof(_currentPath));
-
 	return _numFiles + _numDirectories;
 }
 
@@ -400,11 +682,23 @@ void FileBrowserScreen::show(ui::Context &ctx, bool goBack) {
 	_itemPrompt = STR("FileBrowserScreen.itemPrompt");
 
 	ListScreen::show(ctx, goBack);
+	_startScan(ctx);
+}
+
+void FileBrowserScreen::hide(ui::Context &ctx, bool goBack) {
+	// Do not keep the directory open while other screens (and workers, which
+	// may access or even unmount the same filesystem) are active.
+	_stopScan(ctx);
+	_closeDirectory();
+
+	ListScreen::hide(ctx, goBack);
 }
 
 void FileBrowserScreen::update(ui::Context &ctx) {
 	ListScreen::update(ctx);
 
+	_updateWindows(ctx);
+
 	if (ctx.buttons.pressed(ui::BTN_START)) {
 		if (ctx.buttons.held(ui::BTN_LEFT) || ctx.buttons.held(ui::BTN_RIGHT)) {
 			ctx.show(APP->_filePickerScreen, true, true);
@@ -414,15 +708,26 @@ void FileBrowserScreen::update(ui::Context &ctx) {
 			if (!_isRoot)
 				index--;
 
-			if (index < _numDirectories) {
-				auto entries = _directories.as<file::FileInfo>();
+			bool                 isDirectory = true;
+			const file::FileInfo *entry      = nullptr;
+
+			// Ignore the button if the selected entry has not been loaded yet.
+			if (index >= 0) {
+				entry = _getEntry(index, isDirectory);
 
+				if (!entry)
+					return;
+			}
+
+			if (isDirectory) {
 				if (index < 0)
 					_setPathToParent();
 				else
-					_setPathToChild(entries[index].name);
+					_setPathToChild(entry->name);
 
-				if (loadDirectory(ctx, selectedPath) < 0) {
+				if (loadDirectory(ctx, selectedPath) >= 0) {
+					_startScan(ctx);
+				} else {
 					loadDirectory(ctx, _currentPath, false);
 
 					APP->_messageScreen.previousScreens[MESSAGE_ERROR] = this;
@@ -433,9 +738,7 @@ void FileBrowserScreen::update(ui::Context &ctx) {
 					ctx.show(APP->_messageScreen, false, true);
 				}
 			} else {
-				auto entries = _files.as<file::FileInfo>();
-
-				_setPathToChild(entries[index - _numDirectories].name);
+				_setPathToChild(entry->name);
 				APP->_filePickerScreen._callback(ctx);
 			}
 		}
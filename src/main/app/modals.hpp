@@ -95,28 +95,101 @@ public:
 	void update(ui::Context &ctx);
 };
 
+/* File browser screen */
+
+static constexpr int FILE_BROWSER_WINDOW_LENGTH = 64;
+
+// Only a limited window of entries around the currently visible ones is kept
+// in memory for each list (directories and files). Each window is filled
+// sequentially as the directory is enumerated.
+class FileBrowserWindow {
+public:
+	util::Data entries;
+	int        start, length;
+
+	inline FileBrowserWindow(void)
+	: start(0), length(0) {}
+
+	inline const file::FileInfo *get(int index) const {
+		index -= start;
+
+		if ((index < 0) || (index >= length))
+			return nullptr;
+
+		return &entries.as<file::FileInfo>()[index];
+	}
+	inline bool covers(int first, int last) const {
+		return (first >= start) && (last < (start + FILE_BROWSER_WINDOW_LENGTH));
+	}
+	inline bool isComplete(int total) const {
+		return length >= util::min(FILE_BROWSER_WINDOW_LENGTH, total - start);
+	}
+
+	bool add(int index, const file::FileInfo &entry);
+	void move(int first, int last);
+};
+
+static constexpr int FILE_BROWSER_MAX_CHECKPOINTS = 128;
+
+// The number of directories and files preceding every Nth entry is recorded
+// while the directory is counted, allowing a pass to resume from the closest
+// entry rather than from the beginning of the directory.
+struct FileBrowserCheckpoint {
+public:
+	int directoryIndex, fileIndex;
+};
+
 class FileBrowserScreen : public ui::ListScreen {
 private:
 	char _currentPath[file::MAX_PATH_LENGTH];
-	bool _isRoot;
+	bool _isRoot, _isCounting;
+
+	// The directory is enumerated by a background worker after the first
+	// page. The worker only updates the windows and counters with interrupts
+	// disabled, so that the UI never sees them half-updated.
+	volatile bool _scanActive, _passRequested;
 
-	int        _numFiles, _numDirectories;
-	util::Data _files, _directories;
+	file::Directory *_directory;
+
+	int               _numFiles, _numDirectories;
+	int               _fileIndex, _directoryIndex;
+	FileBrowserWindow _files, _directories;
+
+	int                   _numCheckpoints, _checkpointInterval;
+	FileBrowserCheckpoint _checkpoints[FILE_BROWSER_MAX_CHECKPOINTS];
 
 	void _setPathToParent(void);
 	void _setPathToChild(const char *entry);
+	void _closeDirectory(void);
 	void _unloadDirectory(void);
 
+	void _addCheckpoint(void);
+	bool _isPassNeeded(void) const;
+	bool _startPass(ui::Context &ctx);
+	void _addEntries(const file::FileInfo *entries, int count, int requested);
+	void _scanEntries(int count);
+	void _startScan(ui::Context &ctx);
+	void _stopScan(ui::Context &ctx);
+	void _updateWindows(ui::Context &ctx);
+	const file::FileInfo *_getEntry(int index, bool &isDirectory) const;
+
 protected:
 	const char *_getItemName(ui::Context &ctx, int index) const;
 
 public:
 	char selectedPath[file::MAX_PATH_LENGTH];
 
+	inline FileBrowserScreen(void)
+	: _isCounting(false), _scanActive(false), _passRequested(false),
+	_directory(nullptr), _numFiles(0), _numDirectories(0), _numCheckpoints(0),
+	_checkpointInterval(1) {}
+
 	int loadDirectory(
 		ui::Context &ctx, const char *path, bool updateCurrent = true
 	);
+	bool runScanStep(ui::Context &ctx);
 
 	void show(ui::Context &ctx, bool goBack = false);
+	void hide(ui::Context &ctx, bool goBack = false);
 	void update(ui::Context &ctx);
 };
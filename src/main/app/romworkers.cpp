@@ -19,8 +19,10 @@
 #include <stdio.h>
 #include "common/file/file.hpp"
 #include "common/defs.hpp"
+#include "common/ide.hpp"
 #include "common/rom.hpp"
 #include "common/romdrivers.hpp"
+#include "common/romwriter.hpp"
 #include "common/util.hpp"
 #include "main/app/app.hpp"
 #include "main/app/romactions.hpp"
@@ -70,6 +72,15 @@ static const RegionInfo _REGION_INFO[]{
 static constexpr size_t _DUMP_CHUNK_LENGTH   = 0x80000;
 static constexpr size_t _DUMP_CHUNKS_PER_CRC = 32; // Save CRC32 every 16 MB
 
+// Logging IDE statistics after each dump makes it possible to tell whether a
+// slow dump was caused by the drive (e.g. retries or long DRQ waits).
+static void _logIDEStats(void) {
+	for (auto &dev : ide::devices) {
+		if (dev.flags & ide::DEVICE_READY)
+			dev.logStats();
+	}
+}
+
 // TODO: all these *really* need a cleanup...
 
 bool App::_romChecksumWorker(void) {
@@ -112,6 +123,12 @@ bool App::_romChecksumWorker(void) {
 
 bool App::_romDumpWorker(void) {
 	_workerStatus.update(0, 1, WSTR("App.romDumpWorker.init"));
+	_fileIO.setDriveProfile(ide::PROFILE_PERFORMANCE);
+
+	// Clear the statistics so that the ones saved at the end only reflect the
+	// accesses made while dumping.
+	for (auto &dev : ide::devices)
+		dev.resetStats();
 
 	// Store all dumps in a subdirectory named "dumpNNNN" within the main data
 	// folder.
@@ -178,6 +195,8 @@ bool App::_romDumpWorker(void) {
 		LOG_APP("%s saved", filePath);
 	}
 
+	_logIDEStats();
+
 	_messageScreen.setMessage(
 		MESSAGE_SUCCESS, WSTR("App.romDumpWorker.success"), dirPath
 	);
@@ -196,8 +215,25 @@ _fileError:
 	return false;
 }
 
+// The region writer reports progress through a callback, which forwards it to
+// the worker status along with the message for the current step.
+struct WriterProgress {
+public:
+	WorkerStatus *status;
+	const char   *messages[3];
+};
+
+static void _writerCallback(
+	rom::WriterStep step, size_t part, size_t total, void *arg
+) {
+	auto progress = reinterpret_cast<WriterProgress *>(arg);
+
+	progress->status->update(part, total, progress->messages[step]);
+}
+
 bool App::_romRestoreWorker(void) {
 	_workerStatus.update(0, 1, WSTR("App.romRestoreWorker.init"));
+	_fileIO.setDriveProfile(ide::PROFILE_PERFORMANCE);
 
 	const char *path = _fileBrowserScreen.selectedPath;
 	auto       _file = _fileIO.vfs.openFile(path, file::READ);
@@ -205,195 +241,104 @@ bool App::_romRestoreWorker(void) {
 	auto region       = _storageActionsScreen.selectedRegion;
 	auto regionLength = _storageActionsScreen.selectedLength;
 
-	size_t bytesWritten = 0;
-
-	util::Data buffers, chunkLengths;
-
-	if (!_file)
-		goto _fileError;
-	if (!_romEraseWorker())
+	if (!_file) {
+		_messageScreen.setMessage(
+			MESSAGE_ERROR, WSTR("App.romRestoreWorker.fileError"), path
+		);
 		return false;
+	}
 
-	rom::Driver *driver;
-	size_t      chipLength, numChips, maxChunkLength;
-
-	driver         = region->newDriver();
-	chipLength     = driver->getChipSize().chipLength;
-	numChips       = (regionLength + chipLength - 1) / chipLength;
-	maxChunkLength = util::min(regionLength, _DUMP_CHUNK_LENGTH / numChips);
-
-	LOG_APP("%d chips, buf=%d", numChips, maxChunkLength);
-
-	rom::DriverError error;
-
-	buffers.allocate(maxChunkLength * numChips);
-	chunkLengths.allocate<size_t>(numChips);
-
-	// Parallelize writing by buffering a chunk for each chip into RAM, then
-	// writing all chunks to the respective chips at the same time.
-	for (size_t i = 0; i < chipLength; i += maxChunkLength) {
-		_workerStatus.update(i, chipLength, WSTR("App.romRestoreWorker.write"));
-
-		auto   bufferPtr   = buffers.as<uint8_t>();
-		auto   lengthPtr   = chunkLengths.as<size_t>();
-		size_t offset      = i;
-		size_t totalLength = 0;
-
-		for (
-			size_t j = numChips; j > 0; j--, bufferPtr += maxChunkLength,
-			offset += chipLength
-		) {
-			_file->seek(offset);
-			auto length = _file->read(bufferPtr, maxChunkLength);
-
-			// Data is written 16 bits at a time, so the chunk must be padded to
-			// an even number of bytes.
-			if (length % 2)
-				bufferPtr[length++] = 0xff;
-
-			*(lengthPtr++) = length;
-			totalLength   += length;
+	auto              driver = region->newDriver();
+	rom::RegionWriter writer(*region, *driver, regionLength);
+	WriterProgress    progress{
+		.status   = &_workerStatus,
+		.messages = {
+			WSTR("App.romRestoreWorker.compare"),
+			WSTR("App.romRestoreWorker.erase"),
+			WSTR("App.romRestoreWorker.write")
 		}
+	};
 
-		// Stop once there is no more data to write.
-		if (!totalLength)
-			break;
-
-		bufferPtr = buffers.as<uint8_t>();
-		offset    = i;
-
-		for (
-			size_t j = 0; j < maxChunkLength; j += 2, bufferPtr += 2,
-			offset += 2
-		) {
-			auto chunkOffset = offset;
-			auto chunkPtr    = bufferPtr;
-			lengthPtr        = chunkLengths.as<size_t>();
-
-			for (
-				size_t k = numChips; k > 0;
-				k--, chunkPtr += maxChunkLength, chunkOffset += chipLength
-			) {
-				if (j >= *(lengthPtr++))
-					continue;
-
-				auto value = *reinterpret_cast<const uint16_t *>(chunkPtr);
-
-				driver->write(chunkOffset, value);
-			}
-
-			chunkOffset = offset;
-			chunkPtr    = bufferPtr;
-			lengthPtr   = chunkLengths.as<size_t>();
-
-			for (
-				size_t k = numChips; k > 0; k--, chunkPtr += maxChunkLength,
-				chunkOffset += chipLength, bytesWritten += 2
-			) {
-				if (j >= *(lengthPtr++))
-					continue;
+	writer.callback    = &_writerCallback;
+	writer.callbackArg = &progress;
 
-				auto value = *reinterpret_cast<const uint16_t *>(chunkPtr);
-				error      = driver->flushWrite(chunkOffset, value);
-
-				if (error)
-					goto _flashError;
-			}
-		}
-	}
-
-	util::Hash message;
+	_checksumScreen.valid = false;
 
-	message = (_file->size > regionLength)
-		? "App.romRestoreWorker.overflow"_h
-		: "App.romRestoreWorker.success"_h;
+	auto error = writer.restore(*_file);
+	auto size  = _file->size;
 
-	buffers.destroy();
-	chunkLengths.destroy();
 	_file->close();
 	delete _file;
 	delete driver;
 
-	_messageScreen.setMessage(MESSAGE_SUCCESS, WSTRH(message), bytesWritten);
-	return true;
-
-_fileError:
-	_messageScreen.setMessage(
-		MESSAGE_ERROR, WSTR("App.romRestoreWorker.fileError"), path
-	);
-	return false;
+	if (error == rom::UNSUPPORTED_OP) {
+		_messageScreen.setMessage(
+			MESSAGE_ERROR, WSTR("App.romRestoreWorker.unsupported")
+		);
+		return false;
+	}
+	if (error) {
+		_messageScreen.setMessage(
+			MESSAGE_ERROR, WSTR("App.romRestoreWorker.flashError"),
+			rom::getErrorString(error), writer.bytesWritten
+		);
+		return false;
+	}
 
-_flashError:
-	buffers.destroy();
-	chunkLengths.destroy();
-	_file->close();
-	delete _file;
-	delete driver;
+	auto message = (size > regionLength)
+		? "App.romRestoreWorker.overflow"_h
+		: "App.romRestoreWorker.success"_h;
 
 	_messageScreen.setMessage(
-		MESSAGE_ERROR, WSTR("App.romRestoreWorker.flashError"),
-		rom::getErrorString(error), bytesWritten
+		MESSAGE_SUCCESS, WSTRH(message), writer.sectorsSkipped,
+		writer.sectorsProgrammed, writer.sectorsErased, writer.bytesWritten
 	);
-	return false;
+	return true;
 }
 
 bool App::_romEraseWorker(void) {
 	auto region       = _storageActionsScreen.selectedRegion;
 	auto regionLength = _storageActionsScreen.selectedLength;
 
-	auto   driver       = region->newDriver();
-	size_t chipLength   = driver->getChipSize().chipLength;
-	size_t sectorLength = driver->getChipSize().eraseSectorLength;
-	//size_t numChips     = (regionLength + chipLength - 1) / chipLength;
-
-	size_t sectorsErased = 0;
-
-	if (!chipLength)
-		goto _unsupported;
+	auto              driver = region->newDriver();
+	rom::RegionWriter writer(*region, *driver, regionLength);
+	WriterProgress    progress{
+		.status   = &_workerStatus,
+		.messages = {
+			nullptr,
+			WSTR("App.romEraseWorker.erase"),
+			nullptr
+		}
+	};
 
-	rom::DriverError error;
+	writer.callback    = &_writerCallback;
+	writer.callbackArg = &progress;
 
 	_checksumScreen.valid = false;
 
-	// Parallelize erasing by sending the same sector erase command to all chips
-	// at the same time.
-	for (size_t i = 0; i < chipLength; i += sectorLength) {
-		_workerStatus.update(i, chipLength, WSTR("App.romEraseWorker.erase"));
-
-		for (size_t j = 0; j < regionLength; j += chipLength)
-			driver->eraseSector(i + j);
+	auto error = writer.erase();
 
-		for (size_t j = 0; j < regionLength; j += chipLength, sectorsErased++) {
-			error = driver->flushErase(i + j);
+	delete driver;
 
-			if (error)
-				goto _flashError;
-		}
+	if (error == rom::UNSUPPORTED_OP) {
+		_messageScreen.setMessage(
+			MESSAGE_ERROR, WSTR("App.romEraseWorker.unsupported")
+		);
+		return false;
+	}
+	if (error) {
+		_messageScreen.setMessage(
+			MESSAGE_ERROR, WSTR("App.romEraseWorker.flashError"),
+			rom::getErrorString(error), writer.sectorsErased
+		);
+		return false;
 	}
-
-	delete driver;
 
 	_messageScreen.setMessage(
-		MESSAGE_SUCCESS, WSTR("App.romEraseWorker.success"), sectorsErased
+		MESSAGE_SUCCESS, WSTR("App.romEraseWorker.success"),
+		writer.sectorsErased
 	);
 	return true;
-
-_flashError:
-	delete driver;
-
-	_messageScreen.setMessage(
-		MESSAGE_ERROR, WSTR("App.romEraseWorker.flashError"),
-		rom::getErrorString(error), sectorsErased
-	);
-	return false;
-
-_unsupported:
-	delete driver;
-
-	_messageScreen.setMessage(
-		MESSAGE_ERROR, WSTR("App.romEraseWorker.unsupported")
-	);
-	return false;
 }
 
 bool App::_flashExecutableWriteWorker(void) {
@@ -430,6 +375,7 @@ bool App::_flashHeaderWriteWorker(void) {
 		goto _flashError;
 
 	_workerStatus.update(1, 2, WSTR("App.flashHeaderWriteWorker.write"));
+	driver->enterBulkWrite(0);
 
 	// Write the new header (if any).
 	if (!_romHeaderDump.isDataEmpty()) {
@@ -465,6 +411,7 @@ bool App::_flashHeaderWriteWorker(void) {
 			goto _flashError;
 	}
 
+	driver->exitBulkWrite(0);
 	buffer.destroy();
 	delete driver;
 	return true;
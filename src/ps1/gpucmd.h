@@ -27,7 +27,7 @@
 
 DEF32 gp0_tag(size_t length, void *next) {
 	return 0
-		| (((uint32_t) next   & 0xffffff) <<  0)
+		| (((uintptr_t) next  & 0xffffff) <<  0)
 		| (((uint32_t) length & 0x0000ff) << 24);
 }
 